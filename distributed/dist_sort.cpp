@@ -0,0 +1,481 @@
+#include "dist_sort.hpp"
+#include "net.hpp"
+#include "../merge_sort/external_merge_sort.hpp"
+#include "../merge_sort/io_utils.hpp"
+#include "../merge_sort/logger.hpp"
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <map>
+#include <thread>
+#include <chrono>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <sys/socket.h>
+#include <sys/resource.h>
+
+// Records per destination buffered before a send.
+static const size_t SEND_BATCH = 16384;
+// Samples taken per worker when choosing splitters.
+static const uint64_t SAMPLES_PER_WORKER = 4096;
+
+static double secondsSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+std::string controlAddress(const DistOptions& options) {
+    if (!options.tcpBase.empty()) return "tcp:" + options.tcpBase;
+    return "unix:" + options.workDir + "/control.sock";
+}
+
+std::string workerAddress(const DistOptions& options, int id) {
+    if (!options.tcpBase.empty()) {
+        size_t colon = options.tcpBase.rfind(':');
+        int port = std::stoi(options.tcpBase.substr(colon + 1)) + 1 + id;
+        return "tcp:" + options.tcpBase.substr(0, colon) + ":" + std::to_string(port);
+    }
+    return "unix:" + options.workDir + "/worker_" + std::to_string(id) + ".sock";
+}
+
+// ---------------------------------------------------------------- worker
+
+// Destination for key v. A key equal to one or more splitters may go to any
+// worker from the first to the last range it touches without breaking the
+// global order, so such keys are spread round-robin to keep heavy
+// duplicates from landing on one worker.
+static int ownerOf(int v, const std::vector<int>& splitters, uint64_t& spread) {
+    auto lo = std::lower_bound(splitters.begin(), splitters.end(), v);
+    auto hi = std::upper_bound(lo, splitters.end(), v);
+    int first = static_cast<int>(lo - splitters.begin());
+    int span = static_cast<int>(hi - lo);
+    if (span == 0) return first;
+    return first + static_cast<int>(spread++ % (span + 1));
+}
+
+// Accepts one connection per peer and appends everything they send to the
+// partition file. Returns the number of records received.
+static uint64_t receivePartition(int listenFd, size_t peers, const std::string& partFile) {
+    Buffer buf(1 << 20);
+    FileWriter part(partFile, buf);
+    std::vector<pollfd> conns;
+    std::vector<std::string> carry(peers); // partial records split across recv calls
+    for (size_t i = 0; i < peers; ++i) {
+        int fd = acceptOn(listenFd);
+        if (fd < 0) break;
+        conns.push_back({fd, POLLIN, 0});
+    }
+    std::vector<char> chunk(1 << 20);
+    uint64_t received = 0;
+    size_t open = conns.size();
+    while (open > 0) {
+        if (poll(conns.data(), conns.size(), -1) < 0) continue;
+        for (size_t c = 0; c < conns.size(); ++c) {
+            if (conns[c].fd < 0 || !(conns[c].revents & (POLLIN | POLLHUP | POLLERR))) continue;
+            ssize_t n = recv(conns[c].fd, chunk.data(), chunk.size(), 0);
+            if (n <= 0) {
+                close(conns[c].fd);
+                conns[c].fd = -1;
+                open--;
+                continue;
+            }
+            std::string& rest = carry[c];
+            size_t pos = 0;
+            // Complete a record left over from the previous recv first.
+            while (!rest.empty() && pos < static_cast<size_t>(n)) {
+                rest.push_back(chunk[pos++]);
+                if (rest.size() == sizeof(int)) {
+                    int v;
+                    std::memcpy(&v, rest.data(), sizeof(int));
+                    part.write(v);
+                    received++;
+                    rest.clear();
+                }
+            }
+            size_t whole = (static_cast<size_t>(n) - pos) / sizeof(int);
+            for (size_t k = 0; k < whole; ++k, pos += sizeof(int)) {
+                int v;
+                std::memcpy(&v, chunk.data() + pos, sizeof(int));
+                part.write(v);
+            }
+            received += whole;
+            rest.append(chunk.data() + pos, static_cast<size_t>(n) - pos);
+        }
+    }
+    part.close();
+    return received;
+}
+
+// Copies a sorted file into the output starting at byte `offset`.
+static bool writeSegment(const std::string& sortedFile, const std::string& outputFile, uint64_t offset) {
+    int out = open(outputFile.c_str(), O_WRONLY);
+    std::ifstream in(sortedFile, std::ios::binary);
+    if (out < 0 || !in) {
+        if (out >= 0) close(out);
+        return false;
+    }
+    std::vector<char> block(1 << 20);
+    bool ok = true;
+    while (ok && (in.read(block.data(), block.size()) || in.gcount() > 0)) {
+        size_t len = static_cast<size_t>(in.gcount());
+        for (size_t done = 0; ok && done < len;) {
+            ssize_t w = pwrite(out, block.data() + done, len - done, static_cast<off_t>(offset + done));
+            ok = w > 0;
+            if (ok) done += static_cast<size_t>(w);
+        }
+        offset += len;
+    }
+    return close(out) == 0 && ok;
+}
+
+bool runWorker(int id, const std::string& controlAddr, const std::string& dataAddr, size_t memLimit,
+               const std::string& workDir, const SortOptions& sort) {
+    const std::string tag = "Worker " + std::to_string(id) + ": ";
+    int listenFd = listenOn(dataAddr);
+    LineChannel control(connectTo(controlAddr));
+    if (listenFd < 0 || control.socket() < 0) {
+        if (listenFd >= 0) close(listenFd);
+        control.close();
+        return false;
+    }
+    control.writeLine("hello " + std::to_string(id) + " " + dataAddr);
+
+    // Plan: paths, this worker's input slice, splitters and peer addresses.
+    std::string line, inputFile, outputFile;
+    uint64_t sliceBegin = 0, sliceEnd = 0;
+    std::vector<int> splitters;
+    std::vector<std::string> peers;
+    while (control.readLine(line) && line != "end") {
+        std::istringstream ss(line);
+        std::string key;
+        ss >> key;
+        ss.get();
+        if (key == "input") std::getline(ss, inputFile);
+        else if (key == "output") std::getline(ss, outputFile);
+        else if (key == "slice") ss >> sliceBegin >> sliceEnd;
+        else if (key == "splitters") {
+            size_t n;
+            ss >> n;
+            splitters.resize(n);
+            for (int& s : splitters) ss >> s;
+        } else if (key == "peer") {
+            std::string addr;
+            std::getline(ss, addr);
+            peers.push_back(addr);
+        }
+    }
+    if (line != "end" || peers.empty()) {
+        std::cerr << tag << "incomplete plan from coordinator" << std::endl;
+        close(listenFd);
+        control.close();
+        return false;
+    }
+
+    // --- Shuffle: read the slice, route each record to its range owner.
+    auto shuffleStart = std::chrono::steady_clock::now();
+    const std::string partFile = workDir + "/partition_" + std::to_string(id) + ".bin";
+    uint64_t received = 0;
+    std::thread receiver([&]() { received = receivePartition(listenFd, peers.size(), partFile); });
+
+    std::vector<int> conns;
+    for (const std::string& peer : peers) conns.push_back(connectTo(peer));
+    bool ok = std::find(conns.begin(), conns.end(), -1) == conns.end();
+    std::vector<std::vector<int>> outgoing(peers.size());
+    uint64_t recordsRead = 0, recordsSent = 0, spread = 0;
+    auto sendBatch = [&](size_t dest) {
+        std::vector<int>& batch = outgoing[dest];
+        ok = ok && sendAll(conns[dest], batch.data(), batch.size() * sizeof(int));
+        if (static_cast<int>(dest) != id) recordsSent += batch.size();
+        batch.clear();
+    };
+    if (ok) {
+        Buffer inBuf(1 << 20);
+        FileReader reader(inputFile, inBuf);
+        reader.skip(sliceBegin);
+        for (uint64_t i = sliceBegin; i < sliceEnd && ok && reader.hasNext(); ++i) {
+            int v = reader.next();
+            size_t dest = static_cast<size_t>(ownerOf(v, splitters, spread));
+            outgoing[dest].push_back(v);
+            if (outgoing[dest].size() >= SEND_BATCH) sendBatch(dest);
+            recordsRead++;
+        }
+        for (size_t d = 0; d < outgoing.size(); ++d) {
+            if (!outgoing[d].empty()) sendBatch(d);
+        }
+    }
+    for (int fd : conns) {
+        if (fd < 0) continue;
+        shutdown(fd, SHUT_WR);
+        close(fd);
+    }
+    receiver.join();
+    close(listenFd);
+    double shuffleSeconds = secondsSince(shuffleStart);
+    if (!ok) {
+        std::cerr << tag << "shuffle failed" << std::endl;
+        control.close();
+        return false;
+    }
+
+    // The coordinator turns everyone's counts into output offsets.
+    control.writeLine("received " + std::to_string(received));
+    uint64_t offset = 0;
+    if (!control.readLine(line) || std::sscanf(line.c_str(), "offset %lu", &offset) != 1) {
+        std::cerr << tag << "no output offset from coordinator" << std::endl;
+        control.close();
+        return false;
+    }
+
+    // --- Local sort with the merge sort engine, in a private temp dir.
+    auto sortStart = std::chrono::steady_clock::now();
+    // Workers share the configured temp dirs, so each gets a subdirectory
+    // for its runs and manifest.
+    SortOptions local = sort;
+    const std::string sub = "/worker_" + std::to_string(id);
+    if (local.tmpDirs.empty()) local.tmpDirs = {workDir};
+    for (std::string& dir : local.tmpDirs) {
+        dir += sub;
+        mkdir(dir.c_str(), 0755);
+    }
+    const std::string sortedFile = local.tmpDirs[0] + "/sorted.bin";
+    ok = externalMergeSort(partFile, sortedFile, memLimit, 0, local);
+    remove(partFile.c_str());
+    double sortSeconds = secondsSince(sortStart);
+
+    auto writeStart = std::chrono::steady_clock::now();
+    ok = ok && writeSegment(sortedFile, outputFile, offset * sizeof(int));
+    remove(sortedFile.c_str());
+    for (const std::string& dir : local.tmpDirs) rmdir(dir.c_str());
+    double writeSeconds = secondsSince(writeStart);
+
+    rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    std::ostringstream done;
+    done << "done records_read=" << recordsRead << " records_sent=" << recordsSent
+         << " bytes_sent=" << recordsSent * sizeof(int) << " records_received=" << received
+         << " shuffle_seconds=" << shuffleSeconds << " sort_seconds=" << sortSeconds
+         << " write_seconds=" << writeSeconds << " peak_rss_bytes=" << usage.ru_maxrss * 1024L
+         << " ok=" << (ok ? 1 : 0);
+    control.writeLine(done.str());
+    control.close();
+    return ok;
+}
+
+// ----------------------------------------------------------- coordinator
+
+// Splitters from evenly spaced samples of the input: worker i receives keys
+// in [splitters[i-1], splitters[i]).
+static std::vector<int> chooseSplitters(const std::string& inputFile, uint64_t records, int workers) {
+    std::vector<int> samples;
+    int fd = open(inputFile.c_str(), O_RDONLY);
+    uint64_t count = std::min<uint64_t>(records, SAMPLES_PER_WORKER * workers);
+    for (uint64_t s = 0; fd >= 0 && s < count; ++s) {
+        int v;
+        off_t pos = static_cast<off_t>((records * s / count) * sizeof(int));
+        if (pread(fd, &v, sizeof(v), pos) == sizeof(v)) samples.push_back(v);
+    }
+    if (fd >= 0) close(fd);
+    std::sort(samples.begin(), samples.end());
+    std::vector<int> splitters;
+    for (int i = 1; i < workers && !samples.empty(); ++i) {
+        splitters.push_back(samples[samples.size() * i / workers]);
+    }
+    return splitters;
+}
+
+static std::map<std::string, std::string> parseFields(const std::string& line) {
+    std::map<std::string, std::string> fields;
+    std::istringstream ss(line);
+    std::string word;
+    while (ss >> word) {
+        size_t eq = word.find('=');
+        if (eq != std::string::npos) fields[word.substr(0, eq)] = word.substr(eq + 1);
+    }
+    return fields;
+}
+
+static const char* WORKER_FIELDS[] = {"records_read", "records_sent", "bytes_sent", "records_received",
+                                      "shuffle_seconds", "sort_seconds", "write_seconds", "peak_rss_bytes"};
+
+static bool writeReport(const std::string& path, const std::string& inputFile, const std::string& outputFile,
+                        uint64_t records, const std::vector<int>& splitters, double sampleSeconds,
+                        double wallSeconds, const std::vector<std::map<std::string, std::string>>& workers) {
+    std::ofstream out(path);
+    if (!out) return false;
+    out << "{\n  \"engine\": \"distributed_merge_sort\",\n  \"input\": \"" << inputFile
+        << "\",\n  \"output\": \"" << outputFile << "\",\n  \"workers\": " << workers.size()
+        << ",\n  \"records\": " << records << ",\n  \"wall_seconds\": " << wallSeconds
+        << ",\n  \"sample_seconds\": " << sampleSeconds << ",\n  \"splitters\": [";
+    for (size_t i = 0; i < splitters.size(); ++i) out << (i ? ", " : "") << splitters[i];
+    out << "],\n  \"worker_metrics\": [";
+    for (size_t w = 0; w < workers.size(); ++w) {
+        out << (w ? "," : "") << "\n    {\"id\": " << w;
+        for (const char* f : WORKER_FIELDS) {
+            auto it = workers[w].find(f);
+            out << ", \"" << f << "\": " << (it == workers[w].end() ? "0" : it->second);
+        }
+        out << ", \"sort_metrics\": \"" << path << ".worker" << w << ".json\"}";
+    }
+    out << "\n  ]\n}\n";
+    return static_cast<bool>(out);
+}
+
+bool runCoordinator(const std::string& inputFile, const std::string& outputFile, size_t memPerWorker,
+                    const DistOptions& options) {
+    auto start = std::chrono::steady_clock::now();
+    const int n = options.workers;
+    struct stat st;
+    if (isStdStream(inputFile) || isStdStream(outputFile) || stat(inputFile.c_str(), &st) != 0 || !S_ISREG(st.st_mode)) {
+        std::cerr << "Distributed sort needs a regular input file and a seekable output file." << std::endl;
+        return false;
+    }
+    const uint64_t records = static_cast<uint64_t>(st.st_size) / sizeof(int);
+    std::cout << "=== Distributed Merge Sort ===" << std::endl;
+    std::cout << "Input: " << inputFile << " (" << records << " records), " << n << " workers, "
+              << memPerWorker << " bytes each" << std::endl;
+
+    mkdir(options.workDir.c_str(), 0755);
+    int listenFd = listenOn(controlAddress(options));
+    if (listenFd < 0) return false;
+
+    std::vector<pid_t> children;
+    if (options.spawn) {
+        for (int i = 0; i < n; ++i) {
+            std::cout.flush();
+            pid_t pid = fork();
+            if (pid == 0) {
+                close(listenFd);
+                // Keep the engines' narration out of the coordinator's output.
+                std::string log = options.workDir + "/worker_" + std::to_string(i) + ".log";
+                if (!freopen(log.c_str(), "w", stdout)) std::cerr << "Cannot open " << log << std::endl;
+                SortOptions sort = options.sort;
+                if (!sort.metricsOut.empty()) sort.metricsOut += ".worker" + std::to_string(i) + ".json";
+                bool ok = runWorker(i, controlAddress(options), workerAddress(options, i), memPerWorker,
+                                    options.workDir, sort);
+                std::cout.flush();
+                _exit(ok ? 0 : 1);
+            }
+            children.push_back(pid);
+        }
+    }
+
+    // Every worker says hello once it is listening for shuffle traffic.
+    std::vector<LineChannel> workers(n);
+    std::vector<std::string> addrs(n);
+    // Closes every worker connection first: a worker still waiting on the
+    // coordinator reads end of stream and exits, so the wait cannot hang.
+    // Folds the children's exit status into ok.
+    auto closeAndWait = [&](bool ok) {
+        for (LineChannel& w : workers) w.close();
+        for (pid_t pid : children) {
+            int status = 0;
+            waitpid(pid, &status, 0);
+            ok = ok && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+        }
+        return ok;
+    };
+    for (int joined = 0; joined < n; ++joined) {
+        LineChannel ch(acceptOn(listenFd));
+        std::string line, word;
+        int id = -1;
+        std::istringstream ss;
+        if (ch.socket() >= 0 && ch.readLine(line)) {
+            ss.str(line);
+            ss >> word >> id;
+        }
+        if (word != "hello" || id < 0 || id >= n || workers[id].socket() >= 0) {
+            std::cerr << "Unexpected worker greeting: " << line << std::endl;
+            ch.close();
+            close(listenFd);
+            closeAndWait(false);
+            return false;
+        }
+        ss >> addrs[id];
+        workers[id] = ch;
+    }
+    close(listenFd);
+
+    auto sampleStart = std::chrono::steady_clock::now();
+    std::vector<int> splitters = chooseSplitters(inputFile, records, n);
+    double sampleSeconds = secondsSince(sampleStart);
+    std::ostringstream splitterLine;
+    splitterLine << "splitters " << splitters.size();
+    for (int s : splitters) splitterLine << " " << s;
+
+    for (int i = 0; i < n; ++i) {
+        LineChannel& ch = workers[i];
+        ch.writeLine("input " + inputFile);
+        ch.writeLine("output " + outputFile);
+        ch.writeLine("slice " + std::to_string(records * i / n) + " " + std::to_string(records * (i + 1) / n));
+        ch.writeLine(splitterLine.str());
+        for (const std::string& a : addrs) ch.writeLine("peer " + a);
+        ch.writeLine("end");
+    }
+
+    // Partition sizes -> each worker's offset in the output.
+    std::vector<uint64_t> counts(n, 0);
+    uint64_t total = 0;
+    bool ok = true;
+    for (int i = 0; i < n; ++i) {
+        std::string line;
+        ok = ok && workers[i].readLine(line) && std::sscanf(line.c_str(), "received %lu", &counts[i]) == 1;
+        total += counts[i];
+    }
+    if (!ok || total != records) {
+        std::cerr << "Shuffle lost records: " << total << " of " << records << " received." << std::endl;
+        ok = false;
+    }
+    int out = ok ? open(outputFile.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644) : -1;
+    ok = out >= 0 && ftruncate(out, static_cast<off_t>(total * sizeof(int))) == 0;
+    if (out >= 0) close(out);
+    uint64_t offset = 0;
+    for (int i = 0; i < n && ok; ++i) {
+        workers[i].writeLine("offset " + std::to_string(offset));
+        offset += counts[i];
+    }
+
+    std::vector<std::map<std::string, std::string>> reports(n);
+    for (int i = 0; i < n && ok; ++i) {
+        std::string line;
+        ok = workers[i].readLine(line) && line.compare(0, 4, "done") == 0;
+        if (ok) reports[i] = parseFields(line);
+        ok = ok && reports[i]["ok"] == "1";
+    }
+    ok = closeAndWait(ok);
+    if (!ok) {
+        std::cerr << "Distributed sort failed; see " << options.workDir << "/worker_*.log" << std::endl;
+        return false;
+    }
+
+    double wallSeconds = secondsSince(start);
+    std::cout << "Worker  partition   sent(recs)  shuffle(s)  sort(s)  write(s)  peak RSS(MB)" << std::endl;
+    for (int i = 0; i < n; ++i) {
+        std::map<std::string, std::string>& r = reports[i];
+        std::cout << std::fixed << std::setprecision(3) << std::setw(6) << i << std::setw(11)
+                  << r["records_received"] << std::setw(13) << r["records_sent"] << std::setw(12)
+                  << std::stod(r["shuffle_seconds"]) << std::setw(9) << std::stod(r["sort_seconds"])
+                  << std::setw(10) << std::stod(r["write_seconds"]) << std::setw(14)
+                  << std::stoull(r["peak_rss_bytes"]) / (1024 * 1024) << std::endl;
+    }
+    std::cout << std::defaultfloat << "Distributed sort completed in " << wallSeconds << " s." << std::endl;
+
+    for (int i = 0; i < n; ++i) {
+        if (options.tcpBase.empty()) remove(workerAddress(options, i).substr(5).c_str());
+        remove((options.workDir + "/worker_" + std::to_string(i) + ".log").c_str());
+    }
+    if (options.tcpBase.empty()) remove(controlAddress(options).substr(5).c_str());
+    rmdir(options.workDir.c_str());
+
+    if (!options.sort.metricsOut.empty()
+        && !writeReport(options.sort.metricsOut, inputFile, outputFile, records, splitters,
+                        sampleSeconds, wallSeconds, reports)) {
+        std::cerr << "Failed to write metrics to " << options.sort.metricsOut << std::endl;
+    }
+    return true;
+}
@@ -0,0 +1,29 @@
+#pragma once
+
+#include "../merge_sort/sort_options.hpp"
+#include <string>
+#include <vector>
+
+// Multi-process sort: a coordinator samples the input for range splitters,
+// then each worker reads one slice of the input, shuffles every record to
+// the worker owning its key range, sorts what it received with
+// externalMergeSort and writes it as one contiguous segment of the output.
+struct DistOptions {
+    int workers = 2;
+    std::string workDir = "dist_sort.tmp"; // sockets, partitions, worker temp dirs
+    std::string tcpBase;                   // "host:port": coordinator there, workers on port+1..N
+    bool spawn = true;                     // fork the workers locally
+    SortOptions sort;                      // per-worker engine options; metricsOut is the coordinator's report
+};
+
+// Control socket address and worker i's data socket address.
+std::string controlAddress(const DistOptions& options);
+std::string workerAddress(const DistOptions& options, int id);
+
+bool runCoordinator(const std::string& inputFile, const std::string& outputFile, size_t memPerWorker,
+                    const DistOptions& options);
+
+// One worker; listens on dataAddress and joins the coordinator at
+// controlAddress. The worker's engine metrics go to metricsOut if set.
+bool runWorker(int id, const std::string& controlAddr, const std::string& dataAddr, size_t memLimit,
+               const std::string& workDir, const SortOptions& sort);
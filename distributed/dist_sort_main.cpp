@@ -0,0 +1,75 @@
+#include "dist_sort.hpp"
+#include "../merge_sort/io_utils.hpp"
+#include "../merge_sort/logger.hpp"
+#include "../merge_sort/temp_dirs.hpp"
+#include <iostream>
+#include <string>
+#include <vector>
+
+// Define the global logger flag
+bool g_debug_logging_enabled = false;
+
+static void printUsage(const char* prog) {
+    std::cerr << "Usage: " << prog << " <input_file> <output_file> <mem_per_worker_in_bytes|N%>\n"
+              << "       [--workers N] [--work-dir dir] [--tcp host:port] [--no-spawn]\n"
+              << "       [--tmp-dir dir[,dir...]] [--tmp-policy rr|space|bandwidth]\n"
+              << "       [--metrics-out file.json] [--verbose]\n"
+              << "   or: " << prog << " --worker ID --coordinator ADDR --listen ADDR <mem_limit_in_bytes|N%>\n"
+              << "       [--work-dir dir] [--tmp-dir dir[,dir...]] [--metrics-out file.json] [--verbose]\n";
+}
+
+int main(int argc, char* argv[]) {
+    std::vector<std::string> args(argv + 1, argv + argc);
+    g_debug_logging_enabled = takeFlag(args, "--verbose");
+
+    DistOptions options;
+    std::string workers, worker, coordinator, listen;
+    options.spawn = !takeFlag(args, "--no-spawn");
+    takeOption(args, "--workers", workers);
+    takeOption(args, "--work-dir", options.workDir);
+    takeOption(args, "--tcp", options.tcpBase);
+    takeOption(args, "--worker", worker);
+    takeOption(args, "--coordinator", coordinator);
+    takeOption(args, "--listen", listen);
+
+    std::vector<std::string> tmpDirArgs;
+    takeOption(args, "--tmp-dir", tmpDirArgs);
+    for (const std::string& list : tmpDirArgs) {
+        for (const std::string& dir : splitList(list)) options.sort.tmpDirs.push_back(dir);
+    }
+    takeOption(args, "--tmp-policy", options.sort.tmpPolicy);
+    takeOption(args, "--metrics-out", options.sort.metricsOut);
+
+    size_t memLimit = 0;
+    try {
+        TempDirs::parsePolicy(options.sort.tmpPolicy);
+        if (!workers.empty()) options.workers = std::stoi(workers);
+        if (!args.empty()) memLimit = parseMemoryBudget(args.back());
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+
+    // Worker mode: started by hand (or by another launcher) with --no-spawn
+    // on the coordinator side.
+    if (!worker.empty()) {
+        if (args.size() != 1 || coordinator.empty() || listen.empty()) {
+            printUsage(argv[0]);
+            return 1;
+        }
+        return runWorker(std::stoi(worker), coordinator, listen, memLimit, options.workDir,
+                         options.sort) ? 0 : 1;
+    }
+
+    if (args.size() != 3 || options.workers < 1) {
+        printUsage(argv[0]);
+        return 1;
+    }
+    if (!options.spawn) {
+        std::cout << "Waiting for " << options.workers << " workers on " << controlAddress(options) << std::endl;
+        for (int i = 0; i < options.workers; ++i) {
+            std::cout << "  worker " << i << " listens on " << workerAddress(options, i) << std::endl;
+        }
+    }
+    return runCoordinator(args[0], args[1], memLimit, options) ? 0 : 1;
+}
@@ -0,0 +1,148 @@
+#include "net.hpp"
+#include <iostream>
+#include <cstring>
+#include <cerrno>
+#include <unistd.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+static bool parseAddress(const std::string& address, bool& isTcp, std::string& host, std::string& port) {
+    if (address.compare(0, 4, "tcp:") == 0) {
+        size_t colon = address.rfind(':');
+        if (colon <= 4) return false;
+        isTcp = true;
+        host = address.substr(4, colon - 4);
+        port = address.substr(colon + 1);
+        return true;
+    }
+    isTcp = false;
+    host = address.compare(0, 5, "unix:") == 0 ? address.substr(5) : address;
+    return !host.empty() && host.size() < sizeof(sockaddr_un::sun_path);
+}
+
+// Resolves a TCP address and creates a socket for it.
+static int tcpSocket(const std::string& host, const std::string& port, bool passive, addrinfo** result) {
+    addrinfo hints;
+    std::memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = passive ? AI_PASSIVE : 0;
+    if (getaddrinfo(host.empty() ? nullptr : host.c_str(), port.c_str(), &hints, result) != 0) return -1;
+    return socket((*result)->ai_family, (*result)->ai_socktype, (*result)->ai_protocol);
+}
+
+static sockaddr_un unixAddress(const std::string& path) {
+    sockaddr_un addr;
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    std::strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+    return addr;
+}
+
+int listenOn(const std::string& address) {
+    bool isTcp;
+    std::string host, port;
+    if (!parseAddress(address, isTcp, host, port)) {
+        std::cerr << "Bad socket address: " << address << std::endl;
+        return -1;
+    }
+    int fd = -1;
+    bool ok = false;
+    if (isTcp) {
+        addrinfo* info = nullptr;
+        fd = tcpSocket(host, port, true, &info);
+        if (fd >= 0) {
+            int one = 1;
+            setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+            ok = bind(fd, info->ai_addr, info->ai_addrlen) == 0;
+        }
+        if (info) freeaddrinfo(info);
+    } else {
+        unlink(host.c_str());
+        fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        sockaddr_un addr = unixAddress(host);
+        ok = fd >= 0 && bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == 0;
+    }
+    if (!ok || listen(fd, 128) != 0) {
+        std::cerr << "Cannot listen on " << address << ": " << std::strerror(errno) << std::endl;
+        if (fd >= 0) close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+int acceptOn(int listenFd) {
+    int fd;
+    do {
+        fd = accept(listenFd, nullptr, nullptr);
+    } while (fd < 0 && errno == EINTR);
+    return fd;
+}
+
+int connectTo(const std::string& address) {
+    bool isTcp;
+    std::string host, port;
+    if (!parseAddress(address, isTcp, host, port)) {
+        std::cerr << "Bad socket address: " << address << std::endl;
+        return -1;
+    }
+    for (int attempt = 0; attempt < 500; ++attempt) {
+        int fd = -1;
+        bool ok = false;
+        if (isTcp) {
+            addrinfo* info = nullptr;
+            fd = tcpSocket(host, port, false, &info);
+            ok = fd >= 0 && connect(fd, info->ai_addr, info->ai_addrlen) == 0;
+            if (info) freeaddrinfo(info);
+        } else {
+            fd = socket(AF_UNIX, SOCK_STREAM, 0);
+            sockaddr_un addr = unixAddress(host);
+            ok = fd >= 0 && connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == 0;
+        }
+        if (ok) return fd;
+        if (fd >= 0) close(fd);
+        usleep(10000);
+    }
+    std::cerr << "Cannot connect to " << address << ": " << std::strerror(errno) << std::endl;
+    return -1;
+}
+
+bool sendAll(int fd, const void* data, size_t len) {
+    const char* p = static_cast<const char*>(data);
+    while (len > 0) {
+        ssize_t n = send(fd, p, len, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        p += n;
+        len -= static_cast<size_t>(n);
+    }
+    return true;
+}
+
+bool LineChannel::readLine(std::string& line) {
+    while (true) {
+        size_t nl = pending.find('\n');
+        if (nl != std::string::npos) {
+            line = pending.substr(0, nl);
+            pending.erase(0, nl + 1);
+            return true;
+        }
+        char chunk[4096];
+        ssize_t n = recv(fd, chunk, sizeof(chunk), 0);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        pending.append(chunk, static_cast<size_t>(n));
+    }
+}
+
+bool LineChannel::writeLine(const std::string& line) {
+    std::string msg = line + "\n";
+    return sendAll(fd, msg.data(), msg.size());
+}
+
+void LineChannel::close() {
+    if (fd >= 0) ::close(fd);
+    fd = -1;
+    pending.clear();
+}
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <string>
+#include <cstddef>
+
+// Stream sockets for the distributed sort. Addresses are "unix:/path.sock"
+// or "tcp:host:port"; a bare path means a Unix-domain socket. Functions
+// return -1/false on failure after printing the reason to std::cerr.
+
+int listenOn(const std::string& address);
+int acceptOn(int listenFd);
+// Retries for a few seconds so peers may start in any order.
+int connectTo(const std::string& address);
+bool sendAll(int fd, const void* data, size_t len);
+
+// Newline-delimited text messages over a connected socket.
+class LineChannel {
+public:
+    explicit LineChannel(int fd = -1) : fd(fd) {}
+    bool readLine(std::string& line);
+    bool writeLine(const std::string& line);
+    // Closes the socket, if open; the peer reads end of stream.
+    void close();
+    int socket() const { return fd; }
+
+private:
+    int fd;
+    std::string pending;
+};
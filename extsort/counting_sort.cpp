@@ -0,0 +1,136 @@
+#include "counting_sort.hpp"
+#include "../merge_sort/external_merge_sort.hpp"
+#include "../merge_sort/key_spec.hpp"
+#include "../merge_sort/sparse_index.hpp"
+#include "../merge_sort/metrics.hpp"
+#include "../merge_sort/logger.hpp"
+#include <iostream>
+#include <memory>
+#include <algorithm>
+
+// One table slot: a normalized key and how often it occurred (0: empty).
+struct CountSlot {
+    int key;
+    uint64_t count;
+};
+
+// Open addressing stays fast while the table is at most 3/4 full.
+static size_t tableSlots(size_t memLimit) {
+    size_t bytes = memLimit > 2 * bufferSizeFor(memLimit) ? memLimit - 2 * bufferSizeFor(memLimit) : 0;
+    size_t slots = 1;
+    while (slots * 2 * sizeof(CountSlot) <= bytes) slots *= 2;
+    return slots;
+}
+
+size_t countingCapacity(size_t memLimit) {
+    return tableSlots(memLimit) / 4 * 3;
+}
+
+static uint64_t countAndWrite(const std::string& inputFile, const std::string& outputFile, size_t memLimit,
+                              const SortOptions& options, bool& overflow, bool& ok) {
+    std::cout << "=== Counting Sort ===" << std::endl;
+    std::cout << "Input file: " << inputFile << std::endl;
+    std::cout << "Output file: " << outputFile << std::endl;
+    const KeySpec keys = options.keySpec.empty() ? KeySpec() : KeySpec::parse(options.keySpec);
+    if (!keys.identity()) std::cout << "Sort key: " << keys.describe() << std::endl;
+    metrics().set("key", keys.describe());
+
+    const size_t bufSize = bufferSizeFor(memLimit);
+    const size_t slots = tableSlots(memLimit), capacity = countingCapacity(memLimit);
+    const unsigned shift = 64 - static_cast<unsigned>(__builtin_ctzll(slots));
+    TrackedVector<CountSlot> table(slots, CountSlot{0, 0});
+    uint64_t records = 0;
+    size_t distinct = 0;
+    {
+        PhaseTimer countPhase("count");
+        Buffer inBuf(bufSize);
+        FileReader in(inputFile, inBuf);
+        if (!in.isOpen()) {
+            std::cerr << "Failed to open input file: " << inputFile << std::endl;
+            ok = false;
+            return 0;
+        }
+        in.setTransform(keys.encoder());
+        const int* block;
+        while (size_t n = in.nextBlock(block)) {
+            for (size_t i = 0; i < n; ++i) {
+                uint64_t hash = static_cast<uint32_t>(block[i]) * 0x9E3779B97F4A7C15ULL;
+                size_t at = static_cast<size_t>(hash >> shift);
+                while (table[at].count != 0 && table[at].key != block[i]) at = (at + 1) & (slots - 1);
+                if (table[at].count == 0) {
+                    if (++distinct > capacity) {
+                        std::cout << "More than " << capacity << " distinct records; counting stopped." << std::endl;
+                        overflow = true;
+                        return 0;
+                    }
+                    table[at].key = block[i];
+                }
+                table[at].count++;
+            }
+            records += n;
+        }
+        in.close();
+        countPhase.addRecords(records);
+    }
+    metrics().count("distinct_records", distinct);
+    std::cout << "Counted " << records << " records, " << distinct << " distinct." << std::endl;
+
+    PhaseTimer writePhase("write");
+    auto used = std::remove_if(table.begin(), table.end(), [](const CountSlot& s) { return s.count == 0; });
+    std::sort(table.begin(), used, [](const CountSlot& a, const CountSlot& b) { return a.key < b.key; });
+    std::unique_ptr<SparseIndexWriter> index;
+    if (!options.indexFile.empty()) {
+        index = std::make_unique<SparseIndexWriter>(options.indexFile, keys, options.indexStride);
+    }
+    Buffer outBuf(bufSize);
+    FileWriter out(outputFile, outBuf);
+    if (!out.isOpen()) {
+        std::cerr << "Failed to open output file: " << outputFile << std::endl;
+        ok = false;
+        return 0;
+    }
+    out.setTransform(keys.decoder());
+    if (index) out.setObserver(index->observer());
+    for (auto slot = table.begin(); slot != used; ++slot) {
+        for (uint64_t i = 0; i < slot->count; ++i) out.write(slot->key);
+    }
+    out.close();
+    if (out.failed()) {
+        std::cerr << "Failed to write " << outputFile << std::endl;
+        ok = false;
+        return 0;
+    }
+    if (index && index->close()) {
+        std::cout << "Sparse index: " << options.indexFile << " (" << index->entries() << " entries)" << std::endl;
+    }
+    writePhase.addRecords(records);
+    std::cout << "Counting sort completed." << std::endl;
+    return records;
+}
+
+bool countingSort(const std::string& inputFile, const std::string& outputFile, size_t memLimit,
+                  const SortOptions& options, bool& overflow) {
+    overflow = false;
+    metrics().reset(options.metricsOut);
+    metrics().set("engine", "counting");
+    metrics().set("input", inputFile);
+    metrics().set("output", outputFile);
+    metrics().set("mem_limit", std::to_string(memLimit));
+    memory().reset(memLimit);
+    bool ok = true;
+    try {
+        PhaseTimer total("total");
+        total.addRecords(countAndWrite(inputFile, outputFile, memLimit, options, overflow, ok));
+    } catch (const MemoryLimitExceeded& e) {
+        std::cerr << "Memory limit exceeded: " << e.what() << std::endl;
+        ok = false;
+    } catch (const std::invalid_argument& e) {
+        std::cerr << e.what() << std::endl;
+        ok = false;
+    }
+    reportMemory(std::cout);
+    if (!metrics().write()) {
+        std::cerr << "Failed to write metrics to " << options.metricsOut << std::endl;
+    }
+    return ok && !overflow;
+}
@@ -0,0 +1,19 @@
+#pragma once
+
+#include "../merge_sort/sort_options.hpp"
+#include <string>
+#include <cstddef>
+
+// Counting sort for inputs with few distinct records: one read that counts
+// every distinct record in an in-memory hash table, then one write of the
+// records in key order (options.keySpec). No temp files at all.
+
+// Distinct records the table can take within memLimit.
+size_t countingCapacity(size_t memLimit);
+
+// Sorts inputFile into outputFile. If the input holds more than
+// countingCapacity(memLimit) distinct records it stops with `overflow`
+// set and returns false before anything is written, so the caller can
+// fall back to another engine (unless the input was a stream).
+bool countingSort(const std::string& inputFile, const std::string& outputFile, size_t memLimit,
+                  const SortOptions& options, bool& overflow);
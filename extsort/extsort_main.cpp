@@ -0,0 +1,158 @@
+#include "planner.hpp"
+#include "counting_sort.hpp"
+#include "wide_sort.hpp"
+#include "../merge_sort/external_merge_sort.hpp"
+#include "../merge_sort/temp_dirs.hpp"
+#include "../merge_sort/logger.hpp"
+#include "../quick_sort/external_quick_sort.hpp"
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <sys/stat.h>
+
+// Define the global logger flag
+bool g_debug_logging_enabled = false;
+
+static void printUsage(const char* prog) {
+    std::cerr << "Usage: " << prog << " <input_file|-> <output_file|-> <mem_limit_in_bytes|N%>\n"
+              << "       [--explain] [--engine auto|merge|quick|in-memory|counting] [--io-mbps N]\n"
+              << "       [--tmp-dir dir[,dir...]] [--tmp-policy rr|space|bandwidth] [--metrics-out file.json]\n"
+              << "       [--threads N] [--key OFF:TYPE[:asc|desc],...] [--index file.idx] [--index-stride N]\n"
+              << "       [--pipeline] [--record-bytes N] [--key-bytes 4|8] [--wide-mode auto|full-record|key-pointer]\n"
+              << "       [--verbose]\n";
+}
+
+int main(int argc, char* argv[]) {
+    std::vector<std::string> args(argv + 1, argv + argc);
+    const bool verbose = takeFlag(args, "--verbose");
+    // --explain prints the profile, the estimates and the chosen engine
+    // without sorting; --engine overrides the choice.
+    const bool explain = takeFlag(args, "--explain");
+    std::string engine = "auto", ioMbps, threads, indexStride;
+    takeOption(args, "--engine", engine);
+    // --io-mbps is the device throughput the cost model assumes.
+    takeOption(args, "--io-mbps", ioMbps);
+
+    SortOptions options;
+    std::vector<std::string> tmpDirArgs;
+    takeOption(args, "--tmp-dir", tmpDirArgs);
+    for (const std::string& list : tmpDirArgs) {
+        for (const std::string& dir : splitList(list)) options.tmpDirs.push_back(dir);
+    }
+    takeOption(args, "--tmp-policy", options.tmpPolicy);
+    takeOption(args, "--metrics-out", options.metricsOut);
+    takeOption(args, "--threads", threads);
+    takeOption(args, "--key", options.keySpec);
+    takeOption(args, "--index", options.indexFile);
+    takeOption(args, "--index-stride", indexStride);
+    options.pipeline = takeFlag(args, "--pipeline");
+    // --record-bytes/--key-bytes describe wide records (a signed key at the
+    // start of each, see wide_sort.hpp); --wide-mode overrides the choice
+    // between sorting full records and key-pointer tuples.
+    std::string recordBytes, keyBytes, wideMode = "auto";
+    takeOption(args, "--record-bytes", recordBytes);
+    takeOption(args, "--key-bytes", keyBytes);
+    takeOption(args, "--wide-mode", wideMode);
+
+    g_debug_logging_enabled = verbose;
+    if (args.size() != 3) {
+        printUsage(argv[0]);
+        return 1;
+    }
+    const std::string inputFile = args[0], outputFile = args[1];
+    size_t memLimit = 0;
+    CostModel model;
+    KeySpec keys;
+    RecordLayout layout;
+    try {
+        memLimit = parseMemoryBudget(args[2]);
+        TempDirs::parsePolicy(options.tmpPolicy);
+        if (!options.keySpec.empty()) keys = KeySpec::parse(options.keySpec);
+        if (!threads.empty()) options.threads = std::max(1, std::stoi(threads));
+        if (!indexStride.empty()) options.indexStride = std::max(1, std::stoi(indexStride));
+        if (!ioMbps.empty()) model.ioBytesPerSecond = std::max(1.0, std::stod(ioMbps)) * 1e6;
+        if (!recordBytes.empty()) layout.recordBytes = parseByteSize(recordBytes);
+        if (!keyBytes.empty()) layout.keyBytes = parseByteSize(keyBytes);
+    } catch (const std::invalid_argument& e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    } catch (const std::out_of_range&) {
+        std::cerr << "Numeric argument out of range." << std::endl;
+        return 1;
+    }
+    if (engine != "auto" && engine != "merge" && engine != "quick" && engine != "in-memory" && engine != "counting") {
+        std::cerr << "Unknown engine: '" << engine << "'." << std::endl;
+        printUsage(argv[0]);
+        return 1;
+    }
+
+    if (wideMode != "auto" && wideMode != "full-record" && wideMode != "key-pointer") {
+        std::cerr << "Unknown wide mode: '" << wideMode << "'." << std::endl;
+        printUsage(argv[0]);
+        return 1;
+    }
+
+    // With "-" as output the data owns stdout, so narration goes to stderr.
+    if (outputFile == "-") {
+        std::cout.rdbuf(std::cerr.rdbuf());
+    }
+
+    // Records other than one 32-bit int go to the wide record sort; the
+    // engines below only sort ints.
+    if (layout.recordBytes != sizeof(int) || layout.keyBytes != sizeof(int)) {
+        if (!options.keySpec.empty() || !options.indexFile.empty()) {
+            std::cerr << "--key and --index apply to 32-bit records only." << std::endl;
+            return 1;
+        }
+        if (explain) {
+            struct stat st;
+            const bool sized = !isStdStream(inputFile) && stat(inputFile.c_str(), &st) == 0 && S_ISREG(st.st_mode);
+            const WidePlan plan = planWideSort(layout, sized ? st.st_size / layout.recordBytes : 0, memLimit);
+            std::cout << "Records: " << layout.recordBytes << " bytes, " << layout.keyBytes << "-byte key" << std::endl;
+            if (sized) {
+                std::cout << "Predicted I/O: full-record " << plan.fullRecordBytes / (1024 * 1024) << " MB, key-pointer "
+                          << plan.keyPointerBytes / (1024 * 1024) << " MB" << std::endl;
+            }
+            std::cout << "Chosen mode: " << (wideMode == "auto" ? plan.mode : wideMode) << std::endl;
+            return 0;
+        }
+        if (!wideSort(inputFile, outputFile, memLimit, layout, wideMode, options)) return 1;
+        std::cout << "External sort completed (wide)." << std::endl;
+        return 0;
+    }
+
+    const InputProfile profile = profileInput(inputFile, keys);
+    const SortPlan plan = planSort(profile, memLimit, model, engine == "auto" ? "" : engine);
+    if (explain) {
+        explainPlan(profile, plan, std::cout);
+        return 0;
+    }
+    std::ostringstream decision;
+    explainPlan(profile, plan, decision);
+    LOG_DEBUG(decision.str());
+    for (const EngineEstimate& e : plan.estimates) {
+        if (e.engine == plan.engine && e.feasible) {
+            std::cout << "Engine: " << plan.engine << " (predicted " << e.seconds << " s, "
+                      << e.ioBytes / (1024 * 1024) << " MB I/O)" << std::endl;
+        }
+    }
+
+    bool ok;
+    if (plan.engine == "counting") {
+        bool overflow = false;
+        ok = countingSort(inputFile, outputFile, memLimit, options, overflow);
+        if (overflow && !isStdStream(inputFile)) {
+            std::cout << "Too many distinct keys for counting; falling back to merge sort." << std::endl;
+            ok = externalMergeSort(inputFile, outputFile, memLimit, plan.k, options);
+        }
+    } else if (plan.engine == "merge") {
+        ok = externalMergeSort(inputFile, outputFile, memLimit, plan.k, options);
+    } else {
+        // The quick sort engine sorts inputs that fit in memory directly.
+        ok = externalQuickSort(inputFile, outputFile, memLimit, 0, 0, 0, 0, 0, options);
+    }
+    if (!ok) return 1;
+    std::cout << "External sort completed (" << plan.engine << ")." << std::endl;
+    return 0;
+}
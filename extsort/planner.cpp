@@ -0,0 +1,253 @@
+#include "planner.hpp"
+#include "counting_sort.hpp"
+#include "../merge_sort/external_merge_sort.hpp"
+#include "../merge_sort/run_tagged_tree.hpp"
+#include "../merge_sort/io_utils.hpp"
+#include <fstream>
+#include <algorithm>
+#include <iomanip>
+#include <cmath>
+#include <sys/stat.h>
+
+static const size_t SAMPLE_SEGMENTS = 64;
+static const size_t SEGMENT_RECORDS = 1024;
+// The quick sort engine keeps three 1 MB buffers next to its pivot heap.
+static const size_t QUICK_RESERVED = 3 * 1024 * 1024;
+
+InputProfile profileInput(const std::string& inputFile, const KeySpec& keys) {
+    InputProfile profile;
+    struct stat st;
+    if (isStdStream(inputFile) || stat(inputFile.c_str(), &st) != 0 || !S_ISREG(st.st_mode)) return profile;
+    std::ifstream in(inputFile, std::ios::binary);
+    if (!in) return profile;
+    profile.sampled = true;
+    profile.records = st.st_size / sizeof(int);
+    if (profile.records == 0) return profile;
+
+    // Evenly spaced segments, or the whole file as one segment.
+    std::vector<std::vector<int>> segments;
+    if (profile.records <= SAMPLE_SEGMENTS * SEGMENT_RECORDS) {
+        segments.emplace_back(profile.records);
+        in.read(reinterpret_cast<char*>(segments[0].data()), profile.records * sizeof(int));
+    } else {
+        uint64_t step = (profile.records - SEGMENT_RECORDS) / (SAMPLE_SEGMENTS - 1);
+        for (size_t i = 0; i < SAMPLE_SEGMENTS; ++i) {
+            segments.emplace_back(SEGMENT_RECORDS);
+            in.seekg(static_cast<std::streamoff>(i * step * sizeof(int)));
+            in.read(reinterpret_cast<char*>(segments.back().data()), SEGMENT_RECORDS * sizeof(int));
+        }
+    }
+    if (!in) {
+        profile.sampled = false;
+        return profile;
+    }
+
+    uint64_t pairs = 0, orderedPairs = 0, orderedSegments = 0;
+    std::vector<int> sample;
+    for (size_t i = 0; i < segments.size(); ++i) {
+        std::vector<int>& segment = segments[i];
+        for (int& record : segment) record = keys.encode(record);
+        for (size_t j = 1; j < segment.size(); ++j) orderedPairs += segment[j - 1] <= segment[j];
+        pairs += segment.size() - 1;
+        if (i > 0) orderedSegments += segments[i - 1].back() <= segment.front();
+        sample.insert(sample.end(), segment.begin(), segment.end());
+    }
+    profile.sampleRecords = sample.size();
+    profile.ordered = pairs ? static_cast<double>(orderedPairs) / pairs : 1.0;
+    profile.segmentsOrdered = segments.size() > 1
+        ? static_cast<double>(orderedSegments) / (segments.size() - 1) : profile.ordered;
+
+    // Chao1: the distinct keys seen plus an estimate of the unseen ones
+    // from how many were seen once (f1) and twice (f2).
+    std::sort(sample.begin(), sample.end());
+    profile.minKey = sample.front();
+    profile.maxKey = sample.back();
+    double seen = 0, f1 = 0, f2 = 0;
+    for (size_t i = 0; i < sample.size();) {
+        size_t j = i;
+        while (j < sample.size() && sample[j] == sample[i]) ++j;
+        seen++;
+        if (j - i == 1) f1++;
+        if (j - i == 2) f2++;
+        i = j;
+    }
+    double estimate = seen + (f2 > 0 ? f1 * f1 / (2 * f2) : f1 * (f1 - 1) / 2);
+    profile.distinctEstimate = static_cast<uint64_t>(std::min<double>(estimate, profile.records));
+    return profile;
+}
+
+static double seconds(const CostModel& model, uint64_t ioBytes, double cpuNs) {
+    return ioBytes / model.ioBytesPerSecond + cpuNs / 1e9;
+}
+
+static double log2Of(uint64_t n) {
+    return n > 1 ? std::log2(static_cast<double>(n)) : 1.0;
+}
+
+// Merge passes over `runs` runs: as few as the memory's fan-in allows,
+// with the smallest K that still gets there (bigger read buffers).
+static int mergePasses(uint64_t runs, size_t fit, int& K) {
+    int passes = 0;
+    for (double reach = 1; reach < runs; reach *= fit) passes++;
+    K = 2;
+    while (std::pow(static_cast<double>(K), passes) < runs) K++;
+    return passes;
+}
+
+static EngineEstimate estimateMerge(const InputProfile& p, size_t memLimit, const CostModel& model, int& K) {
+    EngineEstimate e{"merge", false, 0, 0, ""};
+    const size_t bufSize = bufferSizeFor(memLimit);
+    const size_t fit = mergeFanInFor(memLimit, bufSize);
+    K = 0;
+    if (fit < 2) {
+        e.detail = "memory limit cannot hold a 2-way merge";
+        return e;
+    }
+    e.feasible = true;
+    if (!p.sampled) {
+        e.detail = "input size unknown; heuristic K";
+        return e;
+    }
+    // Replacement selection: runs of twice the tree on random input,
+    // longer the more of it is already in order.
+    const size_t reserved = 2 * BufferPool::roundedSize(bufSize);
+    const double treeKeys = std::max<double>(1, (memLimit > reserved ? memLimit - reserved : 0)
+                                                    / RunTaggedTree::bytesPerKey());
+    const double s = std::min(p.ordered, 0.999);
+    double runLength = treeKeys / (1 - s);
+    if (p.ordered >= 0.999 && p.segmentsOrdered >= 0.999) runLength = static_cast<double>(p.records);
+    // Every descent between two sample segments starts at least one new run.
+    const double descents = std::round((1 - p.segmentsOrdered) * (SAMPLE_SEGMENTS - 1));
+    const uint64_t runs = static_cast<uint64_t>(std::max(std::ceil(p.records / runLength), 1 + descents));
+    // A single run is still copied to the output by one merge pass.
+    const int passes = std::max(1, mergePasses(runs, fit, K));
+
+    const uint64_t size = p.records * sizeof(int);
+    e.ioBytes = 2 * size * (1 + passes);
+    const double runGeneration = model.runGenerationNsPerLog * log2Of(static_cast<uint64_t>(treeKeys));
+    e.seconds = seconds(model, e.ioBytes, p.records * (runGeneration + passes * model.mergePassNs));
+    e.detail = "K=" + std::to_string(K) + ", ~" + std::to_string(runs) + " runs, " + std::to_string(passes)
+             + " merge passes";
+    return e;
+}
+
+static EngineEstimate estimateInMemory(const InputProfile& p, size_t memLimit, const CostModel& model) {
+    EngineEstimate e{"in-memory", false, 0, 0, ""};
+    const uint64_t size = p.records * sizeof(int);
+    if (!p.sampled) {
+        e.detail = "input size unknown";
+    } else if (memLimit <= QUICK_RESERVED || size + bufferSizeFor(memLimit) > memLimit) {
+        e.detail = "input does not fit in memory";
+    } else {
+        e.feasible = true;
+        e.ioBytes = 2 * size;
+        e.seconds = seconds(model, e.ioBytes, p.records * model.inMemoryNsPerLog * log2Of(p.records));
+        e.detail = "one read, std::sort, one write";
+    }
+    return e;
+}
+
+static EngineEstimate estimateQuick(const InputProfile& p, size_t memLimit, const CostModel& model) {
+    EngineEstimate e{"quick", false, 0, 0, ""};
+    if (!p.sampled) {
+        e.detail = "input size unknown";
+        return e;
+    }
+    if (memLimit <= QUICK_RESERVED) {
+        e.detail = "memory limit must exceed 3 MB";
+        return e;
+    }
+    e.feasible = true;
+    const uint64_t size = p.records * sizeof(int);
+    const double leafRecords = std::max<double>(1, (memLimit - bufferSizeFor(memLimit)) / sizeof(int));
+    const double leafSort = model.inMemoryNsPerLog * log2Of(static_cast<uint64_t>(std::min<double>(leafRecords, p.records)));
+    if (p.records <= leafRecords) {
+        e.ioBytes = 2 * size;
+        e.seconds = seconds(model, e.ioBytes, p.records * leafSort);
+        e.detail = "fits in memory";
+    } else if (p.distinctEstimate == 1) {
+        // A single-valued pivot heap sends everything to the middle.
+        e.ioBytes = 4 * size;
+        e.seconds = seconds(model, e.ioBytes, p.records * model.partitionLevelNs);
+        e.detail = "one partition, all keys equal";
+    } else if (p.ordered >= 0.9 || p.ordered <= 0.1) {
+        // Sorted or reversed: the first split is lopsided and the big side
+        // falls back to the merge sort engine.
+        int K;
+        EngineEstimate merge = estimateMerge(p, memLimit, model, K);
+        e.ioBytes = 4 * size + merge.ioBytes;
+        e.seconds = merge.seconds + seconds(model, 4 * size, p.records * model.partitionLevelNs);
+        e.detail = "one partition, then merge fallback (" + merge.detail + ")";
+    } else {
+        const int levels = static_cast<int>(std::ceil(std::log2(p.records / leafRecords)));
+        e.ioBytes = size * (4 * levels + 2);
+        e.seconds = seconds(model, e.ioBytes, p.records * (levels * model.partitionLevelNs + leafSort));
+        e.detail = "~" + std::to_string(levels) + " partition levels";
+    }
+    return e;
+}
+
+static EngineEstimate estimateCounting(const InputProfile& p, size_t memLimit, const CostModel& model) {
+    EngineEstimate e{"counting", false, 0, 0, ""};
+    const size_t capacity = countingCapacity(memLimit);
+    if (!p.sampled) {
+        e.detail = "input size unknown";
+    } else if (p.distinctEstimate > capacity / 2) {
+        e.detail = "~" + std::to_string(p.distinctEstimate) + " distinct keys, room for " + std::to_string(capacity);
+    } else {
+        e.feasible = true;
+        e.ioBytes = 2 * p.records * sizeof(int);
+        e.seconds = seconds(model, e.ioBytes, p.records * model.countingNs);
+        e.detail = "room for " + std::to_string(capacity) + " distinct keys";
+    }
+    return e;
+}
+
+SortPlan planSort(const InputProfile& profile, size_t memLimit, const CostModel& model, const std::string& forced) {
+    SortPlan plan;
+    int K = 0;
+    plan.estimates.push_back(estimateCounting(profile, memLimit, model));
+    plan.estimates.push_back(estimateInMemory(profile, memLimit, model));
+    plan.estimates.push_back(estimateQuick(profile, memLimit, model));
+    plan.estimates.push_back(estimateMerge(profile, memLimit, model, K));
+    plan.k = K;
+
+    const EngineEstimate* best = nullptr;
+    for (const EngineEstimate& e : plan.estimates) {
+        if (e.feasible && (!best || e.seconds < best->seconds)) best = &e;
+    }
+    // Without a size the estimates are all zero; merge handles any input.
+    plan.engine = best && profile.sampled ? best->engine : "merge";
+    if (!forced.empty()) plan.engine = forced;
+    return plan;
+}
+
+void explainPlan(const InputProfile& profile, const SortPlan& plan, std::ostream& out) {
+    std::ios::fmtflags flags = out.flags();
+    out << std::fixed << std::setprecision(2);
+    if (!profile.sampled) {
+        out << "Input: stream or unreadable file, not sampled" << std::endl;
+    } else {
+        out << "Input: " << profile.records << " records (" << profile.records * sizeof(int) / (1024.0 * 1024.0)
+            << " MB), sampled " << profile.sampleRecords << std::endl;
+        out << "Presortedness: " << profile.ordered << " of adjacent pairs, " << profile.segmentsOrdered
+            << " of segments in order" << std::endl;
+        out << "Distinct keys: ~" << profile.distinctEstimate << ", sampled key range [" << profile.minKey << ", "
+            << profile.maxKey << "]" << std::endl;
+    }
+    out << "Estimates:" << std::endl;
+    for (const EngineEstimate& e : plan.estimates) {
+        out << "  " << std::left << std::setw(10) << e.engine << std::right;
+        if (e.feasible) {
+            out << std::setw(10) << e.ioBytes / (1024.0 * 1024.0) << " MB I/O " << std::setw(8) << e.seconds << " s  ";
+        } else {
+            out << "  not feasible: ";
+        }
+        out << e.detail << std::endl;
+    }
+    out << "Chosen engine: " << plan.engine;
+    if (plan.engine == "merge") out << " (K=" << (plan.k > 0 ? std::to_string(plan.k) : "heuristic") << ")";
+    if (plan.engine == "quick") out << " (default buffers)";
+    out << std::endl;
+    out.flags(flags);
+}
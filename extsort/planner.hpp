@@ -0,0 +1,61 @@
+#pragma once
+
+#include "../merge_sort/key_spec.hpp"
+#include <string>
+#include <vector>
+#include <ostream>
+#include <cstdint>
+
+// Engine selection for the extsort front end: a cheap sample of the input
+// is profiled, every engine's I/O volume and time are predicted from the
+// profile and the memory limit, and the cheapest engine that can run wins.
+
+// What the sample says about the input (in key order, see key_spec.hpp).
+struct InputProfile {
+    bool sampled = false;         // false for streams: nothing could be read ahead
+    uint64_t records = 0;         // of the whole input
+    uint64_t sampleRecords = 0;
+    double ordered = 0.5;         // share of adjacent sampled pairs already in order
+    double segmentsOrdered = 0.5; // share of consecutive sample segments in order
+    uint64_t distinctEstimate = 0;
+    int minKey = 0, maxKey = 0;   // of the sample
+};
+
+// Reads up to 64 evenly spaced segments of 1024 records each (the whole
+// file if it is smaller). Streams are not read at all.
+InputProfile profileInput(const std::string& inputFile, const KeySpec& keys);
+
+// Device throughput and per-record CPU costs, in nanoseconds. The CPU
+// constants were measured with a warm page cache on the reference box;
+// the device term is what the I/O adds on top of that.
+struct CostModel {
+    double ioBytesPerSecond = 200e6;
+    double runGenerationNsPerLog = 6; // replacement selection, per record and log2(tree keys)
+    double mergePassNs = 60;      // one K-way merge pass, per record
+    double partitionLevelNs = 80; // quick sort partition plus assembly, per record and level
+    double inMemoryNsPerLog = 3;  // std::sort, per record and log2(records)
+    double countingNs = 20;       // hash count plus expansion, per record
+};
+
+struct EngineEstimate {
+    std::string engine;
+    bool feasible = false;
+    uint64_t ioBytes = 0;
+    double seconds = 0;
+    std::string detail; // parameters, or why the engine cannot run
+};
+
+struct SortPlan {
+    std::string engine; // "merge", "quick", "in-memory" or "counting"
+    int k = 0;          // merge fan-in (0: the engine's heuristic); the quick
+                        // sort's buffer sizes are not planned (its defaults)
+    std::vector<EngineEstimate> estimates;
+};
+
+// Estimates every engine and picks the feasible one with the lowest
+// predicted time; `forced` (an engine name) overrides the choice.
+SortPlan planSort(const InputProfile& profile, size_t memLimit, const CostModel& model,
+                  const std::string& forced = "");
+
+// The profile, every estimate and the decision, one line each.
+void explainPlan(const InputProfile& profile, const SortPlan& plan, std::ostream& out);
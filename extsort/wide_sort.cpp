@@ -0,0 +1,535 @@
+#include "wide_sort.hpp"
+#include "../merge_sort/external_merge_sort.hpp"
+#include "../merge_sort/temp_dirs.hpp"
+#include "../merge_sort/metrics.hpp"
+#include "../merge_sort/logger.hpp"
+#include <iostream>
+#include <functional>
+#include <queue>
+#include <cmath>
+#include <cstring>
+#include <cstdio>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+// What key-pointer mode sorts: a record's normalized key and its number
+// in the input.
+struct KeyPointer {
+    uint64_t key;
+    uint64_t record;
+};
+static const size_t TUPLE_BYTES = sizeof(KeyPointer);
+// Narrower records gain too little from moving tuples instead.
+static const size_t KEY_POINTER_RATIO = 4;
+// Merge inputs get at least this much read buffer each.
+static const size_t MIN_MERGE_READ = 64 * 1024;
+// Gather: a gap of up to this many bytes between two wanted records is
+// read through rather than skipped with a second pread (roughly what a
+// seek costs), and one pread covers at most GATHER_SPAN bytes.
+static const size_t GATHER_MAX_GAP = 16 * 1024;
+static const size_t GATHER_SPAN = 1024 * 1024;
+
+using KeyOf = std::function<uint64_t(const char* record)>;
+
+// Signed keys mapped to unsigned ones in the same order.
+static uint64_t normalizedKey(const char* record, size_t keyBytes) {
+    if (keyBytes == 4) {
+        int32_t key;
+        std::memcpy(&key, record, sizeof(key));
+        return static_cast<uint32_t>(key) ^ 0x80000000u;
+    }
+    int64_t key;
+    std::memcpy(&key, record, sizeof(key));
+    return static_cast<uint64_t>(key) ^ (uint64_t(1) << 63);
+}
+
+static bool validLayout(const RecordLayout& layout) {
+    return (layout.keyBytes == 4 || layout.keyBytes == 8) && layout.recordBytes >= layout.keyBytes;
+}
+
+// Merge fan-in that leaves every input MIN_MERGE_READ or 16 records of
+// read buffer next to the output buffer.
+static size_t mergeFanIn(size_t memBytes, size_t width) {
+    const size_t writeBytes = bufferSizeFor(memBytes);
+    return std::max<size_t>(2, (memBytes - std::min(memBytes, writeBytes)) / std::max(MIN_MERGE_READ, 16 * width));
+}
+
+// Merge passes before the final one.
+static int extraPasses(uint64_t runs, size_t fanIn) {
+    int passes = 0;
+    for (; runs > fanIn; passes++) runs = (runs + fanIn - 1) / fanIn;
+    return passes;
+}
+
+WidePlan planWideSort(const RecordLayout& layout, uint64_t records, size_t memLimit) {
+    WidePlan plan;
+    if (!validLayout(layout) || records == 0) return plan;
+    const double n = static_cast<double>(records), width = static_cast<double>(layout.recordBytes);
+    const size_t sortMem = memLimit - std::min(memLimit, 2 * bufferSizeFor(memLimit));
+
+    // Read, runs, extra passes, final merge, output: all whole records.
+    // One run is written as the output.
+    const uint64_t fullRuns = static_cast<uint64_t>(std::ceil(n / std::max<size_t>(1, sortMem / (layout.recordBytes + TUPLE_BYTES))));
+    plan.fullRecordBytes = static_cast<uint64_t>(
+        n * width * (fullRuns <= 1 ? 2 : 4 + 2 * extraPasses(fullRuns, mergeFanIn(memLimit, layout.recordBytes))));
+
+    // Tuples through the runs and merges (the final merge gets half the
+    // memory, the gather the rest), then the gather and the output. A
+    // gather read costs the bytes up to the next wanted record, or a seek
+    // (GATHER_MAX_GAP) and the record when that is further.
+    const uint64_t tupleRuns = static_cast<uint64_t>(std::ceil(n / std::max<size_t>(1, sortMem / TUPLE_BYTES)));
+    const double batch = std::max<double>(1, (memLimit / 2 - std::min(GATHER_SPAN, memLimit / 8)) / (width + TUPLE_BYTES));
+    const double gap = std::max(1.0, n / batch) * width;
+    const double gather = n * std::min(gap, width + GATHER_MAX_GAP);
+    plan.keyPointerBytes = static_cast<uint64_t>(2 * n * width + gather
+                                                 + n * TUPLE_BYTES * (2 + 2 * extraPasses(tupleRuns, mergeFanIn(memLimit / 2, TUPLE_BYTES))));
+
+    if (layout.recordBytes >= KEY_POINTER_RATIO * TUPLE_BYTES && plan.keyPointerBytes < plan.fullRecordBytes) {
+        plan.mode = "key-pointer";
+    }
+    return plan;
+}
+
+// Sequential reads of fixed-width records through a governed buffer. A
+// trailing partial record is dropped.
+class RecordReader {
+public:
+    RecordReader(size_t width, size_t bufBytes) : width(width), buf(std::max(width, bufBytes / width * width)) {}
+    ~RecordReader() { close(); }
+
+    bool open(const std::string& path) {
+        close();
+        owned = !isStdStream(path);
+        fd = owned ? ::open(path.c_str(), O_RDONLY) : STDIN_FILENO;
+        pos = len = 0;
+        return fd >= 0;
+    }
+    // The next record, or nullptr at the end of the input.
+    const char* next() {
+        if (pos + width > len && !fill()) return nullptr;
+        const char* record = buf.data() + pos;
+        pos += width;
+        return record;
+    }
+    void close() {
+        if (owned && fd >= 0) ::close(fd);
+        fd = -1;
+    }
+    uint64_t bytesRead() const { return totalRead; }
+
+private:
+    bool fill() {
+        len -= pos;
+        std::memmove(buf.data(), buf.data() + pos, len);
+        pos = 0;
+        while (len < buf.size()) {
+            ssize_t n = ::read(fd, buf.data() + len, buf.size() - len);
+            if (n <= 0) break;
+            len += static_cast<size_t>(n);
+            totalRead += static_cast<uint64_t>(n);
+        }
+        return len >= width;
+    }
+
+    size_t width;
+    TrackedVector<char> buf;
+    size_t pos = 0, len = 0;
+    int fd = -1;
+    bool owned = false;
+    uint64_t totalRead = 0;
+};
+
+// Buffered writes of fixed-width records.
+class RecordWriter {
+public:
+    RecordWriter(size_t width, size_t bufBytes) : width(width), buf(std::max(width, bufBytes / width * width)) {}
+    ~RecordWriter() { close(); }
+
+    bool open(const std::string& path) {
+        close();
+        owned = !isStdStream(path);
+        fd = owned ? ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644) : STDOUT_FILENO;
+        failed = fd < 0;
+        return !failed;
+    }
+    void write(const char* record) {
+        if (len + width > buf.size()) flush();
+        std::memcpy(buf.data() + len, record, width);
+        len += width;
+    }
+    // Writes `count` records stored back to back, bypassing the buffer.
+    void writeBlock(const char* records, size_t count) {
+        flush();
+        writeAll(records, count * width);
+    }
+    void flush() {
+        writeAll(buf.data(), len);
+        len = 0;
+    }
+    // False if any write failed.
+    bool close() {
+        if (fd >= 0) {
+            flush();
+            if (owned && ::close(fd) != 0) failed = true;
+        }
+        fd = -1;
+        return !failed;
+    }
+    uint64_t bytesWritten() const { return totalWritten; }
+
+private:
+    void writeAll(const char* data, size_t bytes) {
+        while (bytes > 0 && !failed) {
+            ssize_t n = ::write(fd, data, bytes);
+            if (n <= 0) {
+                failed = true;
+                break;
+            }
+            data += n;
+            bytes -= static_cast<size_t>(n);
+            totalWritten += static_cast<uint64_t>(n);
+        }
+    }
+
+    size_t width;
+    TrackedVector<char> buf;
+    size_t len = 0;
+    int fd = -1;
+    bool owned = false, failed = false;
+    uint64_t totalWritten = 0;
+};
+
+// Payload fetch for key-pointer mode: tuples arrive in key order and are
+// collected into batches; each batch is read in record order, coalescing
+// nearby records into one pread, and written out in key order.
+class Gatherer {
+public:
+    Gatherer(int inputFd, size_t width, size_t memBytes, RecordWriter& out)
+        : fd(inputFd), width(width), out(out),
+          span(std::max(width, std::min(GATHER_SPAN, memBytes / 4))),
+          limit(std::max<size_t>(1, (memBytes - std::min(memBytes, span.size())) / (width + TUPLE_BYTES))) {
+        slots.reserve(limit);
+        records.resize(limit * width);
+    }
+
+    size_t capacity() const { return limit; }
+    bool add(const char* tuple) {
+        KeyPointer t;
+        std::memcpy(&t, tuple, sizeof(t));
+        slots.push_back({t.record, slots.size()});
+        return slots.size() < limit || flush();
+    }
+    // Fetches and writes the current batch; false on a read error.
+    bool flush() {
+        if (slots.empty()) return true;
+        std::sort(slots.begin(), slots.end(), [](const KeyPointer& a, const KeyPointer& b) { return a.key < b.key; });
+        for (size_t i = 0; i < slots.size();) {
+            // Extend the read while the next record is close and still fits.
+            size_t j = i + 1;
+            const uint64_t first = slots[i].key;
+            while (j < slots.size() && (slots[j].key - slots[j - 1].key - 1) * width <= GATHER_MAX_GAP
+                   && (slots[j].key - first + 1) * width <= span.size()) {
+                ++j;
+            }
+            if (!readAt(first * width, (slots[j - 1].key - first + 1) * width)) return false;
+            for (size_t s = i; s < j; ++s) {
+                std::memcpy(records.data() + slots[s].record * width, span.data() + (slots[s].key - first) * width, width);
+            }
+            i = j;
+        }
+        out.writeBlock(records.data(), slots.size());
+        batches++;
+        slots.clear();
+        return true;
+    }
+
+    uint64_t reads = 0, bytesRead = 0, batches = 0;
+
+private:
+    bool readAt(uint64_t offset, size_t bytes) {
+        reads++;
+        for (size_t done = 0; done < bytes;) {
+            ssize_t n = pread(fd, span.data() + done, bytes - done, static_cast<off_t>(offset + done));
+            if (n <= 0) return false;
+            done += static_cast<size_t>(n);
+        }
+        bytesRead += bytes;
+        return true;
+    }
+
+    int fd;
+    size_t width;
+    RecordWriter& out;
+    TrackedVector<char> span;
+    size_t limit;
+    // (record number, slot in the batch), reusing the tuple's fields.
+    TrackedVector<KeyPointer> slots;
+    TrackedVector<char> records;
+};
+
+// Merges `runs` of `width`-byte records into emit(record), reading each
+// through its own share of memBytes. Ties go to the earlier run, so runs
+// listed in input order merge stably.
+static bool mergeInto(const std::vector<std::string>& runs, size_t width, const KeyOf& keyOf, size_t memBytes,
+                      const std::function<bool(const char*)>& emit, uint64_t& bytesRead) {
+    const size_t readBytes = std::max(width, memBytes / std::max<size_t>(runs.size(), 1));
+    std::vector<std::unique_ptr<RecordReader>> readers;
+    // (key, run) of every reader's current record, smallest on top.
+    using Head = std::pair<uint64_t, size_t>;
+    std::priority_queue<Head, std::vector<Head>, std::greater<Head>> heads;
+    std::vector<const char*> current(runs.size(), nullptr);
+    for (size_t r = 0; r < runs.size(); ++r) {
+        readers.push_back(std::make_unique<RecordReader>(width, readBytes));
+        if (!readers.back()->open(runs[r])) return false;
+        if ((current[r] = readers[r]->next())) heads.push({keyOf(current[r]), r});
+    }
+    bool ok = true;
+    while (!heads.empty() && ok) {
+        size_t r = heads.top().second;
+        heads.pop();
+        ok = emit(current[r]);
+        if ((current[r] = readers[r]->next())) heads.push({keyOf(current[r]), r});
+    }
+    for (const auto& reader : readers) bytesRead += reader->bytesRead();
+    return ok;
+}
+
+// Merges runs in passes until at most one merge's worth is left, then
+// merges those into emit.
+static bool mergeAll(std::vector<std::string> runs, size_t width, const KeyOf& keyOf, size_t memBytes,
+                     TempDirs& tmp, const std::function<bool(const char*)>& emit, uint64_t& bytesRead,
+                     uint64_t& bytesWritten) {
+    const size_t writeBytes = bufferSizeFor(memBytes);
+    const size_t fanIn = mergeFanIn(memBytes, width);
+    int pass = 1;
+    while (runs.size() > fanIn) {
+        PhaseTimer passPhase("merge_pass_" + std::to_string(pass));
+        metrics().count("merge_passes");
+        std::cout << "Merge pass " << pass << ": " << runs.size() << " runs, merging " << fanIn << " at a time." << std::endl;
+        std::vector<std::string> next;
+        for (size_t g = 0; g < runs.size(); g += fanIn) {
+            std::vector<std::string> group(runs.begin() + g, runs.begin() + std::min(runs.size(), g + fanIn));
+            std::string merged = tmp.place("pass" + std::to_string(pass) + "_" + std::to_string(next.size()) + ".bin");
+            RecordWriter out(width, writeBytes);
+            bool ok = out.open(merged) && mergeInto(group, width, keyOf, memBytes - writeBytes, [&](const char* record) {
+                out.write(record);
+                return true;
+            }, bytesRead);
+            ok = out.close() && ok;
+            bytesWritten += out.bytesWritten();
+            for (const std::string& path : group) remove(path.c_str());
+            if (!ok) return false;
+            next.push_back(merged);
+        }
+        runs.swap(next);
+        pass++;
+    }
+    PhaseTimer finalPhase("final_merge");
+    metrics().count("merge_passes");
+    bool ok = mergeInto(runs, width, keyOf, memBytes, emit, bytesRead);
+    for (const std::string& path : runs) remove(path.c_str());
+    return ok;
+}
+
+static uint64_t sortWide(const std::string& inputFile, const std::string& outputFile, size_t memLimit,
+                         const RecordLayout& layout, std::string mode, const SortOptions& options, bool& ok) {
+    std::cout << "=== Wide Record Sort ===" << std::endl;
+    std::cout << "Input file: " << inputFile << std::endl;
+    std::cout << "Output file: " << outputFile << std::endl;
+    std::cout << "Record layout: " << layout.recordBytes << "-byte records, " << layout.keyBytes << "-byte signed keys"
+              << std::endl;
+    if (!validLayout(layout)) {
+        std::cerr << "Keys must be 4 or 8 bytes and no wider than the record." << std::endl;
+        ok = false;
+        return 0;
+    }
+    struct stat st;
+    const bool regular = !isStdStream(inputFile) && stat(inputFile.c_str(), &st) == 0 && S_ISREG(st.st_mode);
+    if (mode == "auto") {
+        const WidePlan plan = planWideSort(layout, regular ? st.st_size / layout.recordBytes : 0, memLimit);
+        mode = plan.mode;
+        LOG_DEBUG("Predicted I/O: full-record " << plan.fullRecordBytes << " bytes, key-pointer "
+                  << plan.keyPointerBytes << " bytes");
+    }
+    if (mode == "key-pointer" && !regular) {
+        std::cout << "Key-pointer mode needs a regular input file; sorting full records." << std::endl;
+        mode = "full-record";
+    }
+    const bool keyPointer = mode == "key-pointer";
+    std::cout << "Mode: " << mode << std::endl;
+    metrics().set("mode", mode);
+    metrics().set("record_bytes", std::to_string(layout.recordBytes));
+    metrics().set("key_bytes", std::to_string(layout.keyBytes));
+
+    const size_t width = layout.recordBytes, keyBytes = layout.keyBytes;
+    // What the runs and merges move: tuples or whole records.
+    const size_t sortWidth = keyPointer ? TUPLE_BYTES : width;
+    const KeyOf keyOf = keyPointer
+        ? KeyOf([](const char* tuple) {
+              uint64_t key;
+              std::memcpy(&key, tuple, sizeof(key));
+              return key;
+          })
+        : KeyOf([keyBytes](const char* record) { return normalizedKey(record, keyBytes); });
+    const size_t bufSize = bufferSizeFor(memLimit);
+    TempDirs tmp(options.tmpDirs, TempDirs::parsePolicy(options.tmpPolicy), options.tmpPrefix + "wide_");
+    uint64_t records = 0, bytesRead = 0, bytesWritten = 0;
+
+    // --------- Phase 1: runs sorted in memory ---------
+    std::vector<std::string> runs;
+    bool inMemory = false;
+    {
+        PhaseTimer runPhase("run_generation");
+        RecordReader in(width, bufSize);
+        if (!in.open(inputFile)) {
+            std::cerr << "Failed to open input file: " << inputFile << std::endl;
+            ok = false;
+            return 0;
+        }
+        RecordWriter runOut(sortWidth, bufSize);
+        // Full records are sorted through a (key, slot) index next to them.
+        const size_t perRecord = keyPointer ? TUPLE_BYTES : width + TUPLE_BYTES;
+        const size_t chunk = memory().available() / perRecord;
+        if (chunk < 2) {
+            std::cerr << "Memory limit too small: " << memLimit << " bytes leaves no room for records." << std::endl;
+            ok = false;
+            return 0;
+        }
+        TrackedVector<KeyPointer> index;
+        TrackedVector<char> data;
+        index.reserve(chunk);
+        if (!keyPointer) data.resize(chunk * width);
+        std::cout << "Records per run: " << chunk << std::endl;
+
+        bool more = true;
+        while (more) {
+            index.clear();
+            while (index.size() < chunk) {
+                const char* record = in.next();
+                if (!record) {
+                    more = false;
+                    break;
+                }
+                if (keyPointer) {
+                    index.push_back({normalizedKey(record, keyBytes), records});
+                } else {
+                    std::memcpy(data.data() + index.size() * width, record, width);
+                    index.push_back({normalizedKey(record, keyBytes), index.size()});
+                }
+                records++;
+            }
+            if (index.empty() && !runs.empty()) break;
+            // (key, record number) or (key, slot): ties stay in input order.
+            std::sort(index.begin(), index.end(), [](const KeyPointer& a, const KeyPointer& b) {
+                return a.key != b.key ? a.key < b.key : a.record < b.record;
+            });
+            // Full records that all fit in memory go straight to the output.
+            inMemory = !keyPointer && !more && runs.empty();
+            runs.push_back(inMemory ? outputFile : tmp.place("run" + std::to_string(runs.size()) + ".bin"));
+            if (!runOut.open(runs.back())) {
+                std::cerr << "Failed to create file: " << runs.back() << std::endl;
+                ok = false;
+                return 0;
+            }
+            for (const KeyPointer& entry : index) {
+                runOut.write(keyPointer ? reinterpret_cast<const char*>(&entry) : data.data() + entry.record * width);
+            }
+            if (!runOut.close()) {
+                std::cerr << "Failed to write file: " << runs.back() << std::endl;
+                ok = false;
+                return 0;
+            }
+            metrics().count("runs");
+            metrics().observe("run_length_records", index.size());
+        }
+        bytesRead += in.bytesRead();
+        bytesWritten += runOut.bytesWritten();
+        runPhase.addRecords(records);
+    }
+    if (inMemory) {
+        metrics().count("bytes_read", bytesRead);
+        metrics().count("bytes_written", bytesWritten);
+        std::cout << "Input fit in memory; sorted without temporary runs." << std::endl;
+        std::cout << "Wide record sort completed." << std::endl;
+        return records;
+    }
+    std::cout << "Created " << runs.size() << " runs of " << records << " records." << std::endl;
+
+    // --------- Phase 2: merge, then write (full records) or gather ---------
+    RecordWriter out(width, bufSize);
+    if (!out.open(outputFile)) {
+        std::cerr << "Failed to open output file: " << outputFile << std::endl;
+        ok = false;
+        return 0;
+    }
+    if (keyPointer) {
+        // The final merge and the gather split what is left.
+        int inputFd = open(inputFile.c_str(), O_RDONLY);
+        if (inputFd < 0) {
+            std::cerr << "Failed to reopen input file: " << inputFile << std::endl;
+            ok = false;
+            return 0;
+        }
+        const size_t share = memory().available() / 2;
+        Gatherer gather(inputFd, width, share, out);
+        std::cout << "Gather batches of " << gather.capacity() << " records." << std::endl;
+        ok = mergeAll(runs, sortWidth, keyOf, share, tmp, [&](const char* tuple) {
+            return gather.add(tuple);
+        }, bytesRead, bytesWritten);
+        {
+            PhaseTimer gatherPhase("gather");
+            ok = gather.flush() && ok;
+            gatherPhase.addRecords(records);
+        }
+        close(inputFd);
+        bytesRead += gather.bytesRead;
+        metrics().count("gather_batches", gather.batches);
+        metrics().count("gather_reads", gather.reads);
+        metrics().count("gather_bytes_read", gather.bytesRead);
+        std::cout << "Gathered payloads in " << gather.batches << " batches, " << gather.reads << " reads." << std::endl;
+    } else {
+        ok = mergeAll(runs, sortWidth, keyOf, memory().available(), tmp, [&](const char* record) {
+            out.write(record);
+            return true;
+        }, bytesRead, bytesWritten);
+    }
+    ok = out.close() && ok;
+    bytesWritten += out.bytesWritten();
+    if (!ok) {
+        std::cerr << "Wide record sort failed while merging or writing the output." << std::endl;
+        return 0;
+    }
+    metrics().count("bytes_read", bytesRead);
+    metrics().count("bytes_written", bytesWritten);
+    std::cout << "I/O: read " << bytesRead / (1024 * 1024) << " MB, wrote " << bytesWritten / (1024 * 1024) << " MB"
+              << std::endl;
+    std::cout << "Wide record sort completed." << std::endl;
+    return records;
+}
+
+bool wideSort(const std::string& inputFile, const std::string& outputFile, size_t memLimit,
+              const RecordLayout& layout, const std::string& mode, const SortOptions& options) {
+    metrics().reset(options.metricsOut);
+    metrics().set("engine", "wide");
+    metrics().set("input", inputFile);
+    metrics().set("output", outputFile);
+    metrics().set("mem_limit", std::to_string(memLimit));
+    memory().reset(memLimit);
+    bool ok = true;
+    try {
+        PhaseTimer total("total");
+        total.addRecords(sortWide(inputFile, outputFile, memLimit, layout, mode, options, ok));
+    } catch (const MemoryLimitExceeded& e) {
+        std::cerr << "Memory limit exceeded: " << e.what() << std::endl;
+        ok = false;
+    } catch (const std::invalid_argument& e) {
+        std::cerr << e.what() << std::endl;
+        ok = false;
+    }
+    reportMemory(std::cout);
+    if (!metrics().write()) {
+        std::cerr << "Failed to write metrics to " << options.metricsOut << std::endl;
+    }
+    return ok;
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include "../merge_sort/sort_options.hpp"
+#include <string>
+#include <cstddef>
+
+// Sort for records wider than one int, as generate_input writes them with
+// --key-bits and --record-bytes: a signed little-endian key of keyBytes
+// (4 or 8) at the start of every record, payload after it. Records with
+// equal keys keep their input order.
+//
+// Two modes:
+// - full-record: runs of whole records, merged whole.
+// - key-pointer: run generation and the merges move only 16-byte
+//   (normalized key, record number) tuples. The final merge feeds a
+//   gather that fetches the payloads in large batches sorted by file
+//   offset, so its reads move forward through the input, and writes each
+//   batch back in key order. Needs a regular input file.
+
+struct RecordLayout {
+    size_t recordBytes = 4;
+    size_t keyBytes = 4;
+};
+
+// Predicted bytes of I/O for both modes and the chosen one. Key-pointer
+// mode needs records at least four tuples wide and must predict less I/O
+// than full records: it saves the full records' run and merge traffic
+// but reads every record a second time in the gather, seeking between
+// records that lie far apart in a batch. It therefore wins where full
+// records need extra merge passes or the gather batches cover the input
+// densely. Without a record count (streams) full records are chosen.
+struct WidePlan {
+    std::string mode = "full-record";
+    uint64_t fullRecordBytes = 0, keyPointerBytes = 0;
+};
+WidePlan planWideSort(const RecordLayout& layout, uint64_t records, size_t memLimit);
+
+// Sorts inputFile into outputFile. `mode` is "auto" (planWideSort),
+// "full-record" or "key-pointer"; a stream input always gets full
+// records. Uses options.tmpDirs, tmpPolicy, tmpPrefix and metricsOut.
+bool wideSort(const std::string& inputFile, const std::string& outputFile, size_t memLimit,
+              const RecordLayout& layout, const std::string& mode, const SortOptions& options);
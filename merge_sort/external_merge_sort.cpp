@@ -1,186 +1,1218 @@
 #include "external_merge_sort.hpp"
 #include "io_utils.hpp"
-#include "tournament_tree.hpp"
+#include "merge_kernels.hpp"
+#include "run_tagged_tree.hpp"
+#include "manifest.hpp"
+#include "temp_dirs.hpp"
+#include "metrics.hpp"
+#include "numa_topology.hpp"
+#include "key_spec.hpp"
+#include "sparse_index.hpp"
+#include "parallel_output.hpp"
+#include "pipeline.hpp"
 #include "logger.hpp"
 #include <iostream>
+#include <iomanip>
+#include <fstream>
 #include <vector>
 #include <string>
 #include <cstdio>
 #include <memory>
-#include <sstream>
 #include <climits>
+#include <thread>
+#include <mutex>
+#include <map>
+#include <exception>
+#include <chrono>
+#include <functional>
+#include <stdexcept>
+#include <sys/stat.h>
 
-// External Merge Sort using Tournament Tree (min-winner tree)
-void externalMergeSort(const std::string& inputFile, const std::string& outputFile, size_t memLimit, int k_way) {
-    std::cout << "=== External Merge Sort ===" << std::endl;
-    std::cout << "Input file: " << inputFile << std::endl;
-    std::cout << "Output file: " << outputFile << std::endl;
-    std::cout << "Memory limit: " << memLimit << " bytes" << std::endl;
+static const char* MANIFEST_FILE = "merge_sort.manifest";
+static const char* CARRY_FILE = "merge_sort.carry";
 
-    // --------- Phase 1: Run Generation (Replacement Selection) ---------
-    const size_t BUF_SIZE = 1 << 20; // 1 MB per buffer
-    Buffer inputBuf(BUF_SIZE), outputBuf(BUF_SIZE);
-    FileReader reader(inputFile, inputBuf);
-
-    std::vector<std::string> runs;
-    std::vector<int> treeKeys, pendingNextRun;
-    
-    size_t memForDataStructures = memLimit - (2 * BUF_SIZE);
-    size_t memoryPerKey = sizeof(int) + (2 * sizeof(TreeNode)); // Simplified memory estimation
-    size_t maxKeys = memForDataStructures / memoryPerKey;
-
-    TournamentTree tree(static_cast<int>(maxKeys));
-    std::cout << "Max keys in memory: " << maxKeys << std::endl;
-
-    // Initial load: fill tournament tree with as many records as possible
-    while (treeKeys.size() < maxKeys && reader.hasNext()) {
-        treeKeys.push_back(reader.next());
-    }
-    std::cout << "Initial keys loaded: " << treeKeys.size() << std::endl;
-    
-    std::vector<int> sourceIds(treeKeys.size());
-    for(size_t i = 0; i < treeKeys.size(); ++i) sourceIds[i] = i;
-    tree.initialize(treeKeys, sourceIds);
-
-    const int INF_KEY = std::numeric_limits<int>::max();
-    int lastOutput = std::numeric_limits<int>::min();
-    int runCount = 0;
-    auto runWriter = std::make_unique<FileWriter>("run0.bin", outputBuf);
-
-    std::cout << "--- Run Creation Phase ---" << std::endl;
+// Phase 1 checkpoints also persist the records held in memory for the next
+// run, so they are only taken once this many memory-loads of run output
+// have been written since the previous one (keeps the extra I/O ~12%).
+static const size_t CHECKPOINT_INTERVAL_MEMORIES = 8;
+
+// Loads and validates a checkpoint. Every file the manifest lists must
+// still exist with its recorded size and checksum.
+static bool loadCheckpoint(Manifest& manifest, const std::string& inputFile, size_t memLimit, const KeySpec& keys) {
+    if (!manifest.load()) {
+        std::cout << "No checkpoint found; starting from scratch." << std::endl;
+        return false;
+    }
+    if (manifest.get("engine") != "merge" || manifest.get("input") != inputIdentity(inputFile)
+        || manifest.get("mem_limit") != std::to_string(memLimit) || manifest.get("key") != keys.describe()) {
+        std::cout << "Checkpoint belongs to a different sort; starting from scratch." << std::endl;
+        return false;
+    }
+    for (const char* kind : {"run", "carry", "pending", "merged"}) {
+        for (const ManifestFile& f : manifest.files(kind)) {
+            if (!Manifest::verify(f)) {
+                std::cout << "Checkpoint file " << f.path << " is missing or corrupt; starting from scratch." << std::endl;
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+static void reportIndex(SparseIndexWriter& index, const std::string& path) {
+    if (index.close()) std::cout << "Sparse index: " << path << " (" << index.entries() << " entries)" << std::endl;
+}
+
+// Inputs beyond mergeSort's inputFile (externalMergeSortFiles).
+struct ExtraInputs {
+    std::vector<std::string> presorted; // join Phase 2 as runs, unchanged
+    std::vector<std::string> unsorted;  // go through run generation first
+};
+
+// A --presorted input turned out not to be sorted during the merge.
+struct UnsortedInput : std::runtime_error {
+    explicit UnsortedInput(const std::string& path)
+        : std::runtime_error("Input " + path + " is not sorted"), path(path) {}
+    std::string path;
+};
+
+// Reads of a presorted input: normalizes each block like run generation
+// would and checks it continues the order so far, setting *unsorted on a
+// violation. The merge runs on; its caller throws the result away.
+static BlockTransform checkedPresorted(const KeySpec& keys, bool* unsorted) {
+    BlockTransform encode = keys.encoder();
+    auto last = std::make_shared<int>(INT_MIN);
+    return [encode, last, unsorted](int* records, size_t count) {
+        if (encode) encode(records, count);
+        int prev = *last;
+        bool bad = false;
+        for (size_t i = 0; i < count; ++i) {
+            bad |= records[i] < prev;
+            prev = records[i];
+        }
+        *last = prev;
+        if (bad) *unsorted = true;
+    };
+}
+
+// Cheap test before an input is trusted as presorted: PROBE_SAMPLES
+// records spread evenly over the file must be in key order. Most unsorted
+// files fail it within a few reads; the merge then checks every record.
+static const uint64_t PROBE_SAMPLES = 64;
+
+static bool probeSorted(const std::string& path, const KeySpec& keys) {
+    struct stat st;
+    if (isStdStream(path) || stat(path.c_str(), &st) != 0 || !S_ISREG(st.st_mode)) return false;
+    uint64_t records = st.st_size / sizeof(int);
+    std::ifstream in(path, std::ios::binary);
+    if (!in.is_open()) return false;
+    if (records < 2) return true;
+    uint64_t samples = std::min<uint64_t>(PROBE_SAMPLES, records);
+    int prev = INT_MIN;
+    for (uint64_t i = 0; i < samples; ++i) {
+        uint64_t at = i * (records - 1) / (samples - 1);
+        int record = 0;
+        in.seekg(static_cast<std::streamoff>(at * sizeof(int)));
+        if (!in.read(reinterpret_cast<char*>(&record), sizeof(record))) return false;
+        int key = keys.encode(record);
+        if (key < prev) return false;
+        prev = key;
+    }
+    return true;
+}
+
+static std::vector<std::string> paths(const std::vector<ManifestFile>& files) {
+    std::vector<std::string> out;
+    for (const auto& f : files) out.push_back(f.path);
+    return out;
+}
+
+// Replacement selection over a built tree: writes every key to *runWriter,
+// calling endRun() (which must replace runWriter) whenever the winner
+// belongs to the next run. nextInput(value) supplies new records.
+template <typename NextInput, typename EndRun>
+static void emitRuns(RunTaggedTree& tree, std::unique_ptr<FileWriter>& runWriter, NextInput nextInput, EndRun endRun) {
+    uint32_t currentRun = 0;
+    int value;
     while (!tree.empty()) {
-        int minKey = tree.getMinKey();
-        int srcId = tree.getMinSourceId();
-        tree.removeMin();
+        // The winner belongs to the next run: the current one is done.
+        if (tree.minRun() != currentRun) {
+            currentRun = tree.minRun();
+            endRun();
+        }
+        int minKey = tree.minKey();
         runWriter->write(minKey);
-        if (runWriter->bufferFull()) runWriter->flush();
-        lastOutput = minKey;
-
-        if (reader.hasNext()) {
-            int nextVal = reader.next();
-            if (nextVal < lastOutput) {
-                tree.replaceKey(srcId, INF_KEY);
-                pendingNextRun.push_back(nextVal);
-            } else {
-                tree.replaceKey(srcId, nextVal);
-            }
+        if (nextInput(value)) {
+            // A record smaller than what was just written cannot join
+            // this run; it waits in the tree for the next one.
+            tree.replaceMin(value, value < minKey ? currentRun + 1 : currentRun);
         } else {
-            // No more input, just keep removing min until tree is empty
-            // The call to removeMin() at the start of the loop handles this
+            tree.removeMin();
         }
+    }
+}
 
-        // When all remaining keys are INF_KEY, finish current run and start a new one
-        if (tree.getMinKey() == INF_KEY) {
-            runWriter->flush();
-            runWriter->close();
-            runs.push_back(runWriter->fileName());
-            std::cout << "Finished run " << runCount << ": " << runs.back() << std::endl;
+// Opens a temp file for writing; throws SortFailed if it cannot be created.
+static std::unique_ptr<FileWriter> createTempWriter(const std::string& path, Buffer& buffer, IoStats* stats) {
+    auto writer = std::make_unique<FileWriter>(path, buffer, stats);
+    if (!writer->isOpen()) throw SortFailed("Failed to create temp file " + path);
+    return writer;
+}
 
-            if (!pendingNextRun.empty()) {
-                runCount++;
-                std::string nextRun = "run" + std::to_string(runCount) + ".bin";
-                std::cout << "Starting new run " << runCount << ": " << nextRun << std::endl;
-                runWriter = std::make_unique<FileWriter>(nextRun, outputBuf);
-
-                treeKeys.assign(pendingNextRun.begin(), pendingNextRun.end());
-                pendingNextRun.clear();
-                
-                while (treeKeys.size() < maxKeys && reader.hasNext()) {
-                    treeKeys.push_back(reader.next());
-                }
+// Closes a temp file; throws SortFailed if not all of it was written.
+static void closeTempWriter(FileWriter& writer) {
+    writer.close();
+    if (writer.failed()) throw SortFailed("Failed to write temp file " + writer.fileName());
+}
+
+// Merges `group` into mergedFile through the first group.size() readers
+// (already bound to their buffers), rewriting the output with
+// outputTransform and showing it to observer if they are given. Inputs
+// are read through inTransforms[j] when it is set. Returns the result as
+// a "merged" entry; throws SortFailed if mergedFile cannot be written.
+static ManifestFile mergeGroup(const std::vector<ManifestFile>& group, std::vector<std::unique_ptr<FileReader>>& readers,
+                               Buffer& outputBuf, const std::string& mergedFile, IoStats* outStats,
+                               const std::vector<IoStats*>& inStats, const BlockTransform& outputTransform = nullptr,
+                               const BlockSink& observer = nullptr, const std::vector<BlockTransform>& inTransforms = {}) {
+    std::vector<FileReader*> groupReaders;
+    for (size_t j = 0; j < group.size(); ++j) {
+        readers[j]->setTransform(j < inTransforms.size() ? inTransforms[j] : nullptr);
+        readers[j]->open(group[j].path, inStats[j]);
+        groupReaders.push_back(readers[j].get());
+    }
+    FileWriter mergedOut(mergedFile, outputBuf, outStats);
+    if (!mergedOut.isOpen()) throw SortFailed("Failed to open output file: " + mergedFile);
+    mergedOut.setTransform(outputTransform);
+    mergedOut.setObserver(observer);
+    mergeRuns(groupReaders.data(), static_cast<int>(group.size()), mergedOut);
+    mergedOut.close();
+    if (mergedOut.failed()) throw SortFailed("Failed to write " + mergedFile);
+    for (size_t j = 0; j < group.size(); ++j) readers[j]->close();
+    return {"merged", mergedFile, mergedOut.bytesWritten(), mergedOut.checksum()};
+}
+
+// 1 MB per I/O buffer, smaller under tight limits so keys still get most
+// of the memory; always whole records.
+size_t bufferSizeFor(size_t memBytes) {
+    size_t bytes = std::min<size_t>(1 << 20, std::max<size_t>(memBytes / 4, 4096));
+    return bytes - bytes % sizeof(int);
+}
+
+// Every input of a merge group needs at least a small read buffer and its
+// share of the merge kernel's queues next to the output buffer.
+static const size_t MIN_READ_BUF = 4096;
+
+size_t mergeFanInFor(size_t memBytes, size_t outBufSize) {
+    size_t outputBytes = BufferPool::roundedSize(outBufSize);
+    size_t room = memBytes > outputBytes ? memBytes - outputBytes : 0;
+    size_t fit = room / (MIN_READ_BUF + MERGE_BYTES_PER_RUN);
+    return fit < 2 ? 0 : fit;
+}
 
-                sourceIds.resize(treeKeys.size());
-                for(size_t i = 0; i < treeKeys.size(); ++i) sourceIds[i] = i;
-                tree.initialize(treeKeys, sourceIds);
-                lastOutput = std::numeric_limits<int>::min();
+// Read buffers share what the queues leave, up to outBufSize each, in
+// whole pages.
+size_t mergeReadBufferSize(size_t memBytes, size_t outBufSize, int fanIn) {
+    size_t room = memBytes - BufferPool::roundedSize(outBufSize);
+    size_t size = std::min(outBufSize, (room - fanIn * MERGE_BYTES_PER_RUN) / fanIn);
+    return size - size % MIN_READ_BUF;
+}
+
+// Merge fan-in before the Phase 2 memory check: the requested K, or the
+// heuristic min(8, buffers that fit in half the memory).
+static int initialFanIn(int k_way, size_t memLimit, size_t bufSize) {
+    int K = k_way > 0 ? k_way : std::min(8, static_cast<int>(memLimit / bufSize / 2));
+    return std::max(K, 2);
+}
+
+// Phase 1 workers: `threads` when the input is a regular file too big for
+// memory, the sort starts fresh (a resumed run generation continues on
+// one thread) and every worker's share still holds a useful tree; 1
+// otherwise. Sets `records` to the input's record count.
+static int runGenerationWorkers(const std::string& inputFile, size_t memLimit, int threads,
+                                bool freshStart, uint64_t& records) {
+    struct stat st;
+    if (threads <= 1 || !freshStart || isStdStream(inputFile) || stat(inputFile.c_str(), &st) != 0
+        || !S_ISREG(st.st_mode) || static_cast<size_t>(st.st_size) <= memLimit) {
+        return 1;
+    }
+    records = st.st_size / sizeof(int);
+    size_t share = memory().available() / threads;
+    if (share < 2 * BufferPool::roundedSize(bufferSizeFor(share)) + 1024 * RunTaggedTree::bytesPerKey()) {
+        std::cout << "Memory limit too small for " << threads << " workers; generating runs on one thread." << std::endl;
+        return 1;
+    }
+    return threads;
+}
+
+// One parallel run generation worker: a contiguous slice of the input,
+// sorted into runs by a thread pinned to one NUMA node. If there are more
+// runs than the final merge takes at once, they are merged down on that
+// node, so only the final merge reads across nodes.
+struct SliceWork {
+    int worker;
+    const NumaNode* node;
+    int ranOn = -1;
+    uint64_t first = 0, records = 0;
+    std::vector<ManifestFile> runs;
+    std::vector<uint64_t> runLengths; // records per generated run
+    uint64_t mergedRecords = 0;
+    double runSeconds = 0, mergeSeconds = 0;
+    std::exception_ptr error;
+};
+
+// Places a worker's temp file; TempDirs is shared by all workers.
+static std::string placeSliceFile(const SliceWork& work, const std::string& name, TempDirs& tmp,
+                                  std::mutex& tmpLock, IoStats*& stats) {
+    std::lock_guard<std::mutex> guard(tmpLock);
+    std::string path = tmp.place("w" + std::to_string(work.worker) + "_" + name);
+    stats = tmp.statsFor(path);
+    return path;
+}
+
+static void sortSlice(SliceWork& work, const std::string& inputFile, const BlockTransform& encode, size_t share,
+                      size_t bufSize, TempDirs& tmp, std::mutex& tmpLock) {
+    pinThreadToNode(*work.node);
+    work.ranOn = currentNumaNode();
+
+    // Everything below is allocated and first touched by this thread, so
+    // it lives on the worker's node.
+    auto start = std::chrono::steady_clock::now();
+    {
+        BufferPool pool(2, bufSize);
+        Buffer& inputBuf = pool.lease();
+        Buffer& outputBuf = pool.lease();
+        IoStats* inStats;
+        {
+            std::lock_guard<std::mutex> guard(tmpLock);
+            inStats = tmp.statsFor(inputFile);
+        }
+        FileReader reader(inputFile, inputBuf, inStats);
+        reader.setTransform(encode);
+        reader.skip(work.first);
+
+        size_t pools = 2 * BufferPool::roundedSize(bufSize);
+        size_t maxKeys = share > pools ? (share - pools) / RunTaggedTree::bytesPerKey() : 0;
+        maxKeys = std::min<size_t>({maxKeys, work.records, INT_MAX / 2});
+        RunTaggedTree tree(std::max<size_t>(maxKeys, 1));
+
+        uint64_t consumed = 0;
+        const int* block = nullptr;
+        size_t blockLen = 0, blockPos = 0;
+        auto nextInput = [&](int& value) {
+            if (consumed == work.records) return false;
+            if (blockPos == blockLen) {
+                blockLen = reader.nextBlock(block);
+                blockPos = 0;
+                if (blockLen == 0) return false;
             }
+            value = block[blockPos++];
+            consumed++;
+            return true;
+        };
+        int value;
+        while (tree.size() < tree.capacity() && nextInput(value)) tree.add(value);
+        tree.build();
+
+        IoStats* runStats;
+        auto newRunWriter = [&]() {
+            std::string name = placeSliceFile(work, "run" + std::to_string(work.runs.size()) + ".bin", tmp, tmpLock,
+                                              runStats);
+            return createTempWriter(name, outputBuf, runStats);
+        };
+        std::unique_ptr<FileWriter> runWriter = newRunWriter();
+        auto finishRun = [&]() {
+            closeTempWriter(*runWriter);
+            work.runs.push_back({"run", runWriter->fileName(), runWriter->bytesWritten(), runWriter->checksum()});
+            work.runLengths.push_back(runWriter->bytesWritten() / sizeof(int));
+        };
+        emitRuns(tree, runWriter, nextInput, [&]() {
+            finishRun();
+            runWriter = newRunWriter();
+        });
+        finishRun();
+        reader.close();
+    }
+    work.runSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Node-local merge passes that leave the worker targetRuns runs, on a
+// thread pinned to the worker's node again.
+static void mergeSlice(SliceWork& work, size_t share, size_t bufSize, size_t targetRuns, int fanIn, TempDirs& tmp,
+                       std::mutex& tmpLock) {
+    pinThreadToNode(*work.node);
+    auto start = std::chrono::steady_clock::now();
+    size_t k = std::min<size_t>(fanIn, mergeFanInFor(share, bufSize));
+    if (k < 2) throw SortFailed("Memory limit too small: a worker's share cannot hold a 2-way merge.");
+    std::vector<size_t> sizes(k, mergeReadBufferSize(share, bufSize, static_cast<int>(k)));
+    sizes.push_back(bufSize);
+    BufferPool pool(sizes);
+    Buffer& outputBuf = pool.lease(bufSize);
+    std::vector<std::unique_ptr<FileReader>> readers;
+    for (size_t j = 0; j < k; ++j) readers.push_back(std::make_unique<FileReader>(pool.lease()));
+
+    int merges = 0;
+    while (work.runs.size() > targetRuns) {
+        size_t groupSize = std::min(k, work.runs.size() - targetRuns + 1);
+        std::vector<ManifestFile> group(work.runs.begin(), work.runs.begin() + groupSize);
+        IoStats* outStats;
+        std::vector<IoStats*> inStats;
+        std::string mergedFile = placeSliceFile(work, "merge" + std::to_string(merges++) + ".bin", tmp, tmpLock,
+                                                outStats);
+        {
+            std::lock_guard<std::mutex> guard(tmpLock);
+            for (const ManifestFile& r : group) inStats.push_back(tmp.statsFor(r.path));
+        }
+        ManifestFile merged = mergeGroup(group, readers, outputBuf, mergedFile, outStats, inStats);
+        merged.kind = "run";
+        work.mergedRecords += merged.bytes / sizeof(int);
+        for (const ManifestFile& r : group) remove(r.path.c_str());
+        work.runs.erase(work.runs.begin(), work.runs.begin() + groupSize);
+        work.runs.push_back(merged);
+    }
+    work.mergeSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Parallel Phase 1: splits the input into one slice per worker, spreads
+// the workers round-robin over the NUMA nodes and returns every worker's
+// runs. Rethrows the first worker error (e.g. MemoryLimitExceeded).
+static std::vector<ManifestFile> generateRunsParallel(const std::string& inputFile, const BlockTransform& encode,
+                                                      uint64_t totalRecords, int threads, int fanIn, TempDirs& tmp) {
+    const std::vector<NumaNode>& nodes = numaNodes();
+    std::cout << "Parallel run generation: " << threads << " workers on " << nodes.size() << " NUMA node"
+              << (nodes.size() == 1 ? "" : "s") << "." << std::endl;
+
+    size_t share = memory().available() / threads;
+    size_t workerBuf = bufferSizeFor(share);
+    std::vector<SliceWork> work(threads);
+    for (int i = 0; i < threads; ++i) {
+        work[i].worker = i;
+        work[i].node = &nodes[i % nodes.size()];
+        work[i].first = totalRecords * i / threads;
+        work[i].records = totalRecords * (i + 1) / threads - work[i].first;
+    }
+    std::mutex tmpLock;
+    auto runWorkers = [&](const std::function<void(SliceWork&)>& body) {
+        std::vector<std::thread> workers;
+        for (SliceWork& w : work) {
+            workers.emplace_back([&, &w = w]() {
+                try {
+                    body(w);
+                } catch (...) {
+                    w.error = std::current_exception();
+                }
+            });
         }
+        for (std::thread& t : workers) t.join();
+        for (const SliceWork& w : work) {
+            if (w.error) std::rethrow_exception(w.error);
+        }
+    };
+    runWorkers([&](SliceWork& w) { sortSlice(w, inputFile, encode, share, workerBuf, tmp, tmpLock); });
+
+    // Only when the final merge cannot take every run in one pass do the
+    // workers merge locally, each down to its share of the fan-in.
+    size_t totalRuns = 0;
+    for (const SliceWork& w : work) totalRuns += w.runs.size();
+    if (totalRuns > static_cast<size_t>(fanIn)) {
+        runWorkers([&](SliceWork& w) {
+            size_t targetRuns = std::max<size_t>(1, fanIn * w.runs.size() / totalRuns);
+            if (w.runs.size() > targetRuns) mergeSlice(w, share, workerBuf, targetRuns, fanIn, tmp, tmpLock);
+        });
     }
 
-    if (runWriter && runWriter->isOpen()) {
-        runWriter->flush();
+    // Per-node breakdown: a node's time is its slowest worker's.
+    struct NodeTotals {
+        int workers = 0;
+        uint64_t records = 0, merged = 0;
+        size_t runs = 0;
+        double runSeconds = 0, mergeSeconds = 0;
+    };
+    std::map<int, NodeTotals> perNode;
+    for (const SliceWork& w : work) {
+        NodeTotals& t = perNode[w.node->id];
+        t.workers++;
+        t.records += w.records;
+        t.merged += w.mergedRecords;
+        t.runs += w.runLengths.size();
+        t.runSeconds = std::max(t.runSeconds, w.runSeconds);
+        t.mergeSeconds = std::max(t.mergeSeconds, w.mergeSeconds);
+        if (w.ranOn != w.node->id) {
+            LOG_DEBUG("Worker " << w.worker << " was placed on node " << w.node->id << " but ran on " << w.ranOn);
+        }
+    }
+    auto mbPerSec = [](uint64_t records, double seconds) {
+        return seconds > 0 ? records * sizeof(int) / seconds / 1e6 : 0.0;
+    };
+    std::cout << std::left << std::setw(6) << "Node" << std::right << std::setw(9) << "Workers"
+              << std::setw(12) << "Records" << std::setw(7) << "Runs"
+              << std::setw(14) << "Runs MB/s" << std::setw(14) << "Merge MB/s" << std::endl;
+    std::cout << std::fixed << std::setprecision(1);
+    for (const auto& entry : perNode) {
+        const NodeTotals& t = entry.second;
+        std::cout << std::left << std::setw(6) << entry.first << std::right << std::setw(9) << t.workers
+                  << std::setw(12) << t.records << std::setw(7) << t.runs
+                  << std::setw(14) << mbPerSec(t.records, t.runSeconds)
+                  << std::setw(14) << mbPerSec(t.merged, t.mergeSeconds) << std::endl;
+        std::string key = "numa_node" + std::to_string(entry.first) + "_";
+        metrics().count(key + "records", t.records);
+        metrics().count(key + "run_generation_mb_per_s", static_cast<uint64_t>(mbPerSec(t.records, t.runSeconds)));
+        metrics().count(key + "local_merge_mb_per_s", static_cast<uint64_t>(mbPerSec(t.merged, t.mergeSeconds)));
+    }
+    std::cout << std::defaultfloat;
+    metrics().set("numa_nodes", std::to_string(nodes.size()));
+    metrics().set("threads", std::to_string(threads));
+
+    std::vector<ManifestFile> runs;
+    for (const SliceWork& w : work) {
+        metrics().count("runs", w.runLengths.size());
+        for (uint64_t length : w.runLengths) metrics().observe("run_length_records", length);
+        runs.insert(runs.end(), w.runs.begin(), w.runs.end());
+    }
+    return runs;
+}
+
+// --pipeline runs a fresh, uncheckpointed run generation as a pipeline
+// (pipeline.hpp) unless the input fits in memory; those keep the
+// in-memory shortcut. Streams are assumed not to fit.
+static bool pipelinedRunGeneration(const std::string& inputFile, size_t memLimit, const SortOptions& options,
+                                   bool checkpointed) {
+    struct stat st;
+    if (!options.pipeline || checkpointed) return false;
+    if (isStdStream(inputFile)) return true;
+    return stat(inputFile.c_str(), &st) != 0 || !S_ISREG(st.st_mode) || static_cast<size_t>(st.st_size) > memLimit;
+}
+
+// Blocks in flight on each pipeline channel.
+static const size_t PIPELINE_BLOCKS = 2;
+
+// A block of run output between the run former and the run writer;
+// endsRun (with no block) closes the current run.
+struct RunBlock {
+    Buffer* block = nullptr;
+    bool endsRun = false;
+};
+
+// Replacement selection split into three stages that overlap: "read"
+// fills input blocks from the file, "form_runs" feeds them through the
+// tree and packs its output into output blocks, and "write" writes those
+// to run files. Used blocks return to their producer through a free
+// list, so PIPELINE_BLOCKS per direction bound the memory besides the
+// tree. Returns the runs in order and sets `records` to the input read;
+// throws SortFailed if a stage fails.
+static std::vector<ManifestFile> generateRunsPipelined(const std::string& inputFile, const BlockTransform& encode,
+                                                       size_t bufSize, TempDirs& tmp, uint64_t& records) {
+    // Read, form and write buffers plus the blocks in flight both ways,
+    // together the two I/O buffers of the sequential run generation.
+    const size_t buffers = 3 + 2 * PIPELINE_BLOCKS;
+    const size_t blockSize = std::max<size_t>(2 * bufSize / buffers, 4096);
+    BufferPool pool(buffers, blockSize);
+    Buffer& readBuf = pool.lease();
+    Buffer& formBuf = pool.lease();
+    Buffer& writeBuf = pool.lease();
+    BoundedChannel<Buffer*> freeInput("free_input", PIPELINE_BLOCKS, true), input("input", PIPELINE_BLOCKS);
+    BoundedChannel<Buffer*> freeOutput("free_output", PIPELINE_BLOCKS, true);
+    BoundedChannel<RunBlock> output("output", PIPELINE_BLOCKS + 1);
+    for (size_t i = 0; i < PIPELINE_BLOCKS; ++i) {
+        freeInput.push(&pool.lease());
+        freeOutput.push(&pool.lease());
+    }
+
+    const size_t maxKeys = std::min<size_t>(memory().available() / RunTaggedTree::bytesPerKey(), INT_MAX / 2);
+    if (maxKeys < 2) throw SortFailed("Memory limit too small: the pipeline's blocks leave no room for keys.");
+    RunTaggedTree tree(maxKeys);
+    std::cout << "Max keys in memory: " << maxKeys << " (pipelined)" << std::endl;
+    IoStats* inStats = tmp.statsFor(inputFile);
+
+    Pipeline pipeline;
+    for (ChannelBase* c : std::initializer_list<ChannelBase*>{&freeInput, &input, &freeOutput, &output}) {
+        pipeline.connect(*c);
+    }
+
+    pipeline.addStage("read", [&] {
+        FileReader reader(inputFile, readBuf, inStats);
+        if (!reader.isOpen()) throw std::runtime_error("cannot open input file " + inputFile);
+        reader.setTransform(encode);
+        const int* data;
+        while (size_t n = reader.nextBlock(data)) {
+            while (n > 0) {
+                Buffer* block;
+                if (!freeInput.pop(block)) return;
+                size_t take = std::min(n, block->capacity());
+                std::copy(data, data + take, block->raw());
+                block->resize(take);
+                if (!input.push(block)) return;
+                data += take;
+                n -= take;
+            }
+        }
+        input.close();
+    });
+
+    records = 0;
+    pipeline.addStage("form_runs", [&] {
+        Buffer* block = nullptr;
+        size_t pos = 0;
+        auto nextInput = [&](int& value) {
+            while (!block || pos == block->size()) {
+                if (block) freeInput.push(block);
+                block = nullptr;
+                if (!input.pop(block)) {
+                    block = nullptr;
+                    return false;
+                }
+                pos = 0;
+            }
+            value = block->raw()[pos++];
+            records++;
+            return true;
+        };
+        // The run writer's blocks are copies of formBuf's flushes. Once
+        // another stage failed the channels are closed and the blocks are
+        // dropped: the sink also runs from the writer's destructor, so it
+        // must not throw, and the pipeline reports the failure itself.
+        auto newRunWriter = [&] {
+            return std::make_unique<FileWriter>(formBuf, [&](const int* data, size_t n) {
+                while (n > 0) {
+                    Buffer* out;
+                    if (!freeOutput.pop(out)) return;
+                    size_t take = std::min(n, out->capacity());
+                    std::copy(data, data + take, out->raw());
+                    out->resize(take);
+                    if (!output.push({out, false})) return;
+                    data += take;
+                    n -= take;
+                }
+            });
+        };
+
+        int value;
+        while (tree.size() < maxKeys && nextInput(value)) tree.add(value);
+        tree.build();
+        std::unique_ptr<FileWriter> runWriter = newRunWriter();
+        emitRuns(tree, runWriter, nextInput, [&] {
+            runWriter->close();
+            output.push({nullptr, true});
+            runWriter = newRunWriter();
+        });
         runWriter->close();
-        runs.push_back(runWriter->fileName());
+        output.push({nullptr, true});
+        output.close();
+    });
+
+    std::vector<ManifestFile> runs;
+    pipeline.addStage("write", [&] {
+        std::unique_ptr<FileWriter> runWriter;
+        auto finishRun = [&] {
+            closeTempWriter(*runWriter);
+            runs.push_back({"run", runWriter->fileName(), runWriter->bytesWritten(), runWriter->checksum()});
+            metrics().count("runs");
+            metrics().observe("run_length_records", runWriter->bytesWritten() / sizeof(int));
+            LOG_DEBUG("Finished run " << runs.size() - 1 << ": " << runs.back().path);
+            runWriter.reset();
+        };
+        RunBlock item;
+        while (output.pop(item)) {
+            if (!runWriter) {
+                std::string name = tmp.place("run" + std::to_string(runs.size()) + ".bin");
+                runWriter = createTempWriter(name, writeBuf, tmp.statsFor(name));
+            }
+            if (item.endsRun) {
+                finishRun();
+                continue;
+            }
+            const int* data = item.block->raw();
+            size_t n = item.block->size();
+            while (n > 0) {
+                size_t room;
+                int* dst = runWriter->reserve(room);
+                size_t take = std::min(room, n);
+                std::copy(data, data + take, dst);
+                runWriter->commit(take);
+                data += take;
+                n -= take;
+            }
+            if (!freeOutput.push(item.block)) return;
+        }
+    });
+
+    std::cout << "--- Run Creation Phase (pipelined) ---" << std::endl;
+    try {
+        pipeline.run();
+    } catch (const MemoryLimitExceeded&) {
+        throw;
+    } catch (const std::runtime_error& e) {
+        throw SortFailed(std::string("Pipelined run generation failed: ") + e.what());
+    }
+    pipeline.report(std::cout);
+    return runs;
+}
+
+// External Merge Sort using Tournament Tree (min-winner tree). Returns the
+// number of input records.
+// Sorts inputFile into outputFile. With handOff set, stops instead once
+// at most maxRuns runs are left and returns them there. Extra inputs are
+// sorted into the same output (inputFile may then be empty); they are
+// not checkpointed. Throws UnsortedInput if a presorted one is not.
+static uint64_t mergeSort(const std::string& inputFile, const std::string& outputFile, size_t memLimit, int k_way,
+                          const SortOptions& options, SortedRuns* handOff = nullptr, size_t maxRuns = 1,
+                          const ExtraInputs& extra = ExtraInputs()) {
+    std::cout << "=== External Merge Sort ===" << std::endl;
+    if (!inputFile.empty()) std::cout << "Input file: " << inputFile << std::endl;
+    if (!handOff) std::cout << "Output file: " << outputFile << std::endl;
+    std::cout << "Memory limit: " << memLimit << " bytes" << std::endl;
+
+    // Records are normalized as they are read and restored as the output
+    // is written; runs and merges only see the normalized keys.
+    const KeySpec keys = options.keySpec.empty() ? KeySpec() : KeySpec::parse(options.keySpec);
+    if (!keys.identity()) std::cout << "Sort key: " << keys.describe() << std::endl;
+    metrics().set("key", keys.describe());
+
+    // The final pass (or the in-memory sort) feeds the output's sparse
+    // index as it writes; see sparse_index.hpp.
+    std::unique_ptr<SparseIndexWriter> index;
+    if (!handOff && !options.indexFile.empty()) {
+        index = std::make_unique<SparseIndexWriter>(options.indexFile, keys, options.indexStride);
+        if (!index->isOpen()) throw SortFailed("Failed to open index file: " + options.indexFile);
+        metrics().set("index", options.indexFile);
+    }
+    const BlockSink indexObserver = index ? index->observer() : nullptr;
+
+    const size_t bufSize = bufferSizeFor(memLimit);
+
+    TempDirs tmp(options.tmpDirs, TempDirs::parsePolicy(options.tmpPolicy), options.tmpPrefix);
+    const std::string carryFile = tmp.dirPath(CARRY_FILE);
+    Manifest manifest(tmp.dirPath(MANIFEST_FILE), options.checkpoint || options.resume);
+    bool resumed = options.resume && loadCheckpoint(manifest, inputFile, memLimit, keys);
+    if (resumed) {
+        for (const ManifestFile& f : manifest.files("obsolete")) remove(f.path.c_str());
+        manifest.removeFiles("obsolete");
+    } else {
+        manifest.discard();
+        manifest.set("engine", "merge");
+        manifest.set("input", inputIdentity(inputFile));
+        manifest.set("mem_limit", std::to_string(memLimit));
+        manifest.set("key", keys.describe());
+        manifest.set("phase", "runs");
+    }
+
+    std::vector<std::string> runs = paths(manifest.files("run"));
+    uint64_t totalRecords = 0;
+
+    // Extra inputs become runs up front: presorted files as they are, the
+    // others through their own run generation (no merging). Either way
+    // the in-memory shortcut below no longer applies.
+    uint64_t extraRecords = 0;
+    std::map<std::string, bool> unsortedInput; // presorted path -> found out of order
+    for (const std::string& path : extra.presorted) {
+        struct stat st;
+        uint64_t bytes = stat(path.c_str(), &st) == 0 ? static_cast<uint64_t>(st.st_size) : 0;
+        manifest.addFile("run", path, bytes, 0);
+        runs.push_back(path);
+        unsortedInput[path] = false;
+        extraRecords += bytes / sizeof(int);
+    }
+    for (size_t i = 0; i < extra.unsorted.size(); ++i) {
+        SortOptions inputOptions = options;
+        inputOptions.tmpPrefix += "in" + std::to_string(i) + "_";
+        inputOptions.indexFile.clear();
+        SortedRuns inputRuns;
+        mergeSort(extra.unsorted[i], "", memLimit, k_way, inputOptions, &inputRuns, SIZE_MAX);
+        for (const std::string& path : inputRuns.paths) {
+            struct stat st;
+            manifest.addFile("run", path, stat(path.c_str(), &st) == 0 ? st.st_size : 0, 0);
+            runs.push_back(path);
+        }
+        extraRecords += inputRuns.records;
+    }
+    if (!extra.presorted.empty()) {
+        std::cout << "Presorted inputs: " << extra.presorted.size() << " join the merge as runs." << std::endl;
+        metrics().count("presorted_inputs", extra.presorted.size());
+    }
+
+    // --------- Phase 1: Run Generation (Replacement Selection) ---------
+    if (manifest.get("phase") == "runs") {
+        PhaseTimer runPhase("run_generation");
+        uint64_t inputRecords = 0;
+        int workers = runGenerationWorkers(inputFile, memLimit, options.threads, !resumed, inputRecords);
+        if (inputFile.empty()) {
+            // Every input is an extra one, already in runs.
+        } else if (workers > 1) {
+            std::vector<ManifestFile> made = generateRunsParallel(inputFile, keys.encoder(), inputRecords, workers,
+                                                                  initialFanIn(k_way, memLimit, bufSize), tmp);
+            for (const ManifestFile& r : made) {
+                manifest.syncData(r.path);
+                manifest.addFile("run", r.path, r.bytes, r.checksum);
+                runs.push_back(r.path);
+            }
+            runPhase.addRecords(inputRecords);
+            totalRecords = inputRecords;
+            std::cout << "Created " << runs.size() << " runs." << std::endl;
+        } else if (pipelinedRunGeneration(inputFile, memLimit, options, manifest.enabled())) {
+            std::vector<ManifestFile> made = generateRunsPipelined(inputFile, keys.encoder(), bufSize, tmp, totalRecords);
+            for (const ManifestFile& r : made) {
+                manifest.addFile("run", r.path, r.bytes, r.checksum);
+                runs.push_back(r.path);
+            }
+            runPhase.addRecords(totalRecords);
+            std::cout << "Created " << runs.size() << " runs." << std::endl;
+        } else {
+            BufferPool runPool(2, bufSize);
+            Buffer& inputBuf = runPool.lease();
+            Buffer& outputBuf = runPool.lease();
+            FileReader reader(inputFile, inputBuf, tmp.statsFor(inputFile));
+            if (!reader.isOpen()) throw SortFailed("Failed to open input file: " + inputFile);
+            reader.setTransform(keys.encoder());
+            uint64_t consumed = std::stoull(manifest.get("consumed", "0"));
+            if (resumed) {
+                std::cout << "Resuming run generation after " << runs.size() << " runs ("
+                          << consumed << " input records already in runs or carried)." << std::endl;
+                reader.skip(consumed);
+            }
+            const uint64_t resumedAt = consumed;
+
+            // Everything left after the two I/O buffers is the tree. Records
+            // held back for the next run stay in it, tagged with that run.
+            size_t maxKeys = std::min<size_t>(memory().available() / RunTaggedTree::bytesPerKey(), INT_MAX / 2);
+            if (maxKeys < 2) {
+                throw SortFailed("Memory limit too small: " + std::to_string(memLimit) +
+                                 " bytes leaves no room for keys.");
+            }
+            RunTaggedTree tree(maxKeys);
+            std::cout << "Max keys in memory: " << maxKeys << std::endl;
+
+            // Records that were in memory at the checkpoint seed the next run.
+            for (const ManifestFile& carry : manifest.files("carry")) {
+                FileReader carryReader(carry.path, outputBuf, tmp.statsFor(carry.path));
+                while (carryReader.hasNext()) tree.add(carryReader.next());
+            }
+
+            // Initial load: fill the tree with as many records as possible.
+            // Input is consumed a buffer-sized block at a time from here on.
+            const int* block = nullptr;
+            size_t blockLen = 0, blockPos = 0;
+            auto nextInput = [&](int& value) {
+                if (blockPos == blockLen) {
+                    blockLen = reader.nextBlock(block);
+                    blockPos = 0;
+                    if (blockLen == 0) return false;
+                }
+                value = block[blockPos++];
+                consumed++;
+                return true;
+            };
+            int value;
+            while (tree.size() < maxKeys && nextInput(value)) tree.add(value);
+            std::cout << "Initial keys loaded: " << tree.size() << std::endl;
+
+            // Everything fit in memory: sort it and stream it straight to the
+            // output without creating any temporary runs. A hand-off needs
+            // a run, which the tree below produces as usual.
+            if (!handOff && runs.empty() && blockPos == blockLen && !reader.hasNext()) {
+                PhaseTimer sortPhase("in_memory_sort");
+                reader.close();
+                size_t records = tree.size();
+                tree.sortKeys();
+                FileWriter out(outputFile, outputBuf);
+                if (!out.isOpen()) throw SortFailed("Failed to open output file: " + outputFile);
+                out.setTransform(keys.decoder());
+                out.setObserver(indexObserver);
+                tree.forEachKey([&](int key) { out.write(key); });
+                out.close();
+                if (out.failed()) throw SortFailed("Failed to write " + outputFile);
+                if (index) reportIndex(*index, options.indexFile);
+                manifest.discard();
+                sortPhase.addRecords(records);
+                runPhase.addRecords(records);
+                std::cout << "Input fit in memory; sorted without temporary runs." << std::endl;
+                std::cout << "Merge sort completed." << std::endl;
+                return records;
+            }
+            tree.build();
+
+            int runCount = static_cast<int>(runs.size());
+            auto newRunWriter = [&]() {
+                std::string name = tmp.place("run" + std::to_string(runCount) + ".bin");
+                return createTempWriter(name, outputBuf, tmp.statsFor(name));
+            };
+            auto runWriter = newRunWriter();
+
+            // Runs finished since the last checkpoint, not yet fsynced.
+            std::vector<ManifestFile> unsyncedRuns;
+            uint64_t bytesSinceCheckpoint = 0;
+            auto finishRun = [&]() {
+                closeTempWriter(*runWriter);
+                runs.push_back(runWriter->fileName());
+                unsyncedRuns.push_back({"run", runWriter->fileName(), runWriter->bytesWritten(), runWriter->checksum()});
+                bytesSinceCheckpoint += runWriter->bytesWritten();
+                metrics().count("runs");
+                metrics().observe("run_length_records", runWriter->bytesWritten() / sizeof(int));
+            };
+            auto syncRuns = [&]() {
+                for (const ManifestFile& r : unsyncedRuns) {
+                    manifest.syncData(r.path);
+                    manifest.addFile(r.kind, r.path, r.bytes, r.checksum);
+                }
+                unsyncedRuns.clear();
+                bytesSinceCheckpoint = 0;
+            };
+
+            std::cout << "--- Run Creation Phase ---" << std::endl;
+            emitRuns(tree, runWriter, nextInput, [&]() {
+                finishRun();
+                LOG_DEBUG("Finished run " << runCount << ": " << runs.back());
+
+                // At a run boundary every record read so far is either in a
+                // finished run or in the tree, which makes it a consistent
+                // point to checkpoint.
+                if (manifest.enabled() && bytesSinceCheckpoint >= CHECKPOINT_INTERVAL_MEMORIES * memLimit) {
+                    std::unique_ptr<FileWriter> carryOut =
+                        createTempWriter(carryFile, outputBuf, tmp.statsFor(carryFile));
+                    tree.forEachKey([&](int key) { carryOut->write(key); });
+                    closeTempWriter(*carryOut);
+                    manifest.syncData(carryFile);
+                    syncRuns();
+                    manifest.removeFiles("carry");
+                    manifest.addFile("carry", carryFile, carryOut->bytesWritten(), carryOut->checksum());
+                    manifest.set("consumed", std::to_string(consumed));
+                    manifest.commit();
+                    metrics().count("checkpoints");
+                    std::cout << "Checkpoint: " << runs.size() << " runs, "
+                              << consumed << " input records." << std::endl;
+                }
+
+                runCount++;
+                runWriter = newRunWriter();
+                LOG_DEBUG("Starting new run " << runCount << ": " << runWriter->fileName());
+            });
+
+            if (runWriter && runWriter->isOpen()) {
+                finishRun();
+            }
+            reader.close();
+            runPhase.addRecords(consumed - resumedAt);
+            totalRecords = consumed;
+            std::cout << "Created " << runs.size() << " runs." << std::endl;
+            syncRuns();
+        }
+
+        totalRecords += extraRecords;
+
+        // Phase boundary: all runs are durable and become the first merge
+        // pass's inputs.
+        for (const ManifestFile& r : manifest.files("run")) {
+            manifest.addFile("pending", r.path, r.bytes, r.checksum);
+        }
+        manifest.removeFiles("carry");
+        manifest.set("consumed", std::to_string(totalRecords));
+        manifest.set("phase", "merge");
+        manifest.set("pass", "1");
+        manifest.commit();
+        if (manifest.enabled()) remove(carryFile.c_str());
+    } else {
+        totalRecords = std::stoull(manifest.get("consumed", "0"));
+        std::cout << "Resuming merge pass " << manifest.get("pass") << " with "
+                  << manifest.files("pending").size() << " unmerged and "
+                  << manifest.files("merged").size() << " merged runs." << std::endl;
     }
-    reader.close();
 
-    // --------- Phase 2: Multi-way Merge (K-way Merge with Tournament Tree) ---------
+    // --------- Phase 2: Multi-way Merge (K-way Merge, see merge_kernels.hpp) ---------
     std::cout << "--- Multi-way Merging Phase ---" << std::endl;
     int K;
     if (k_way > 0) {
         K = k_way;
         std::cout << "Using fixed K = " << K << std::endl;
     } else {
-        K = std::min(8, static_cast<int>(memLimit / BUF_SIZE / 2));
+        K = initialFanIn(0, memLimit, bufSize);
         std::cout << "Using heuristic K = " << K << std::endl;
     }
-    std::vector<std::string> currentRuns = runs, nextRuns;
-    int pass = 1;
+    K = std::max(K, 2);
+    size_t fitK = mergeFanInFor(memory().available(), bufSize);
+    if (fitK < 2) {
+        throw SortFailed("Memory limit too small: " + std::to_string(memLimit) + " bytes cannot hold a 2-way merge.");
+    }
+    if (static_cast<size_t>(K) > fitK) {
+        K = static_cast<int>(fitK);
+        std::cout << "Reducing K to " << K << " to fit the memory limit." << std::endl;
+    }
+    metrics().set("k", std::to_string(K));
+    metrics().set("simd", simdLevelName(simdLevel()));
+    std::cout << "Merge kernels use SIMD: " << simdLevelName(simdLevel()) << std::endl;
+
+    // One pool for the whole phase: K read buffers and the output buffer.
+    // Readers are bound to their buffers once and reopened for every group
+    // of every pass.
+    size_t readBufSize = mergeReadBufferSize(memory().available(), bufSize, K);
+    std::vector<size_t> poolSizes(K, readBufSize);
+    poolSizes.push_back(bufSize);
+    auto mergePool = std::make_unique<BufferPool>(poolSizes);
+    Buffer& outputBuf = mergePool->lease(bufSize);
+    std::vector<std::unique_ptr<FileReader>> runReaders;
+    for (int j = 0; j < K; ++j) runReaders.push_back(std::make_unique<FileReader>(mergePool->lease()));
 
-    while (currentRuns.size() > 1) {
+    // Each pass consumes "pending" runs and produces "merged" ones; the
+    // manifest is committed after every group so a crash loses at most one
+    // group's work.
+    std::vector<ManifestFile> currentRuns = manifest.files("pending");
+    std::vector<ManifestFile> nextRuns = manifest.files("merged");
+    int pass = std::stoi(manifest.get("pass", "1"));
+    // With --threads and a regular output file the passes stop at K runs
+    // and the last merge is split among several writers (see
+    // parallel_output.hpp), unless an index or the check of presorted
+    // inputs needs the output in one ordered stream.
+    const bool parallelFinal = !handOff && !index && unsortedInput.empty() && parallelOutput(outputFile, options.threads);
+    const size_t stopAt = handOff ? std::max<size_t>(maxRuns, 1) : parallelFinal ? static_cast<size_t>(K) : 1;
+
+    while (currentRuns.size() + nextRuns.size() > stopAt) {
+        PhaseTimer passPhase("merge_pass_" + std::to_string(pass));
+        metrics().count("merge_passes");
         std::cout << "Merge pass " << pass << ": " << currentRuns.size()
                   << " runs, merging " << K << " at a time." << std::endl;
-        nextRuns.clear();
 
-        for (size_t i = 0; i < currentRuns.size(); i += K) {
-            int groupSize = std::min(K, static_cast<int>(currentRuns.size() - i));
-            std::cout << "Merging group of " << groupSize << " runs." << std::endl;
+        // The last pass writes straight to the output (which may be stdout)
+        // instead of producing a temp file to rename.
+        bool finalPass = !handOff && nextRuns.empty() && currentRuns.size() <= static_cast<size_t>(K);
 
-            std::vector<std::unique_ptr<Buffer>> buffers;
-            std::vector<std::unique_ptr<FileReader>> runReaders;
-            for (int j = 0; j < groupSize; ++j) {
-                buffers.push_back(std::make_unique<Buffer>(BUF_SIZE));
-                runReaders.push_back(std::make_unique<FileReader>(currentRuns[i + j], *buffers.back()));
+        while (!currentRuns.empty()) {
+            // With several temp devices the group reads from devices other
+            // than the one its output goes to.
+            std::vector<size_t> group, avoid;
+            if (finalPass) {
+                for (size_t j = 0; j < currentRuns.size(); ++j) group.push_back(j);
+            } else {
+                group = tmp.nextMergeGroup(paths(currentRuns), K, avoid);
             }
+            int groupSize = static_cast<int>(group.size());
+            LOG_DEBUG("Merging group of " << groupSize << " runs.");
+            metrics().count("merge_groups");
+            metrics().observe("merge_group_runs", groupSize);
 
-            TournamentTree mergeTree(groupSize);
-            std::vector<int> initKeys(groupSize), sourceIds(groupSize);
-            for (int j = 0; j < groupSize; ++j) {
-                initKeys[j] = runReaders[j]->hasNext() ? runReaders[j]->next() : INF_KEY;
-                sourceIds[j] = j;
+            std::vector<ManifestFile> groupRuns;
+            std::vector<IoStats*> inStats;
+            std::vector<BlockTransform> inTransforms;
+            for (size_t j : group) {
+                const std::string& path = currentRuns[j].path;
+                groupRuns.push_back(currentRuns[j]);
+                inStats.push_back(tmp.statsFor(path));
+                auto presorted = unsortedInput.find(path);
+                inTransforms.push_back(presorted != unsortedInput.end() ? checkedPresorted(keys, &presorted->second)
+                                                                       : nullptr);
             }
-            mergeTree.initialize(initKeys, sourceIds);
 
-            std::string mergedFile = "merge_pass" + std::to_string(pass)
-                                   + "_run" + std::to_string(i / K) + ".bin";
-            FileWriter mergedOut(mergedFile, outputBuf);
-
-            while (!mergeTree.empty()) {
-                int smallest = mergeTree.getMinKey();
-                int srcRun = mergeTree.getMinSourceId();
-                
-                if (smallest == INF_KEY) break;
-
-                mergedOut.write(smallest);
-                if (mergedOut.bufferFull()) mergedOut.flush();
-
-                if (runReaders[srcRun]->hasNext()) {
-                    mergeTree.replaceKey(srcRun, runReaders[srcRun]->next());
-                } else {
-                    mergeTree.replaceKey(srcRun, INF_KEY);
+            std::string mergedFile = finalPass ? outputFile
+                                   : tmp.place("merge_pass" + std::to_string(pass)
+                                               + "_run" + std::to_string(nextRuns.size()) + ".bin", avoid);
+            ManifestFile merged = mergeGroup(groupRuns, runReaders, outputBuf, mergedFile,
+                                             tmp.statsFor(mergedFile), inStats,
+                                             finalPass ? keys.decoder() : nullptr,
+                                             finalPass ? indexObserver : nullptr, inTransforms);
+            // A presorted input out of order spoils the whole result: drop
+            // every temp file and let the caller sort it properly.
+            for (const ManifestFile& r : groupRuns) {
+                auto presorted = unsortedInput.find(r.path);
+                if (presorted == unsortedInput.end() || !presorted->second) continue;
+                for (const auto* list : {&currentRuns, &nextRuns}) {
+                    for (const ManifestFile& f : *list) {
+                        if (!unsortedInput.count(f.path)) remove(f.path.c_str());
+                    }
                 }
+                if (!finalPass) remove(mergedFile.c_str());
+                throw UnsortedInput(r.path);
             }
+            passPhase.addRecords(merged.bytes / sizeof(int));
+            if (!isStdStream(mergedFile)) manifest.syncData(mergedFile);
+            nextRuns.push_back(merged);
+            manifest.addFile(merged.kind, merged.path, merged.bytes, merged.checksum);
+            // Inputs are marked obsolete before they are deleted so a crash
+            // in between cannot orphan them.
+            // Presorted inputs are the caller's files and are never deleted.
+            for (size_t j : group) {
+                const ManifestFile& r = currentRuns[j];
+                if (!unsortedInput.count(r.path)) manifest.addFile("obsolete", r.path, r.bytes, r.checksum);
+            }
+            manifest.commit();
 
-            mergedOut.flush();
-            mergedOut.close();
-            for (auto& rr : runReaders) rr->close();
-            nextRuns.push_back(mergedFile);
-
-            // Optional: Delete old temporary runs to save disk space
-            for (int j = 0; j < groupSize; ++j) {
-                if (remove(currentRuns[i + j].c_str()) != 0) {
-                    std::stringstream ss;
-                    ss << "Error deleting file: " << currentRuns[i + j];
-                    LOG_DEBUG(ss.str());
+            for (auto j = group.rbegin(); j != group.rend(); ++j) {
+                if (!unsortedInput.count(currentRuns[*j].path) && remove(currentRuns[*j].path.c_str()) != 0) {
+                    LOG_DEBUG("Error deleting file: " << currentRuns[*j].path);
                 }
+                currentRuns.erase(currentRuns.begin() + *j);
             }
+            manifest.removeFiles("obsolete");
         }
+
+        // Pass boundary: this pass's outputs are the next pass's inputs.
         currentRuns.swap(nextRuns);
         pass++;
+        manifest.removeFiles("merged");
+        for (const ManifestFile& r : currentRuns) manifest.addFile("pending", r.path, r.bytes, r.checksum);
+        manifest.set("pass", std::to_string(pass));
+        manifest.commit();
+        if (finalPass) break;
     }
 
-    if (!currentRuns.empty()) {
-        rename(currentRuns[0].c_str(), outputFile.c_str());
+    if (handOff) {
+        for (const ManifestFile& r : currentRuns) handOff->paths.push_back(r.path);
+        handOff->records = totalRecords;
+        manifest.discard();
+        tmp.report(std::cout);
+        tmp.recordMetrics();
+        std::cout << "Left " << currentRuns.size() << " runs for the final merge." << std::endl;
+        return totalRecords;
     }
+
+    if (parallelFinal && currentRuns.size() + nextRuns.size() > 1) {
+        std::vector<ManifestFile> finalRuns = currentRuns;
+        finalRuns.insert(finalRuns.end(), nextRuns.begin(), nextRuns.end());
+        // The phase's pool goes back to the governor; the writers share it.
+        runReaders.clear();
+        mergePool.reset();
+        PhaseTimer passPhase("merge_pass_" + std::to_string(pass));
+        metrics().count("merge_passes");
+        metrics().count("merge_groups");
+        metrics().observe("merge_group_runs", finalRuns.size());
+        std::vector<IoStats*> inStats;
+        for (const ManifestFile& r : finalRuns) inStats.push_back(tmp.statsFor(r.path));
+        uint64_t records = 0;
+        int writers = mergeParallel(paths(finalRuns), outputFile, options.threads, memory().available(),
+                                    keys.decoder(), records, inStats, tmp.statsFor(outputFile));
+        if (writers == 0) throw SortFailed("Failed to write " + outputFile);
+        std::cout << "Merge pass " << pass << ": " << finalRuns.size() << " runs, merged by " << writers
+                  << " writers." << std::endl;
+        metrics().set("output_writers", std::to_string(writers));
+        passPhase.addRecords(records);
+
+        ManifestFile merged{"merged", outputFile, records * sizeof(int), 0};
+        if (manifest.enabled()) fileChecksum(outputFile, merged.bytes, merged.checksum);
+        manifest.syncData(outputFile);
+        manifest.addFile(merged.kind, merged.path, merged.bytes, merged.checksum);
+        for (const ManifestFile& r : finalRuns) manifest.addFile("obsolete", r.path, r.bytes, r.checksum);
+        manifest.commit();
+        for (const ManifestFile& r : finalRuns) remove(r.path.c_str());
+        manifest.removeFiles("obsolete");
+        currentRuns.assign(1, merged);
+        nextRuns.clear();
+    }
+
+    // A single run (e.g. presorted input) never went through a merge pass.
+    // Its keys are still normalized unless the spec is the identity, so
+    // then it is copied through the decoder instead of moved. A presorted
+    // input is always copied (and checked on the way).
+    auto single = currentRuns.size() == 1 ? unsortedInput.find(currentRuns[0].path) : unsortedInput.end();
+    if (single != unsortedInput.end()) {
+        mergeGroup({currentRuns[0]}, runReaders, outputBuf, outputFile, tmp.statsFor(outputFile),
+                   {tmp.statsFor(currentRuns[0].path)}, keys.decoder(), indexObserver,
+                   {checkedPresorted(keys, &single->second)});
+        if (single->second) throw UnsortedInput(single->first);
+    } else if (currentRuns.size() == 1 && currentRuns[0].path != outputFile) {
+        if (!keys.identity()) {
+            mergeGroup({currentRuns[0]}, runReaders, outputBuf, outputFile, tmp.statsFor(outputFile),
+                       {tmp.statsFor(currentRuns[0].path)}, keys.decoder(), indexObserver);
+            remove(currentRuns[0].path.c_str());
+        } else {
+            // Moved rather than written: index the run before it goes.
+            if (index) indexSortedFile(currentRuns[0].path, outputBuf, *index);
+            if (!moveOrCopyFile(currentRuns[0].path, outputFile)) {
+                throw SortFailed("Failed to move final run to " + outputFile);
+            }
+        }
+    }
+    if (index) reportIndex(*index, options.indexFile);
+    manifest.discard();
+    tmp.report(std::cout);
+    tmp.recordMetrics();
     std::cout << "Merge sort completed." << std::endl;
+    return totalRecords;
+}
+
+bool sortToRuns(const std::string& inputFile, size_t memLimit, int k_way, size_t maxRuns,
+                const SortOptions& options, SortedRuns& out) {
+    SortOptions runOptions = options;
+    runOptions.checkpoint = runOptions.resume = false;
+    out = SortedRuns();
+    mergeSort(inputFile, "", memLimit, k_way, runOptions, &out, maxRuns);
+    return !out.paths.empty();
+}
+
+uint64_t mergeSortFile(const std::string& inputFile, const std::string& outputFile, size_t memLimit, int k_way,
+                       const SortOptions& options) {
+    SortOptions fileOptions = options;
+    fileOptions.checkpoint = fileOptions.resume = false;
+    return mergeSort(inputFile, outputFile, memLimit, k_way, fileOptions);
+}
+
+// Metrics, memory governor and error handling around one sort.
+static bool runSort(const std::string& inputLabel, const std::string& outputFile, size_t memLimit,
+                    const SortOptions& options, const std::function<uint64_t()>& sort) {
+    metrics().reset(options.metricsOut);
+    metrics().set("engine", "merge_sort");
+    metrics().set("input", inputLabel);
+    metrics().set("output", outputFile);
+    metrics().set("mem_limit", std::to_string(memLimit));
+    memory().reset(memLimit);
+    bool ok = true;
+    try {
+        PhaseTimer total("total");
+        total.addRecords(sort());
+    } catch (const MemoryLimitExceeded& e) {
+        std::cerr << "Memory limit exceeded: " << e.what() << std::endl;
+        ok = false;
+    } catch (const std::invalid_argument& e) {
+        std::cerr << e.what() << std::endl;
+        ok = false;
+    } catch (const SortFailed& e) {
+        std::cerr << e.what() << std::endl;
+        ok = false;
+    }
+    reportMemory(std::cout);
+    if (!metrics().write()) {
+        std::cerr << "Failed to write metrics to " << options.metricsOut << std::endl;
+    }
+    return ok;
+}
+
+bool externalMergeSort(const std::string& inputFile, const std::string& outputFile, size_t memLimit, int k_way,
+                       const SortOptions& options) {
+    return runSort(inputFile, outputFile, memLimit, options,
+                   [&]() { return mergeSort(inputFile, outputFile, memLimit, k_way, options); });
+}
+
+bool externalMergeSortFiles(const std::vector<std::string>& inputFiles, const std::string& outputFile,
+                            size_t memLimit, int k_way, const SortOptions& options) {
+    std::string label;
+    for (const std::string& input : inputFiles) {
+        if (input == outputFile || sameFile(input, outputFile)) {
+            std::cerr << "The output must not be one of the inputs: " << outputFile << std::endl;
+            return false;
+        }
+        label += (label.empty() ? "" : ",") + input;
+    }
+    return runSort(label, outputFile, memLimit, options, [&]() -> uint64_t {
+        const KeySpec keys = options.keySpec.empty() ? KeySpec() : KeySpec::parse(options.keySpec);
+        ExtraInputs extra;
+        std::vector<std::string> unsorted;
+        for (const std::string& input : inputFiles) {
+            if (probeSorted(input, keys)) {
+                extra.presorted.push_back(input);
+            } else {
+                std::cout << "Input " << input << " is not sorted; it goes through run generation." << std::endl;
+                unsorted.push_back(input);
+            }
+        }
+        while (true) {
+            std::string first = unsorted.empty() ? "" : unsorted[0];
+            extra.unsorted.assign(unsorted.begin() + (unsorted.empty() ? 0 : 1), unsorted.end());
+            try {
+                return mergeSort(first, outputFile, memLimit, k_way, options, nullptr, 1, extra);
+            } catch (const UnsortedInput& e) {
+                std::cout << e.what() << " after all." << std::endl;
+                if (isStdStream(outputFile)) {
+                    throw std::invalid_argument("Output already streamed; cannot sort again.");
+                }
+                std::cout << "Sorting again with it through run generation." << std::endl;
+                metrics().count("presorted_rejected");
+                extra.presorted.erase(std::find(extra.presorted.begin(), extra.presorted.end(), e.path));
+                unsorted.push_back(e.path);
+            }
+        }
+    });
 }
@@ -1,10 +1,55 @@
 #pragma once
-#include "tournament_tree.hpp"
-#include "io_utils.hpp" 
+#include "merge_kernels.hpp"
+#include "io_utils.hpp"
+#include "sort_options.hpp"
 #include <vector>
 #include <string>
 #include <climits>
 #include <algorithm>
 #include <iostream>
 
-void externalMergeSort(const std::string& inputFile, const std::string& outputFile, size_t memLimit, int k_way = 0);
+// False if the sort hit the memory limit (the hard cap on everything the
+// engine allocates).
+bool externalMergeSort(const std::string& inputFile, const std::string& outputFile, size_t memLimit, int k_way = 0,
+                       const SortOptions& options = SortOptions());
+
+// Sorts several inputs into one output. Inputs already sorted in the key
+// order (checked by sampling) skip run generation and join the merge as
+// runs; the merge checks them fully as it reads them, and one that turns
+// out unsorted sends the sort back to run generation for it. The inputs
+// are left in place. Checkpointing is not supported.
+bool externalMergeSortFiles(const std::vector<std::string>& inputFiles, const std::string& outputFile,
+                            size_t memLimit, int k_way, const SortOptions& options = SortOptions());
+
+// Runs of one input sorted up to their last merge pass, for callers that
+// run that pass themselves (relational_ops.hpp). The runs hold keys
+// normalized by options.keySpec; the caller deletes them.
+struct SortedRuns {
+    std::vector<std::string> paths;
+    uint64_t records = 0;
+};
+
+// Run generation and every merge pass but the last: stops once at most
+// maxRuns runs are left (at least one, possibly empty). Temp files are
+// named with options.tmpPrefix; checkpointing is not supported. Unlike
+// externalMergeSort this leaves the memory governor and metrics to the
+// caller. Throws SortFailed if the input cannot be sorted.
+bool sortToRuns(const std::string& inputFile, size_t memLimit, int k_way, size_t maxRuns,
+                const SortOptions& options, SortedRuns& out);
+
+// The whole merge sort, for another engine that hands it part of its work
+// (the quick sort's fallback): unlike externalMergeSort it leaves the
+// memory governor and metrics to the caller. Temp files are named with
+// options.tmpPrefix; checkpointing is not supported. Returns the records
+// sorted; throws SortFailed if it cannot.
+uint64_t mergeSortFile(const std::string& inputFile, const std::string& outputFile, size_t memLimit, int k_way,
+                       const SortOptions& options);
+
+// I/O buffer size for a memory budget: 1 MB, less under tight limits.
+size_t bufferSizeFor(size_t memBytes);
+// Merge memory layout: one output buffer of outBufSize bytes plus, per
+// input, a read buffer and the kernel's MERGE_BYTES_PER_RUN. The largest
+// fan-in that fits memBytes (0 if not even a 2-way merge does), and the
+// read buffer size for a given fan-in.
+size_t mergeFanInFor(size_t memBytes, size_t outBufSize);
+size_t mergeReadBufferSize(size_t memBytes, size_t outBufSize, int fanIn);
@@ -0,0 +1,361 @@
+#include "incremental_merge.hpp"
+#include "external_merge_sort.hpp"
+#include "key_spec.hpp"
+#include "temp_dirs.hpp"
+#include "metrics.hpp"
+#include "logger.hpp"
+#include <iostream>
+#include <fstream>
+#include <memory>
+#include <functional>
+#include <algorithm>
+#include <cstdio>
+#include <sys/stat.h>
+
+// One input of the final merge: a run of the sorted delta (normalized
+// keys) or an already sorted file (records, normalized as they are read).
+struct MergeInput {
+    std::string path;
+    bool sortedFile;
+};
+
+static bool fileExists(const std::string& path) {
+    struct stat st;
+    return stat(path.c_str(), &st) == 0;
+}
+
+static uint64_t recordCount(const std::string& path) {
+    struct stat st;
+    return stat(path.c_str(), &st) == 0 ? static_cast<uint64_t>(st.st_size) / sizeof(int) : 0;
+}
+
+// The input's smallest key (its first record's); false if it is empty.
+static bool firstKey(const MergeInput& input, const KeySpec& keys, int& key) {
+    std::ifstream in(input.path, std::ios::binary);
+    int record = 0;
+    if (!in.read(reinterpret_cast<char*>(&record), sizeof(record))) return false;
+    key = input.sortedFile ? keys.encode(record) : record;
+    return true;
+}
+
+// Number of leading records of a sorted file with keys at most `key`,
+// found by binary search. When `key` is the smallest key of everything
+// else being merged, those records come out of the merge first and
+// unchanged.
+static uint64_t keptPrefix(const std::string& path, int key, const KeySpec& keys) {
+    std::ifstream in(path, std::ios::binary);
+    uint64_t lo = 0, hi = recordCount(path);
+    while (lo < hi) {
+        uint64_t mid = lo + (hi - lo) / 2;
+        int record = 0;
+        in.seekg(static_cast<std::streamoff>(mid * sizeof(int)));
+        if (!in.read(reinterpret_cast<char*>(&record), sizeof(record))) return 0;
+        if (keys.encode(record) <= key) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+static void removeRuns(const SortedRuns& runs) {
+    for (const std::string& path : runs.paths) {
+        if (remove(path.c_str()) != 0) LOG_DEBUG("Error deleting file: " << path);
+    }
+}
+
+// Merges `inputs` into outputFile in one pass within what the memory
+// governor has left. If `target` is an input's index, that input is
+// outputFile itself and is merged in place: its kept prefix is not
+// touched, its tail is copied aside and merged back from there. Returns
+// the records in the output.
+static uint64_t mergeInputs(std::vector<MergeInput> inputs, const std::string& outputFile, int target,
+                            const KeySpec& keys, TempDirs& tmp, bool& ok) {
+    // Any other input that is the output would be truncated while it is
+    // still being read.
+    for (size_t i = 0; i < inputs.size(); ++i) {
+        if (static_cast<int>(i) != target && sameFile(inputs[i].path, outputFile)) {
+            std::cerr << "Output " << outputFile << " is also input " << inputs[i].path
+                      << " but is not merged in place." << std::endl;
+            ok = false;
+            return 0;
+        }
+    }
+    uint64_t kept = 0;
+    std::string tailFile;
+    if (target >= 0) {
+        bool any = false;
+        int low = 0, key = 0;
+        for (size_t i = 0; i < inputs.size(); ++i) {
+            if (static_cast<int>(i) == target || !firstKey(inputs[i], keys, key)) continue;
+            low = any ? std::min(low, key) : key;
+            any = true;
+        }
+        const uint64_t total = recordCount(outputFile);
+        kept = any ? keptPrefix(outputFile, low, keys) : total;
+        std::cout << "In place: keeping " << kept << " of " << total << " records, rewriting "
+                  << total - kept << "." << std::endl;
+        metrics().count("records_kept_in_place", kept);
+        if (kept == total) {
+            inputs.erase(inputs.begin() + target);
+        } else {
+            tailFile = tmp.place("tail.bin");
+            BufferPool copyPool(2, bufferSizeFor(memory().available() / 2));
+            FileReader in(outputFile, copyPool.lease());
+            FileWriter out(tailFile, copyPool.lease(), tmp.statsFor(tailFile));
+            if (!in.isOpen() || !out.isOpen()) {
+                std::cerr << "Failed to copy the tail of " << outputFile << std::endl;
+                ok = false;
+                return 0;
+            }
+            in.skip(kept);
+            const int* block;
+            while (size_t n = in.nextBlock(block)) {
+                for (size_t i = 0; i < n; ++i) out.write(block[i]);
+            }
+            out.close();
+            in.close();
+            // The base is rewritten from `kept` on next, so an incomplete
+            // copy (e.g. a full disk) must stop the merge before that.
+            if (out.failed() || out.bytesWritten() != (total - kept) * sizeof(int)) {
+                std::cerr << "Failed to copy the tail of " << outputFile << "; it is left unchanged." << std::endl;
+                remove(tailFile.c_str());
+                ok = false;
+                return 0;
+            }
+            inputs[target].path = tailFile;
+        }
+    }
+
+    const int count = static_cast<int>(inputs.size());
+    const size_t memBytes = memory().available();
+    const size_t bufSize = bufferSizeFor(memBytes);
+    std::vector<size_t> poolSizes(count, mergeReadBufferSize(memBytes, bufSize, std::max(count, 2)));
+    poolSizes.push_back(bufSize);
+    BufferPool pool(poolSizes);
+    Buffer& outputBuf = pool.lease(bufSize);
+    std::unique_ptr<FileWriter> out = target >= 0
+        ? std::make_unique<FileWriter>(outputFile, outputBuf, kept * sizeof(int), tmp.statsFor(outputFile))
+        : std::make_unique<FileWriter>(outputFile, outputBuf, tmp.statsFor(outputFile));
+    if (!out->isOpen()) {
+        std::cerr << "Failed to open output file: " << outputFile << std::endl;
+        ok = false;
+        return 0;
+    }
+    if (!keys.identity()) out->setTransform(keys.decoder());
+
+    std::vector<std::unique_ptr<FileReader>> readers;
+    std::vector<FileReader*> open;
+    for (const MergeInput& input : inputs) {
+        readers.push_back(std::make_unique<FileReader>(input.path, pool.lease(), tmp.statsFor(input.path)));
+        if (input.sortedFile && !keys.identity()) readers.back()->setTransform(keys.encoder());
+        open.push_back(readers.back().get());
+    }
+    if (count > 0) mergeRuns(open.data(), count, *out);
+    out->close();
+    for (auto& reader : readers) reader->close();
+    if (out->failed()) {
+        // In place, the tail copy is kept: the base's old records are in it.
+        std::cerr << "Failed to write " << outputFile
+                  << (tailFile.empty() ? "" : "; its former tail is in " + tailFile) << std::endl;
+        ok = false;
+        return 0;
+    }
+    if (!tailFile.empty()) remove(tailFile.c_str());
+    return kept + out->bytesWritten() / sizeof(int);
+}
+
+// Final fan-in for memLimit (the requested K if that is smaller).
+static size_t mergeFanIn(size_t memLimit, int k_way) {
+    size_t fit = mergeFanInFor(memLimit, bufferSizeFor(memLimit));
+    return k_way > 1 ? std::min(fit, static_cast<size_t>(k_way)) : fit;
+}
+
+static uint64_t mergeIntoBase(const std::string& deltaFile, const std::string& baseFile, const std::string& outputFile,
+                              size_t memLimit, int k_way, const SortOptions& options, bool& ok) {
+    std::cout << "=== Incremental Merge ===" << std::endl;
+    std::cout << "Delta file: " << deltaFile << std::endl;
+    std::cout << "Base file: " << baseFile << std::endl;
+    const KeySpec keys = options.keySpec.empty() ? KeySpec() : KeySpec::parse(options.keySpec);
+    if (isStdStream(baseFile)) {
+        std::cerr << "The base must be a file, not a stream." << std::endl;
+        ok = false;
+        return 0;
+    }
+    const bool hasBase = fileExists(baseFile);
+    if (!hasBase) std::cout << "Base file does not exist yet; starting empty." << std::endl;
+
+    size_t fanIn = mergeFanIn(memLimit, k_way);
+    if (fanIn < 2) {
+        std::cerr << "Memory limit too small: " << memLimit << " bytes cannot hold a 2-way merge." << std::endl;
+        ok = false;
+        return 0;
+    }
+    SortOptions sortOptions = options;
+    sortOptions.tmpPrefix = "delta_";
+    SortedRuns runs;
+    if (!sortToRuns(deltaFile, memLimit, k_way, fanIn - (hasBase ? 1 : 0), sortOptions, runs)) {
+        ok = false;
+        return 0;
+    }
+
+    PhaseTimer mergePhase("incremental_merge");
+    std::vector<MergeInput> inputs;
+    for (const std::string& path : runs.paths) inputs.push_back({path, false});
+    int target = -1;
+    if (hasBase) {
+        if (sameFile(outputFile, baseFile)) target = static_cast<int>(inputs.size());
+        inputs.push_back({baseFile, true});
+    }
+    TempDirs tmp(options.tmpDirs, TempDirs::parsePolicy(options.tmpPolicy), "delta_");
+    uint64_t records = mergeInputs(inputs, outputFile, target, keys, tmp, ok);
+    removeRuns(runs);
+    mergePhase.addRecords(records);
+    if (ok) {
+        std::cout << "Merged " << runs.records << " new records; " << outputFile << " holds " << records
+                  << " records." << std::endl;
+    }
+    tmp.report(std::cout);
+    tmp.recordMetrics();
+    return records;
+}
+
+static std::string levelPath(const std::string& store, size_t level) {
+    return store + "." + std::to_string(level);
+}
+
+static bool renameLevel(const std::string& from, const std::string& to) {
+    if (from == to || std::rename(from.c_str(), to.c_str()) == 0) return true;
+    std::cerr << "Failed to rename " << from << " to " << to << std::endl;
+    return false;
+}
+
+static uint64_t appendToLevels(const std::string& deltaFile, const std::string& store, double ratio,
+                               size_t memLimit, int k_way, const SortOptions& options, bool& ok) {
+    std::cout << "=== Tiered Append ===" << std::endl;
+    std::cout << "Delta file: " << deltaFile << std::endl;
+    const KeySpec keys = options.keySpec.empty() ? KeySpec() : KeySpec::parse(options.keySpec);
+    std::vector<std::string> levels;
+    while (fileExists(levelPath(store, levels.size()))) levels.push_back(levelPath(store, levels.size()));
+    std::cout << "Store: " << store << " (" << levels.size() << " levels)" << std::endl;
+
+    size_t fanIn = mergeFanIn(memLimit, k_way);
+    if (fanIn < 2) {
+        std::cerr << "Memory limit too small: " << memLimit << " bytes cannot hold a 2-way merge." << std::endl;
+        ok = false;
+        return 0;
+    }
+    // Half the final fan-in is left for the levels the delta may pick up.
+    SortOptions sortOptions = options;
+    sortOptions.tmpPrefix = "delta_";
+    SortedRuns runs;
+    if (!sortToRuns(deltaFile, memLimit, k_way, std::max<size_t>(1, fanIn / 2), sortOptions, runs)) {
+        ok = false;
+        return 0;
+    }
+    if (runs.records == 0) {
+        removeRuns(runs);
+        std::cout << "Empty delta; levels unchanged." << std::endl;
+        return 0;
+    }
+
+    // Take levels smallest first while each is within `ratio` times what
+    // has been gathered so far.
+    uint64_t gathered = runs.records;
+    size_t chosen = 0;
+    while (chosen < levels.size() && runs.paths.size() + chosen < fanIn
+           && static_cast<double>(recordCount(levels[chosen])) <= ratio * static_cast<double>(gathered)) {
+        gathered += recordCount(levels[chosen]);
+        chosen++;
+    }
+    std::cout << "Compacting the delta with " << chosen << " of " << levels.size() << " levels." << std::endl;
+    metrics().count("levels_compacted", chosen);
+
+    PhaseTimer mergePhase("incremental_merge");
+    std::vector<MergeInput> inputs;
+    for (const std::string& path : runs.paths) inputs.push_back({path, false});
+    for (size_t i = 0; i < chosen; ++i) inputs.push_back({levels[i], true});
+    // The largest level taken is rewritten in place; with none taken the
+    // delta becomes a new level.
+    const std::string merged = chosen > 0 ? levels[chosen - 1] : store + ".new";
+    const int target = chosen > 0 ? static_cast<int>(inputs.size()) - 1 : -1;
+    TempDirs tmp(options.tmpDirs, TempDirs::parsePolicy(options.tmpPolicy), "delta_");
+    uint64_t records = mergeInputs(inputs, merged, target, keys, tmp, ok);
+    removeRuns(runs);
+    mergePhase.addRecords(records);
+    if (!ok) return records;
+
+    // Renumber: the merged level becomes level 0, the untouched ones follow.
+    for (size_t i = 0; i + 1 < chosen; ++i) remove(levels[i].c_str());
+    if (chosen == 0) {
+        for (size_t i = levels.size(); i-- > 0;) ok = renameLevel(levels[i], levelPath(store, i + 1)) && ok;
+        ok = renameLevel(merged, levelPath(store, 0)) && ok;
+    } else {
+        ok = renameLevel(merged, levelPath(store, 0)) && ok;
+        for (size_t i = chosen; i < levels.size(); ++i) {
+            ok = renameLevel(levels[i], levelPath(store, i - chosen + 1)) && ok;
+        }
+    }
+    const size_t count = levels.size() - chosen + 1;
+    std::cout << "Levels:";
+    for (size_t i = 0; i < count; ++i) {
+        std::cout << " " << levelPath(store, i) << " (" << recordCount(levelPath(store, i)) << ")";
+    }
+    std::cout << std::endl;
+    metrics().count("levels", count);
+    tmp.report(std::cout);
+    tmp.recordMetrics();
+    return records;
+}
+
+// Metrics, memory governor and error handling around one operation, as
+// externalMergeSort does for a whole sort.
+static bool runIncremental(const std::string& engine, const std::string& input, const std::string& output,
+                           size_t memLimit, const SortOptions& options,
+                           const std::function<uint64_t(bool&)>& body) {
+    metrics().reset(options.metricsOut);
+    metrics().set("engine", engine);
+    metrics().set("input", input);
+    metrics().set("output", output);
+    metrics().set("mem_limit", std::to_string(memLimit));
+    memory().reset(memLimit);
+    bool ok = true;
+    try {
+        PhaseTimer total("total");
+        total.addRecords(body(ok));
+    } catch (const MemoryLimitExceeded& e) {
+        std::cerr << "Memory limit exceeded: " << e.what() << std::endl;
+        ok = false;
+    } catch (const std::invalid_argument& e) {
+        std::cerr << e.what() << std::endl;
+        ok = false;
+    } catch (const SortFailed& e) {
+        std::cerr << e.what() << std::endl;
+        ok = false;
+    }
+    reportMemory(std::cout);
+    if (!metrics().write()) {
+        std::cerr << "Failed to write metrics to " << options.metricsOut << std::endl;
+    }
+    return ok;
+}
+
+bool incrementalMerge(const std::string& deltaFile, const std::string& baseFile, const std::string& outputFile,
+                      size_t memLimit, int k_way, const SortOptions& options) {
+    return runIncremental("incremental_merge", deltaFile + "," + baseFile, outputFile, memLimit, options,
+                          [&](bool& ok) {
+                              return mergeIntoBase(deltaFile, baseFile, outputFile, memLimit, k_way, options, ok);
+                          });
+}
+
+bool tieredAppend(const std::string& deltaFile, const std::string& store, double ratio,
+                  size_t memLimit, int k_way, const SortOptions& options) {
+    if (ratio < 1) {
+        std::cerr << "The tier ratio must be at least 1." << std::endl;
+        return false;
+    }
+    return runIncremental("tiered_append", deltaFile, store, memLimit, options, [&](bool& ok) {
+        return appendToLevels(deltaFile, store, ratio, memLimit, k_way, options, ok);
+    });
+}
@@ -0,0 +1,26 @@
+#pragma once
+#include "sort_options.hpp"
+#include <string>
+
+// Incremental sorting: new records (the delta) are sorted with the merge
+// sort engine up to its last pass, and that pass merges them with data
+// that is already sorted instead of re-sorting everything. Records are in
+// options.keySpec order; checkpointing and --index are not supported.
+
+// Merges the sorted baseFile with deltaFile into outputFile in one
+// sequential pass. When outputFile is baseFile the merge happens in place:
+// the base's records that sort before every delta record stay where they
+// are and only the tail after them is rewritten (for appends that mostly
+// land at the end, a small fraction of the file). A missing base is empty.
+bool incrementalMerge(const std::string& deltaFile, const std::string& baseFile, const std::string& outputFile,
+                      size_t memLimit, int k_way, const SortOptions& options);
+
+// LSM-style tiering over a set of sorted level files store.0, store.1, ...
+// (smallest, newest first). The sorted delta is merged with the smallest
+// levels only while each next level holds at most `ratio` times the
+// records gathered so far; larger levels are left alone. The result
+// becomes store.0 and the untouched levels are renumbered after it, so
+// every level stays more than `ratio` times larger than the ones before
+// it. ratio must be at least 1.
+bool tieredAppend(const std::string& deltaFile, const std::string& store, double ratio,
+                  size_t memLimit, int k_way, const SortOptions& options);
@@ -2,37 +2,210 @@
 #include "logger.hpp"
 #include <iostream>
 #include <sstream>
+#include <cstdio>
+#include <algorithm>
+#include <stdexcept>
+#include <chrono>
+#include <mutex>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+bool isStdStream(const std::string& filename) {
+    return filename == "-";
+}
+
+// std::ifstream/std::ofstream cannot adopt an existing descriptor, so the
+// standard streams are reopened through their /dev aliases.
+static std::string openPath(const std::string& filename, bool forWriting) {
+    if (isStdStream(filename)) {
+        return forWriting ? "/dev/stdout" : "/dev/stdin";
+    }
+    return filename;
+}
+
+bool sameFile(const std::string& a, const std::string& b) {
+    struct stat sa, sb;
+    return stat(a.c_str(), &sa) == 0 && stat(b.c_str(), &sb) == 0 && sa.st_dev == sb.st_dev && sa.st_ino == sb.st_ino;
+}
+
+bool moveOrCopyFile(const std::string& src, const std::string& dst) {
+    if (!isStdStream(dst) && rename(src.c_str(), dst.c_str()) == 0) {
+        return true;
+    }
+
+    std::ifstream in(src, std::ios::binary);
+    std::ofstream out(openPath(dst, true), std::ios::binary | std::ios::trunc);
+    if (!in || !out) {
+        std::stringstream ss;
+        ss << "Error copying " << src << " to " << dst;
+        LOG_DEBUG(ss.str());
+        return false;
+    }
+    std::vector<char> block(1 << 20);
+    while (in.read(block.data(), block.size()) || in.gcount() > 0) {
+        out.write(block.data(), in.gcount());
+    }
+    out.close();
+    in.close();
+    remove(src.c_str());
+    return static_cast<bool>(out);
+}
+
+size_t parseByteSize(const std::string& text) {
+    size_t idx = 0;
+    unsigned long long value;
+    try {
+        value = std::stoull(text, &idx);
+    } catch (const std::out_of_range&) {
+        throw std::invalid_argument("size out of range: " + text);
+    }
+    std::string suffix = text.substr(idx);
+    if (suffix.empty() || suffix == "B") return value;
+    if (suffix == "K" || suffix == "KB") return value << 10;
+    if (suffix == "M" || suffix == "MB") return value << 20;
+    if (suffix == "G" || suffix == "GB") return value << 30;
+    throw std::invalid_argument("unknown size suffix: " + suffix);
+}
+
+uint64_t checksumUpdate(uint64_t hash, const int* data, size_t count) {
+    // FNV-1a over 32-bit words: cheap enough to run on every flush.
+    for (size_t i = 0; i < count; ++i) {
+        hash ^= static_cast<uint32_t>(data[i]);
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+bool fileChecksum(const std::string& filename, uint64_t& bytes, uint64_t& checksum) {
+    std::ifstream in(filename, std::ios::binary);
+    if (!in) return false;
+    std::vector<int> block(1 << 18);
+    bytes = 0;
+    checksum = CHECKSUM_SEED;
+    while (in.read(reinterpret_cast<char*>(block.data()), block.size() * sizeof(int)) || in.gcount() > 0) {
+        checksum = checksumUpdate(checksum, block.data(), in.gcount() / sizeof(int));
+        bytes += in.gcount();
+    }
+    return true;
+}
 
 // Buffer implementation
-Buffer::Buffer(size_t size_in_bytes) : capacity(size_in_bytes / sizeof(int)), data() {
-    data.reserve(capacity);
+Buffer::Buffer(size_t size_in_bytes)
+    : data(nullptr), count(0), max_elems(size_in_bytes / sizeof(int)), owned(true) {
+    // Uninitialized storage: readers and writers fill it before use.
+    data = TrackedAllocator<int>().allocate(max_elems);
+}
+
+Buffer::Buffer(int* storage, size_t size_in_bytes)
+    : data(storage), count(0), max_elems(size_in_bytes / sizeof(int)), owned(false) {}
+
+Buffer::~Buffer() {
+    if (owned) TrackedAllocator<int>().deallocate(data, max_elems);
 }
 
-bool Buffer::isFull() const {
-    return data.size() >= capacity;
+// BufferPool implementation
+static const size_t POOL_PAGE_BYTES = 4096;
+static const size_t POOL_HUGE_PAGE_BYTES = 2 << 20;
+
+size_t BufferPool::roundedSize(size_t bytes) {
+    return (std::max(bytes, sizeof(int)) + POOL_PAGE_BYTES - 1) / POOL_PAGE_BYTES * POOL_PAGE_BYTES;
 }
 
-void Buffer::add(int value) {
-    if (!isFull()) {
-        data.push_back(value);
+BufferPool::BufferPool(const std::vector<size_t>& sizes) : slab(nullptr), slabBytes(0), mappedBytes(0), mapping(nullptr) {
+    for (size_t bytes : sizes) slabBytes += roundedSize(bytes);
+    memory().acquire(slabBytes);
+    // Over-map by a huge page so the slab can start on a 2 MB boundary,
+    // which lets transparent huge pages back it.
+    bool huge = slabBytes >= POOL_HUGE_PAGE_BYTES;
+    mappedBytes = slabBytes + (huge ? POOL_HUGE_PAGE_BYTES : 0);
+    void* p = mmap(nullptr, mappedBytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (p == MAP_FAILED) {
+        memory().release(slabBytes);
+        throw std::bad_alloc();
+    }
+    mapping = static_cast<char*>(p);
+    slab = mapping;
+    if (huge) {
+        uintptr_t addr = reinterpret_cast<uintptr_t>(mapping);
+        slab = reinterpret_cast<char*>((addr + POOL_HUGE_PAGE_BYTES - 1) & ~(POOL_HUGE_PAGE_BYTES - 1));
+        madvise(slab, slabBytes, MADV_HUGEPAGE);
+    }
+    // Touch every page now so the sort itself never faults on a buffer.
+    for (size_t off = 0; off < slabBytes; off += POOL_PAGE_BYTES) slab[off] = 0;
+
+    char* next = slab;
+    for (size_t bytes : sizes) {
+        buffers.push_back(std::make_unique<Buffer>(reinterpret_cast<int*>(next), bytes));
+        inUse.push_back(false);
+        next += roundedSize(bytes);
     }
 }
 
-void Buffer::clear() {
-    data.clear();
+BufferPool::~BufferPool() {
+    buffers.clear();
+    munmap(mapping, mappedBytes);
+    memory().release(slabBytes);
 }
 
-size_t Buffer::size() const {
-    return data.size();
+Buffer& BufferPool::lease(size_t minBytes) {
+    size_t best = buffers.size();
+    for (size_t i = 0; i < buffers.size(); ++i) {
+        if (inUse[i] || buffers[i]->capacity() * sizeof(int) < minBytes) continue;
+        if (best == buffers.size() || buffers[i]->capacity() < buffers[best]->capacity()) best = i;
+    }
+    if (best == buffers.size()) throw std::runtime_error("buffer pool exhausted");
+    inUse[best] = true;
+    buffers[best]->clear();
+    return *buffers[best];
 }
 
-const std::vector<int>& Buffer::getData() const {
-    return data;
+void BufferPool::release(Buffer& buffer) {
+    for (size_t i = 0; i < buffers.size(); ++i) {
+        if (buffers[i].get() == &buffer) inUse[i] = false;
+    }
+}
+
+static IoStats processTotals;
+// Parallel run generation shares the totals and the per-device counters.
+static std::mutex ioStatsLock;
+
+const IoStats& processIoStats() {
+    return processTotals;
+}
+
+static void recordRead(IoStats* stats, uint64_t bytes, double seconds) {
+    std::lock_guard<std::mutex> guard(ioStatsLock);
+    for (IoStats* s : {&processTotals, stats}) {
+        if (!s) continue;
+        s->read_seconds += seconds;
+        s->bytes_read += bytes;
+        s->read_calls++;
+    }
+}
+
+static void recordWrite(IoStats* stats, uint64_t bytes, double seconds) {
+    std::lock_guard<std::mutex> guard(ioStatsLock);
+    for (IoStats* s : {&processTotals, stats}) {
+        if (!s) continue;
+        s->write_seconds += seconds;
+        s->bytes_written += bytes;
+        s->write_calls++;
+    }
 }
 
 // FileReader implementation
-FileReader::FileReader(const std::string& filename, Buffer& buffer) : buffer(buffer), current_pos(0) {
-    file.open(filename, std::ios::binary);
+FileReader::FileReader(const std::string& filename, Buffer& buffer, IoStats* stats) : FileReader(buffer) {
+    open(filename, stats);
+}
+
+FileReader::FileReader(Buffer& buffer) : buffer(buffer), current_pos(0), remaining(UINT64_MAX), stats(nullptr) {}
+
+void FileReader::open(const std::string& filename, IoStats* stats) {
+    close();
+    file.clear();
+    this->stats = stats;
+    remaining = UINT64_MAX;
+    file.open(openPath(filename, false), std::ios::binary);
     if (!file.is_open()) {
         std::stringstream ss;
         ss << "Error opening file for reading: " << filename;
@@ -46,7 +219,10 @@ FileReader::~FileReader() {
 }
 
 bool FileReader::hasNext() {
-    return current_pos < buffer.size() || !file.eof();
+    if (current_pos >= buffer.size() && remaining > 0 && file.is_open() && !file.eof()) {
+        fillBuffer();
+    }
+    return current_pos < buffer.size();
 }
 
 int FileReader::next() {
@@ -54,19 +230,37 @@ int FileReader::next() {
         fillBuffer();
     }
     if (current_pos < buffer.size()) {
-        return buffer.getData()[current_pos++];
+        return buffer.raw()[current_pos++];
     }
     return -1; // Should not happen if hasNext() is checked
 }
 
+size_t FileReader::nextBlock(const int*& records) {
+    if (!hasNext()) return 0;
+    records = buffer.raw() + current_pos;
+    size_t count = buffer.size() - current_pos;
+    current_pos = buffer.size();
+    return count;
+}
+
 void FileReader::fillBuffer() {
-    buffer.clear();
+    // One block read per refill. istream::read keeps pulling from a pipe
+    // until the block is full or the writer closes, so a short block only
+    // ever means end of input.
     current_pos = 0;
-    // Read integers from the file into the buffer
-    int val;
-    while (buffer.size() < buffer.getData().capacity() && file.read(reinterpret_cast<char*>(&val), sizeof(int))) {
-        buffer.add(val);
-    }
+    buffer.resize(buffer.capacity());
+    auto start = std::chrono::steady_clock::now();
+    size_t want = static_cast<size_t>(std::min<uint64_t>(buffer.capacity(), remaining));
+    file.read(reinterpret_cast<char*>(buffer.raw()), want * sizeof(int));
+    buffer.resize(file.gcount() / sizeof(int));
+    remaining -= buffer.size();
+    if (transform) transform(buffer.raw(), buffer.size());
+    recordRead(stats, file.gcount(), std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+}
+
+void FileReader::setTransform(BlockTransform t) {
+    transform = std::move(t);
+    if (transform && current_pos < buffer.size()) transform(buffer.raw() + current_pos, buffer.size() - current_pos);
 }
 
 void FileReader::close() {
@@ -75,31 +269,91 @@ void FileReader::close() {
     }
 }
 
+bool FileReader::isOpen() const {
+    return file.is_open();
+}
+
+void FileReader::limit(uint64_t count) {
+    uint64_t buffered = buffer.size() - current_pos;
+    if (count <= buffered) {
+        buffer.resize(current_pos + count);
+        remaining = 0;
+    } else {
+        remaining = count - buffered;
+    }
+}
+
+void FileReader::skip(uint64_t count) {
+    uint64_t buffered = buffer.size() - current_pos;
+    if (count <= buffered) {
+        current_pos += count;
+        return;
+    }
+    count -= buffered;
+    current_pos = buffer.size();
+    file.clear();
+    if (file.seekg(static_cast<std::streamoff>(count * sizeof(int)), std::ios::cur)) {
+        fillBuffer();
+        return;
+    }
+    file.clear();
+    while (count > 0 && hasNext()) {
+        uint64_t step = std::min<uint64_t>(count, buffer.size() - current_pos);
+        current_pos += step;
+        count -= step;
+    }
+}
+
 // FileWriter implementation
-FileWriter::FileWriter(const std::string& filename, Buffer& buffer) : buffer(buffer), current_filename(filename) {
-    file.open(filename, std::ios::binary | std::ios::trunc);
+FileWriter::FileWriter(const std::string& filename, Buffer& buffer, IoStats* stats)
+    : buffer(buffer), current_filename(filename), bytes_written(0), running_checksum(CHECKSUM_SEED), stats(stats) {
+    // Buffers are shared between readers and writers; never emit leftovers.
+    buffer.clear();
+    file.open(openPath(filename, true), std::ios::binary | std::ios::trunc);
     if (!file.is_open()) {
+        write_failed = true;
         std::stringstream ss;
         ss << "Error opening file for writing: " << filename;
         LOG_DEBUG(ss.str());
     }
 }
 
-FileWriter::~FileWriter() {
-    close();
+FileWriter::FileWriter(const std::string& filename, Buffer& buffer, uint64_t offset, IoStats* stats)
+    : buffer(buffer), current_filename(filename), bytes_written(0), running_checksum(CHECKSUM_SEED), stats(stats) {
+    buffer.clear();
+    file.open(filename, std::ios::binary | std::ios::in | std::ios::out);
+    if (file.is_open() && !file.seekp(static_cast<std::streamoff>(offset))) file.close();
+    if (!file.is_open()) {
+        write_failed = true;
+        LOG_DEBUG("Error opening file for writing at offset " << offset << ": " << filename);
+    }
 }
 
-void FileWriter::write(int value) {
-    if (buffer.isFull()) {
-        flush();
-    }
-    buffer.add(value);
+FileWriter::FileWriter(Buffer& buffer, BlockSink sink)
+    : buffer(buffer), bytes_written(0), running_checksum(CHECKSUM_SEED), stats(nullptr), sink(std::move(sink)) {
+    buffer.clear();
+}
+
+FileWriter::~FileWriter() {
+    close();
 }
 
 void FileWriter::flush() {
-    const std::vector<int>& data = buffer.getData();
-    if (!data.empty()) {
-        file.write(reinterpret_cast<const char*>(data.data()), data.size() * sizeof(int));
+    const Buffer& data = buffer;
+    if (data.size() > 0) {
+        if (transform) transform(buffer.raw(), data.size());
+        if (observer) observer(data.raw(), data.size());
+        if (sink) {
+            sink(data.raw(), data.size());
+        } else {
+            auto start = std::chrono::steady_clock::now();
+            file.write(reinterpret_cast<const char*>(data.raw()), data.size() * sizeof(int));
+            if (!file) write_failed = true;
+            recordWrite(stats, data.size() * sizeof(int),
+                        std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+        }
+        running_checksum = checksumUpdate(running_checksum, data.raw(), data.size());
+        bytes_written += data.size() * sizeof(int);
     }
     buffer.clear();
 }
@@ -108,11 +362,19 @@ void FileWriter::close() {
     if (file.is_open()) {
         flush();
         file.close();
+        if (!file) write_failed = true;
+    } else if (sink) {
+        flush();
+        sink = nullptr;
     }
 }
 
 bool FileWriter::isOpen() const {
-    return file.is_open();
+    return file.is_open() || sink;
+}
+
+bool FileWriter::failed() const {
+    return write_failed;
 }
 
 std::string FileWriter::fileName() const {
@@ -122,3 +384,19 @@ std::string FileWriter::fileName() const {
 bool FileWriter::bufferFull() const {
     return buffer.isFull();
 }
+
+uint64_t FileWriter::bytesWritten() const {
+    return bytes_written;
+}
+
+uint64_t FileWriter::checksum() const {
+    return running_checksum;
+}
+
+void FileWriter::setTransform(BlockTransform t) {
+    transform = std::move(t);
+}
+
+void FileWriter::setObserver(BlockSink o) {
+    observer = std::move(o);
+}
@@ -1,51 +1,223 @@
 #pragma once
 
+#include "memory_governor.hpp"
 #include <string>
 #include <vector>
 #include <fstream>
+#include <cstdint>
+#include <memory>
+#include <algorithm>
+#include <functional>
+#include <stdexcept>
 
+// Thrown when a sort cannot go on: an input that does not open, an output
+// that cannot be written, a memory limit too small for the algorithm. The
+// entry points report it and return false.
+class SortFailed : public std::runtime_error {
+public:
+    explicit SortFailed(const std::string& what) : std::runtime_error(what) {}
+};
+
+// "-" names stdin (for readers) or stdout (for writers), so the
+// executables can sit in the middle of a shell pipeline.
+bool isStdStream(const std::string& filename);
+
+// True if both paths name the same existing file (by device and inode,
+// so "./b.bin" and "b.bin" match).
+bool sameFile(const std::string& a, const std::string& b);
+
+// Moves src to dst. Falls back to a buffered copy when a rename is not
+// possible (dst is stdout, or src and dst live on different filesystems).
+bool moveOrCopyFile(const std::string& src, const std::string& dst);
+
+// Parses a byte count with an optional K/M/G suffix (powers of 1024), e.g.
+// "16777216", "16M" or "1G". Throws std::invalid_argument on bad input.
+size_t parseByteSize(const std::string& text);
+
+// Running checksum over a stream of records. Writers fold in every record
+// they emit so a file's checksum is known the moment it is closed.
+uint64_t checksumUpdate(uint64_t hash, const int* data, size_t count);
+const uint64_t CHECKSUM_SEED = 14695981039346656037ULL;
+
+// Size and checksum of an existing file; false if it cannot be read.
+bool fileChecksum(const std::string& filename, uint64_t& bytes, uint64_t& checksum);
+
+// Byte, call and time counters for one I/O target (e.g. a temp device).
+struct IoStats {
+    uint64_t bytes_read = 0, bytes_written = 0;
+    uint64_t read_calls = 0, write_calls = 0;
+    double read_seconds = 0, write_seconds = 0;
+};
+
+// Totals over every FileReader/FileWriter in the process.
+const IoStats& processIoStats();
+
+// Record buffer; its storage counts against the memory governor. A buffer
+// either owns its storage or borrows a slice of a BufferPool slab.
 class Buffer {
 public:
     explicit Buffer(size_t size_in_bytes);
-    bool isFull() const;
-    void add(int value);
-    void clear();
-    size_t size() const;
-    const std::vector<int>& getData() const;
+    Buffer(int* storage, size_t size_in_bytes);
+    ~Buffer();
+    Buffer(const Buffer&) = delete;
+    Buffer& operator=(const Buffer&) = delete;
+
+    bool isFull() const { return count >= max_elems; }
+    void add(int value) {
+        if (!isFull()) data[count++] = value;
+    }
+    void clear() { count = 0; }
+    size_t size() const { return count; }
+    size_t capacity() const { return max_elems; }
+    const int* raw() const { return data; }
+    int* raw() { return data; }
+    // Sets the number of valid records (after reading into raw()).
+    void resize(size_t n) { count = std::min(n, max_elems); }
 
 private:
-    std::vector<int> data;
-    size_t capacity;
+    int* data;
+    size_t count;
+    size_t max_elems;
+    bool owned;
 };
 
+// Buffers carved once from a single slab, so merge passes and recursion
+// nodes reuse the same memory instead of allocating and faulting in fresh
+// buffers for every group. The slab is page-aligned, pre-faulted,
+// advised for transparent huge pages, and charged to the memory governor.
+class BufferPool {
+public:
+    BufferPool(const std::vector<size_t>& sizes);
+    BufferPool(size_t count, size_t bytesEach) : BufferPool(std::vector<size_t>(count, bytesEach)) {}
+    ~BufferPool();
+    BufferPool(const BufferPool&) = delete;
+    BufferPool& operator=(const BufferPool&) = delete;
+
+    // Smallest free buffer with at least minBytes of room; throws
+    // std::runtime_error if none is free.
+    Buffer& lease(size_t minBytes = 0);
+    void release(Buffer& buffer);
+
+    // Bytes rounded up so every buffer starts on a page boundary.
+    static size_t roundedSize(size_t bytes);
+
+    // Returns its buffer to the pool when it goes out of scope.
+    class Lease {
+    public:
+        explicit Lease(BufferPool& pool, size_t minBytes = 0) : pool(pool), buffer(pool.lease(minBytes)) {}
+        ~Lease() { pool.release(buffer); }
+        Lease(const Lease&) = delete;
+        Lease& operator=(const Lease&) = delete;
+        Buffer& operator*() { return buffer; }
+        Buffer* operator->() { return &buffer; }
+
+    private:
+        BufferPool& pool;
+        Buffer& buffer;
+    };
+
+private:
+    char* slab;
+    size_t slabBytes;
+    size_t mappedBytes;
+    char* mapping;
+    std::vector<std::unique_ptr<Buffer>> buffers;
+    std::vector<bool> inUse;
+};
+
+// In-place rewrite of a block of records as it is read or written (e.g.
+// key normalization, see key_spec.hpp). Empty means none.
+using BlockTransform = std::function<void(int* records, size_t count)>;
+
+// Consumer of a writer's output blocks in place of a file.
+using BlockSink = std::function<void(const int* records, size_t count)>;
+
 class FileReader {
 public:
-    FileReader(const std::string& filename, Buffer& buffer);
+    FileReader(const std::string& filename, Buffer& buffer, IoStats* stats = nullptr);
+    // Unopened reader; open() attaches it to a file, and may be called
+    // again after close() to reuse the reader and its buffer.
+    explicit FileReader(Buffer& buffer);
     ~FileReader();
+    void open(const std::string& filename, IoStats* stats = nullptr);
     bool hasNext();
     int next();
+    // Hands out every buffered record at once (refilling first if none are
+    // left) and consumes them; 0 at end of input. For loops that would
+    // otherwise pay a hasNext()/next() call per record.
+    size_t nextBlock(const int*& records);
     void close();
+    bool isOpen() const;
+    // Skips `count` records; seeks on regular files, reads through pipes.
+    void skip(uint64_t count);
+    // Ends the input after `count` more records (e.g. one slice of a run
+    // after skip()). Cleared by open().
+    void limit(uint64_t count);
+    // Applies `transform` to every record from here on, starting with the
+    // ones already buffered. Kept across open().
+    void setTransform(BlockTransform transform);
 
 private:
     void fillBuffer();
     std::ifstream file;
     Buffer& buffer;
     size_t current_pos;
+    uint64_t remaining; // records left to read from the file
+    IoStats* stats;
+    BlockTransform transform;
 };
 
 class FileWriter {
 public:
-    FileWriter(const std::string& filename, Buffer& buffer);
+    FileWriter(const std::string& filename, Buffer& buffer, IoStats* stats = nullptr);
+    // Hands every flushed block to `sink` instead of writing a file, so
+    // code that produces into a FileWriter (the merge kernels) can feed an
+    // operator directly.
+    FileWriter(Buffer& buffer, BlockSink sink);
+    // Overwrites an existing file from byte `offset` on, keeping what lies
+    // before it (the file is not truncated). bytesWritten() and checksum()
+    // cover only what this writer wrote.
+    FileWriter(const std::string& filename, Buffer& buffer, uint64_t offset, IoStats* stats = nullptr);
     ~FileWriter();
-    void write(int value);
+    void write(int value) {
+        if (buffer.isFull()) flush();
+        buffer.add(value);
+    }
     void flush();
+    // Bulk producers write straight into the buffer: reserve() returns its
+    // free space (flushing first if it is full) and commit(n) accounts for
+    // the n records placed there.
+    int* reserve(size_t& room) {
+        if (buffer.isFull()) flush();
+        room = buffer.capacity() - buffer.size();
+        return buffer.raw() + buffer.size();
+    }
+    void commit(size_t n) { buffer.resize(buffer.size() + n); }
     void close();
     bool isOpen() const;
+    // True once the file failed to open or a write or the close failed
+    // (e.g. a full disk); what was written since then is incomplete.
+    bool failed() const;
     std::string fileName() const;
     bool bufferFull() const;
+    uint64_t bytesWritten() const;
+    uint64_t checksum() const;
+    // Applies `transform` to each block just before it is written; the
+    // checksum covers the bytes as they land in the file.
+    void setTransform(BlockTransform transform);
+    // Shows `observer` each block as it is written, after the transform
+    // (e.g. to build a sparse index of the output).
+    void setObserver(BlockSink observer);
 
 private:
     std::ofstream file;
     Buffer& buffer;
     std::string current_filename;
+    uint64_t bytes_written;
+    uint64_t running_checksum;
+    IoStats* stats;
+    bool write_failed = false;
+    BlockTransform transform;
+    BlockSink sink;
+    BlockSink observer;
 };
@@ -0,0 +1,103 @@
+#include "key_spec.hpp"
+#include <sstream>
+#include <stdexcept>
+
+// Keys are compared as signed ints, so the unsigned byte-wise order is
+// shifted by flipping the key's top bit.
+static const uint32_t INT_BIAS = 0x80000000u;
+
+KeyColumn KeyColumn::parse(const std::string& field) {
+    std::stringstream parts(field);
+    std::string offset, type, order = "asc";
+    std::getline(parts, offset, ':');
+    std::getline(parts, type, ':');
+    if (parts.good()) std::getline(parts, order);
+    KeyColumn c;
+    try {
+        size_t used = 0;
+        c.offset = std::stoi(offset, &used);
+        if (used != offset.size()) throw std::invalid_argument(offset);
+    } catch (const std::exception&) {
+        throw std::invalid_argument("Invalid key column '" + field + "': bad byte offset");
+    }
+    if (type.size() < 2 || (type[0] != 'i' && type[0] != 'u')
+        || (type.substr(1) != "8" && type.substr(1) != "16" && type.substr(1) != "32")) {
+        throw std::invalid_argument("Invalid key column '" + field + "': type must be i8, u8, i16, u16, i32 or u32");
+    }
+    c.isSigned = type[0] == 'i';
+    c.width = std::stoi(type.substr(1)) / 8;
+    if (order != "asc" && order != "desc") {
+        throw std::invalid_argument("Invalid key column '" + field + "': order must be asc or desc");
+    }
+    c.descending = order == "desc";
+    if (c.offset < 0 || c.offset + c.width > 4) {
+        throw std::invalid_argument("Invalid key column '" + field + "': does not fit in a 4-byte record");
+    }
+    return c;
+}
+
+std::string KeyColumn::describe() const {
+    return std::to_string(offset) + ":" + (isSigned ? "i" : "u") + std::to_string(8 * width)
+         + (descending ? ":desc" : ":asc");
+}
+
+KeySpec::KeySpec()
+    : toKey{0, 1, 2, 3}, toRecord{0, 1, 2, 3}, mask(0), columnMask(0xFFFFFFFFu), columns{KeyColumn()},
+      isIdentity(true), text("0:i32:asc") {}
+
+KeySpec KeySpec::parse(const std::string& spec) {
+    std::vector<KeyColumn> columns;
+    std::stringstream fields(spec);
+    std::string field;
+    while (std::getline(fields, field, ',')) columns.push_back(KeyColumn::parse(field));
+    if (columns.empty()) throw std::invalid_argument("Empty key spec");
+
+    // Assign key bytes from the most significant (3) down.
+    KeySpec keys;
+    bool used[4] = {false, false, false, false};
+    int next = 3;
+    keys.mask = 0;
+    keys.columnMask = 0;
+    keys.columns = columns;
+    keys.text.clear();
+    for (const KeyColumn& c : columns) {
+        for (int b = c.offset + c.width - 1; b >= c.offset; --b) {
+            if (used[b]) throw std::invalid_argument("Key columns overlap at byte " + std::to_string(b));
+            used[b] = true;
+            keys.toKey[next] = static_cast<uint8_t>(b);
+            uint32_t byteMask = 0;
+            if (c.descending) byteMask = 0xFF;
+            if (c.isSigned && b == c.offset + c.width - 1) byteMask ^= 0x80;
+            keys.mask |= byteMask << (8 * next);
+            keys.columnMask |= 0xFFu << (8 * next);
+            --next;
+        }
+        if (!keys.text.empty()) keys.text += ",";
+        keys.text += c.describe();
+    }
+    // Uncovered bytes break ties, ascending, in record order.
+    for (int b = 3; b >= 0; --b) {
+        if (!used[b]) keys.toKey[next--] = static_cast<uint8_t>(b);
+    }
+    keys.mask ^= INT_BIAS;
+    for (int i = 0; i < 4; ++i) keys.toRecord[keys.toKey[i]] = static_cast<uint8_t>(i);
+    keys.isIdentity = keys.mask == 0 && keys.toKey[0] == 0 && keys.toKey[1] == 1 && keys.toKey[2] == 2
+                   && keys.toKey[3] == 3;
+    return keys;
+}
+
+BlockTransform KeySpec::encoder() const {
+    if (isIdentity) return nullptr;
+    KeySpec keys = *this;
+    return [keys](int* records, size_t count) {
+        for (size_t i = 0; i < count; ++i) records[i] = keys.encode(records[i]);
+    };
+}
+
+BlockTransform KeySpec::decoder() const {
+    if (isIdentity) return nullptr;
+    KeySpec keys = *this;
+    return [keys](int* records, size_t count) {
+        for (size_t i = 0; i < count; ++i) records[i] = keys.decode(records[i]);
+    };
+}
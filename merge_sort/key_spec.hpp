@@ -0,0 +1,80 @@
+#pragma once
+#include "io_utils.hpp"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// One fixed-width column of the record.
+struct KeyColumn {
+    int offset = 0, width = 4;
+    bool isSigned = true, descending = false;
+
+    // Parses "OFF:TYPE[:asc|desc]"; throws std::invalid_argument.
+    static KeyColumn parse(const std::string& field);
+    // The column's value in `record`, sign-extended for signed types.
+    int64_t extract(int record) const {
+        uint64_t bits = (static_cast<uint32_t>(record) >> (8 * offset)) & ((uint64_t(1) << (8 * width)) - 1);
+        if (isSigned && bits >> (8 * width - 1)) return static_cast<int64_t>(bits) - (int64_t(1) << (8 * width));
+        return static_cast<int64_t>(bits);
+    }
+    std::string describe() const;
+};
+
+// Schema-driven sort order for the 32-bit records. A spec lists fixed-width
+// columns inside the record (little-endian, as the records are stored) with
+// their signedness and direction, e.g.
+//
+//     2:u16:desc,0:i8,1:u8        (byte offset : type [: asc|desc])
+//
+// and is compiled into a normalized key: the columns' bytes reordered
+// most-significant first in spec order, the sign bit of signed columns
+// flipped and descending columns inverted. Bytes no column covers follow
+// as an ascending tiebreak, so the mapping is a bijection on 32 bits and
+// the key can be turned back into the record.
+//
+// The engines never see a multi-field comparator: the sort's input is
+// normalized as it is read, everything in between (runs, partitions,
+// trees, heaps, std::sort, the SIMD merges) orders the keys as plain ints,
+// and the output is restored as it is written.
+class KeySpec {
+public:
+    // The default: the whole record as one signed ascending int.
+    KeySpec();
+    // Throws std::invalid_argument on a malformed spec or overlapping
+    // columns.
+    static KeySpec parse(const std::string& text);
+
+    // True when keys equal records (the default order); no transform runs.
+    bool identity() const { return isIdentity; }
+    // Canonical form of the spec, e.g. "2:u16:desc,0:i8:asc,1:u8:asc".
+    const std::string& describe() const { return text; }
+
+    // The key columns in spec order.
+    const std::vector<KeyColumn>& keyColumns() const { return columns; }
+    // A normalized key with its tiebreak bytes cleared. Records with equal
+    // key columns share it, and groups compare in sort order.
+    int groupKey(int key) const { return static_cast<int>(static_cast<uint32_t>(key) & columnMask); }
+
+    int encode(int record) const { return static_cast<int>(permute(static_cast<uint32_t>(record), toKey) ^ mask); }
+    int decode(int key) const { return static_cast<int>(permute(static_cast<uint32_t>(key) ^ mask, toRecord)); }
+
+    // Block transforms for FileReader/FileWriter::setTransform; empty for
+    // the identity spec.
+    BlockTransform encoder() const;
+    BlockTransform decoder() const;
+
+private:
+    // out byte i = in byte from[i] (byte 0 is the least significant).
+    static uint32_t permute(uint32_t in, const uint8_t* from) {
+        return ((in >> (8 * from[0])) & 0xFF) | ((in >> (8 * from[1])) & 0xFF) << 8
+             | ((in >> (8 * from[2])) & 0xFF) << 16 | ((in >> (8 * from[3])) & 0xFF) << 24;
+    }
+
+    uint8_t toKey[4];    // key byte i comes from record byte toKey[i]
+    uint8_t toRecord[4]; // the inverse permutation
+    uint32_t mask;       // sign flips, descending inversions, int bias
+    uint32_t columnMask; // key bits that come from key columns
+    std::vector<KeyColumn> columns;
+    bool isIdentity;
+    std::string text;
+};
@@ -0,0 +1,153 @@
+#include "manifest.hpp"
+#include "io_utils.hpp"
+#include "logger.hpp"
+#include <fstream>
+#include <sstream>
+#include <cstdio>
+#include <algorithm>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+static const char* MANIFEST_HEADER = "# external sort manifest v1";
+
+Manifest::Manifest(const std::string& path, bool enabled) : path(path), is_enabled(enabled) {}
+
+bool Manifest::enabled() const {
+    return is_enabled;
+}
+
+bool Manifest::syncData(const std::string& file) const {
+    return !is_enabled || syncFile(file);
+}
+
+bool Manifest::load() {
+    std::ifstream in(path);
+    std::string line;
+    if (!in || !std::getline(in, line) || line != MANIFEST_HEADER) {
+        return false;
+    }
+    values.clear();
+    entries.clear();
+    while (std::getline(in, line)) {
+        std::istringstream ss(line);
+        std::string tag;
+        ss >> tag;
+        if (tag == "file") {
+            ManifestFile f;
+            ss >> f.kind >> f.bytes >> std::hex >> f.checksum >> std::dec;
+            ss.get(); // single separator before the path
+            std::getline(ss, f.path);
+            entries.push_back(f);
+        } else if (tag == "end") {
+            return true;
+        } else if (!tag.empty()) {
+            std::string value;
+            ss.get();
+            std::getline(ss, value);
+            values[tag] = value;
+        }
+    }
+    // No "end" marker: the file was truncated, which commit() never leaves
+    // behind, so treat it as unusable.
+    return false;
+}
+
+bool Manifest::commit() {
+    if (!is_enabled) return true;
+    std::string tmp = path + ".tmp";
+    {
+        std::ofstream out(tmp, std::ios::trunc);
+        out << MANIFEST_HEADER << "\n";
+        for (const auto& kv : values) out << kv.first << " " << kv.second << "\n";
+        for (const auto& f : entries) {
+            out << "file " << f.kind << " " << f.bytes << " " << std::hex << f.checksum
+                << std::dec << " " << f.path << "\n";
+        }
+        out << "end\n";
+        if (!out) {
+            LOG_DEBUG("Failed to write manifest " << tmp);
+            return false;
+        }
+    }
+    if (!syncFile(tmp) || rename(tmp.c_str(), path.c_str()) != 0) {
+        LOG_DEBUG("Failed to install manifest " << path);
+        return false;
+    }
+    // Persist the rename itself.
+    size_t slash = path.find_last_of('/');
+    syncFile(slash == std::string::npos ? "." : path.substr(0, slash + 1));
+    return true;
+}
+
+void Manifest::discard() {
+    values.clear();
+    entries.clear();
+    if (is_enabled) remove(path.c_str());
+}
+
+void Manifest::set(const std::string& key, const std::string& value) {
+    values[key] = value;
+}
+
+std::string Manifest::get(const std::string& key, const std::string& fallback) const {
+    auto it = values.find(key);
+    return it == values.end() ? fallback : it->second;
+}
+
+void Manifest::addFile(const std::string& kind, const std::string& file, uint64_t bytes, uint64_t checksum) {
+    removeFile(file);
+    entries.push_back({kind, file, bytes, checksum});
+}
+
+void Manifest::removeFile(const std::string& file) {
+    entries.erase(std::remove_if(entries.begin(), entries.end(),
+                                 [&](const ManifestFile& f) { return f.path == file; }),
+                  entries.end());
+}
+
+void Manifest::removeFiles(const std::string& kind) {
+    entries.erase(std::remove_if(entries.begin(), entries.end(),
+                                 [&](const ManifestFile& f) { return f.kind == kind; }),
+                  entries.end());
+}
+
+std::vector<ManifestFile> Manifest::files(const std::string& kind) const {
+    std::vector<ManifestFile> out;
+    for (const auto& f : entries) {
+        if (f.kind == kind) out.push_back(f);
+    }
+    return out;
+}
+
+const ManifestFile* Manifest::find(const std::string& file) const {
+    for (const auto& f : entries) {
+        if (f.path == file) return &f;
+    }
+    return nullptr;
+}
+
+bool Manifest::verify(const ManifestFile& file) {
+    uint64_t bytes = 0, checksum = 0;
+    if (!fileChecksum(file.path, bytes, checksum)) return false;
+    return bytes == file.bytes && checksum == file.checksum;
+}
+
+bool syncFile(const std::string& path) {
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+    bool ok = ::fsync(fd) == 0;
+    ::close(fd);
+    return ok;
+}
+
+std::string inputIdentity(const std::string& inputFile) {
+    struct stat st;
+    if (isStdStream(inputFile) || stat(inputFile.c_str(), &st) != 0) return inputFile;
+    return inputFile + " " + std::to_string(st.st_size);
+}
+
+bool checkpointableInput(const std::string& inputFile) {
+    struct stat st;
+    return !isStdStream(inputFile) && (stat(inputFile.c_str(), &st) != 0 || S_ISREG(st.st_mode));
+}
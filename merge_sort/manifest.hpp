@@ -0,0 +1,60 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <map>
+#include <cstdint>
+
+// A file the manifest vouches for: it is complete, and its contents hash to
+// `checksum` (see checksumUpdate in io_utils).
+struct ManifestFile {
+    std::string kind; // e.g. "run", "merged", "carry", "partition", "sorted"
+    std::string path;
+    uint64_t bytes;
+    uint64_t checksum;
+};
+
+// Durable progress record for long-running sorts. The manifest is a small
+// text file that is rewritten atomically (temp file + fsync + rename) at
+// phase and pass boundaries, so after a crash it always describes the last
+// consistent checkpoint. A disabled manifest still tracks state in memory
+// but never touches the disk, so sorts that do not checkpoint pay nothing.
+class Manifest {
+public:
+    explicit Manifest(const std::string& path, bool enabled = true);
+
+    bool load();    // false if missing or unreadable
+    bool commit();  // durably replace the on-disk copy
+    void discard(); // forget all state and remove the on-disk copy
+    bool enabled() const;
+    // fsync a data file the next commit will vouch for (no-op if disabled).
+    bool syncData(const std::string& file) const;
+
+    void set(const std::string& key, const std::string& value);
+    std::string get(const std::string& key, const std::string& fallback = "") const;
+
+    void addFile(const std::string& kind, const std::string& path, uint64_t bytes, uint64_t checksum);
+    void removeFile(const std::string& path);
+    void removeFiles(const std::string& kind);
+    std::vector<ManifestFile> files(const std::string& kind) const;
+    const ManifestFile* find(const std::string& path) const;
+
+    // True if the file exists with the recorded size and checksum.
+    static bool verify(const ManifestFile& file);
+
+private:
+    std::string path;
+    bool is_enabled;
+    std::map<std::string, std::string> values;
+    std::vector<ManifestFile> entries;
+};
+
+// Path plus size, so a checkpoint is never applied to a different input.
+std::string inputIdentity(const std::string& inputFile);
+
+// False for inputs a resumed sort could not reopen at the same place:
+// stdin and other pipes. Such inputs must not be checkpointed.
+bool checkpointableInput(const std::string& inputFile);
+
+// fsync an already written and closed file.
+bool syncFile(const std::string& path);
@@ -0,0 +1,92 @@
+#include "memory_governor.hpp"
+#include "io_utils.hpp"
+#include <fstream>
+#include <cstdint>
+#include <unistd.h>
+
+MemoryGovernor& memory() {
+    static MemoryGovernor instance;
+    return instance;
+}
+
+void MemoryGovernor::reset(size_t capBytes) {
+    limit = capBytes;
+    highWater = used.load();
+}
+
+void MemoryGovernor::acquire(size_t bytes) {
+    size_t now = used.fetch_add(bytes) + bytes;
+    if (limit > 0 && now > limit) {
+        used.fetch_sub(bytes);
+        throw MemoryLimitExceeded("allocating " + std::to_string(bytes) + " bytes would use "
+                                  + std::to_string(now) + " of the " + std::to_string(limit) + " byte limit");
+    }
+    size_t peak = highWater.load();
+    while (now > peak && !highWater.compare_exchange_weak(peak, now)) {
+    }
+}
+
+void MemoryGovernor::release(size_t bytes) {
+    used.fetch_sub(bytes);
+}
+
+size_t MemoryGovernor::available() const {
+    if (limit == 0) return SIZE_MAX;
+    size_t now = used.load();
+    return now < limit ? limit - now : 0;
+}
+
+// First number in a cgroup limit file; 0 for "max" or a missing file.
+static size_t readLimitFile(const std::string& path) {
+    std::ifstream in(path);
+    std::string value;
+    if (!(in >> value) || value == "max") return 0;
+    try {
+        uint64_t bytes = std::stoull(value);
+        // cgroup v1 reports "unlimited" as a huge page-rounded number.
+        return bytes >= (1ULL << 62) ? 0 : static_cast<size_t>(bytes);
+    } catch (const std::exception&) {
+        return 0;
+    }
+}
+
+size_t cgroupMemoryLimit() {
+    // Our own cgroup's path from /proc/self/cgroup ("0::/path" on v2,
+    // "N:memory:/path" on v1), falling back to the mount root.
+    std::ifstream self("/proc/self/cgroup");
+    std::string line, v2Path, v1Path;
+    while (std::getline(self, line)) {
+        size_t first = line.find(':'), second = line.find(':', first + 1);
+        if (first == std::string::npos || second == std::string::npos) continue;
+        std::string controllers = line.substr(first + 1, second - first - 1);
+        std::string path = line.substr(second + 1);
+        if (controllers.empty()) v2Path = path;
+        else if (controllers.find("memory") != std::string::npos) v1Path = path;
+    }
+    for (const std::string& path : {"/sys/fs/cgroup" + v2Path + "/memory.max",
+                                    std::string("/sys/fs/cgroup/memory.max"),
+                                    "/sys/fs/cgroup/memory" + v1Path + "/memory.limit_in_bytes",
+                                    std::string("/sys/fs/cgroup/memory/memory.limit_in_bytes")}) {
+        size_t limit = readLimitFile(path);
+        if (limit > 0) return limit;
+    }
+    return 0;
+}
+
+size_t parseMemoryBudget(const std::string& text) {
+    if (text.empty() || text.back() != '%') return parseByteSize(text);
+    double percent;
+    try {
+        size_t idx = 0;
+        percent = std::stod(text, &idx);
+        if (idx != text.size() - 1) throw std::invalid_argument(text);
+    } catch (const std::exception&) {
+        throw std::invalid_argument("Invalid memory budget: '" + text + "'");
+    }
+    if (percent <= 0 || percent > 100) {
+        throw std::invalid_argument("Memory percentage must be in (0, 100]: '" + text + "'");
+    }
+    size_t total = cgroupMemoryLimit();
+    if (total == 0) total = static_cast<size_t>(sysconf(_SC_PHYS_PAGES)) * static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    return static_cast<size_t>(total * (percent / 100.0));
+}
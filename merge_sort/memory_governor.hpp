@@ -0,0 +1,84 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <atomic>
+#include <cstddef>
+#include <new>
+#include <stdexcept>
+
+// Thrown when an allocation would take the tracked total past the cap.
+class MemoryLimitExceeded : public std::runtime_error {
+public:
+    explicit MemoryLimitExceeded(const std::string& what) : std::runtime_error(what) {}
+};
+
+// Accounts for every large allocation the engines make (I/O buffers,
+// tournament trees, the pivot heap, in-memory key arrays) against one hard
+// cap. The engines size their structures from available(), so the cap is
+// what they actually use rather than an estimate.
+class MemoryGovernor {
+public:
+    // Sets the cap (0: unlimited) and restarts peak tracking from the
+    // current usage. Outstanding allocations stay charged.
+    void reset(size_t capBytes);
+
+    // Charges `bytes`; throws MemoryLimitExceeded if the cap would be exceeded.
+    void acquire(size_t bytes);
+    void release(size_t bytes);
+
+    size_t cap() const { return limit; }
+    size_t current() const { return used.load(); }
+    size_t peak() const { return highWater.load(); }
+    // Bytes left under the cap (SIZE_MAX when unlimited).
+    size_t available() const;
+
+private:
+    size_t limit = 0;
+    std::atomic<size_t> used{0};
+    std::atomic<size_t> highWater{0};
+};
+
+// The process-wide governor used by both engines.
+MemoryGovernor& memory();
+
+// Allocator that charges the governor, for containers whose storage
+// counts against the memory limit.
+template <typename T>
+struct TrackedAllocator {
+    using value_type = T;
+
+    TrackedAllocator() = default;
+    template <typename U>
+    TrackedAllocator(const TrackedAllocator<U>&) {}
+
+    T* allocate(size_t n) {
+        memory().acquire(n * sizeof(T));
+        try {
+            return static_cast<T*>(::operator new(n * sizeof(T)));
+        } catch (...) {
+            memory().release(n * sizeof(T));
+            throw;
+        }
+    }
+    void deallocate(T* p, size_t n) {
+        ::operator delete(p);
+        memory().release(n * sizeof(T));
+    }
+
+    template <typename U>
+    bool operator==(const TrackedAllocator<U>&) const { return true; }
+    template <typename U>
+    bool operator!=(const TrackedAllocator<U>&) const { return false; }
+};
+
+template <typename T>
+using TrackedVector = std::vector<T, TrackedAllocator<T>>;
+
+// Memory limit of the enclosing cgroup (v2 or v1); 0 if there is none.
+size_t cgroupMemoryLimit();
+
+// Parses a memory budget: a byte count as accepted by parseByteSize, or a
+// percentage such as "90%" of the cgroup limit (of physical memory when
+// there is no cgroup limit). Throws std::invalid_argument on bad input.
+size_t parseMemoryBudget(const std::string& text);
@@ -0,0 +1,14 @@
+#include "merge_kernels.hpp"
+#include <vector>
+
+uint64_t mergeRuns(FileReader* const* readers, int count, FileWriter& out) {
+    std::vector<RunCursor<int, FileReader>> runs(count);
+    for (int i = 0; i < count; ++i) runs[i].reader = readers[i];
+    // Dispatch once per group; the vector width was picked at startup.
+    if (count <= 0) return 0;
+    if (count == 1) return drainRun(runs[0], out);
+    if (count == 2) return mergeTwo(runs.data(), out);
+    // The FIFO tree beats both the loser tree and the register select at
+    // every K from 3 up, scalar or vectorized (see bin/merge_bench).
+    return mergeFifoTree(runs.data(), count, out);
+}
@@ -0,0 +1,303 @@
+#pragma once
+
+#include "io_utils.hpp"
+#include "simd_merge.hpp"
+#include <cstdint>
+#include <cstddef>
+#include <algorithm>
+#include <cstring>
+
+// Merge kernels for one group of sorted runs, specialized at compile time
+// on the fan-in and the record type:
+//   K = 2        two-way merge, vectorized (simd_merge.hpp) or branchless;
+//   larger K     a tree of those two-way merges joined by small
+//                cache-resident queues.
+// mergeSelect (branchless arg-min over K register-resident heads) and
+// mergeTree (loser tree) are the scalar per-record kernels it replaced;
+// bin/merge_bench keeps them as baselines.
+// Runs are consumed and output produced a buffer-sized block at a time, so
+// there is no per-record hasNext()/next() call. Exhausted runs are tracked
+// explicitly; no key value is reserved as a sentinel.
+
+// Order-preserving 64-bit image of a record's key. Every real key maps
+// below EXHAUSTED, which marks a run with nothing left.
+template <typename Record>
+struct RecordTraits;
+
+template <>
+struct RecordTraits<int> {
+    static uint64_t key(int value) { return static_cast<uint32_t>(value) ^ 0x80000000u; }
+    static bool less(int a, int b) { return a < b; }
+};
+
+const uint64_t EXHAUSTED = UINT64_MAX;
+
+// Block-wise view of one run. Reader provides nextBlock(const Record*&).
+template <typename Record, typename Reader>
+struct RunCursor {
+    Reader* reader = nullptr;
+    const Record* pos = nullptr;
+    const Record* end = nullptr;
+
+    // True if a record is available at pos (refilling when needed).
+    bool ready() {
+        if (pos != end) return true;
+        size_t n = reader ? reader->nextBlock(pos) : 0;
+        end = pos + n;
+        return n > 0;
+    }
+    uint64_t head() { return ready() ? RecordTraits<Record>::key(*pos) : EXHAUSTED; }
+};
+
+// Vector step of a two-way merge: simdMergeBlock() for int records, none
+// (0 records) for any other type.
+template <typename Record>
+size_t vectorMerge(const Record*&, const Record*, const Record*&, const Record*, Record*, size_t) {
+    return 0;
+}
+inline size_t vectorMerge(const int*& a, const int* aEnd, const int*& b, const int* bEnd, int* dst, size_t room) {
+    return simdMergeBlock(a, aEnd, b, bEnd, dst, room);
+}
+
+// Merges [a, aEnd) and [b, bEnd) into dst until room is used up or either
+// range is empty: vector steps while both hold a full vector, scalar
+// branchless steps across the block edges.
+template <typename Record>
+size_t mergeRanges(const Record*& a, const Record* aEnd, const Record*& b, const Record* bEnd,
+                   Record* dst, size_t room) {
+    size_t written = 0;
+    while (written < room && a != aEnd && b != bEnd) {
+        size_t n = vectorMerge(a, aEnd, b, bEnd, dst + written, room - written);
+        if (n == 0) {
+            n = std::min<size_t>({room - written, static_cast<size_t>(aEnd - a), static_cast<size_t>(bEnd - b)});
+            const Record* pa = a;
+            const Record* pb = b;
+            Record* out = dst + written;
+            for (size_t i = 0; i < n; ++i) {
+                Record x = *pa, y = *pb;
+                bool takeB = RecordTraits<Record>::less(y, x);
+                out[i] = takeB ? y : x;
+                pa += !takeB;
+                pb += takeB;
+            }
+            a = pa;
+            b = pb;
+        }
+        written += n;
+    }
+    return written;
+}
+
+// Copies the rest of one run to the output.
+template <typename Record, typename Reader, typename Writer>
+uint64_t drainRun(RunCursor<Record, Reader>& run, Writer& out) {
+    uint64_t written = 0;
+    while (run.ready()) {
+        size_t room;
+        Record* dst = out.reserve(room);
+        size_t n = std::min<size_t>(room, run.end - run.pos);
+        std::memcpy(dst, run.pos, n * sizeof(Record));
+        run.pos += n;
+        out.commit(n);
+        written += n;
+    }
+    return written;
+}
+
+// Two runs: vector steps where available, otherwise one compare and two
+// conditional pointer bumps per record.
+template <typename Record, typename Reader, typename Writer>
+uint64_t mergeTwo(RunCursor<Record, Reader>* runs, Writer& out) {
+    RunCursor<Record, Reader>& a = runs[0];
+    RunCursor<Record, Reader>& b = runs[1];
+    uint64_t written = 0;
+    while (a.ready() && b.ready()) {
+        size_t room;
+        Record* dst = out.reserve(room);
+        size_t n = mergeRanges(a.pos, a.end, b.pos, b.end, dst, room);
+        out.commit(n);
+        written += n;
+    }
+    return written + drainRun(a, out) + drainRun(b, out);
+}
+
+// Up to K runs: the K heads live in a fixed array the compiler keeps in
+// registers and the minimum is found with an unrolled branchless scan.
+template <int K, typename Record, typename Reader, typename Writer>
+uint64_t mergeSelect(RunCursor<Record, Reader>* runs, int count, Writer& out) {
+    uint64_t heads[K];
+    for (int i = 0; i < K; ++i) heads[i] = i < count ? runs[i].head() : EXHAUSTED;
+    uint64_t written = 0;
+    while (true) {
+        size_t room;
+        Record* dst = out.reserve(room);
+        size_t n = 0;
+        for (; n < room; ++n) {
+            int best = 0;
+            uint64_t bestKey = heads[0];
+            for (int i = 1; i < K; ++i) {
+                bool smaller = heads[i] < bestKey;
+                bestKey = smaller ? heads[i] : bestKey;
+                best = smaller ? i : best;
+            }
+            if (bestKey == EXHAUSTED) break;
+            dst[n] = *runs[best].pos++;
+            heads[best] = runs[best].head();
+        }
+        out.commit(n);
+        written += n;
+        if (n < room) return written;
+    }
+}
+
+// Any number of runs: a loser tree, log2(count) compares per record.
+template <typename Record, typename Reader, typename Writer>
+uint64_t mergeTree(RunCursor<Record, Reader>* runs, int count, Writer& out) {
+    const int k = count;
+    TrackedVector<uint64_t> keys(k);
+    TrackedVector<int> losers(k); // losers[0] holds the overall winner
+    for (int i = 0; i < k; ++i) keys[i] = runs[i].head();
+    // Build: winners bottom-up, then the loser of each match top-down
+    // (leaf i is node i + k; node j's children are 2j and 2j + 1).
+    auto winnerOf = [&](int node) { return node >= k ? node - k : losers[node]; };
+    for (int j = k - 1; j >= 1; --j) {
+        int a = winnerOf(2 * j), b = winnerOf(2 * j + 1);
+        losers[j] = keys[a] <= keys[b] ? a : b;
+    }
+    losers[0] = k > 1 ? losers[1] : 0;
+    for (int j = 1; j < k; ++j) {
+        int a = winnerOf(2 * j), b = winnerOf(2 * j + 1);
+        losers[j] = losers[j] == a ? b : a;
+    }
+
+    uint64_t written = 0;
+    while (true) {
+        size_t room;
+        Record* dst = out.reserve(room);
+        size_t n = 0;
+        for (; n < room; ++n) {
+            int current = losers[0];
+            if (keys[current] == EXHAUSTED) break;
+            dst[n] = *runs[current].pos++;
+            uint64_t value = runs[current].head();
+            keys[current] = value;
+            for (int node = (current + k) / 2; node >= 1; node /= 2) {
+                int other = losers[node];
+                uint64_t otherKey = keys[other];
+                if (otherKey < value) {
+                    losers[node] = current;
+                    current = other;
+                    value = otherKey;
+                }
+            }
+            losers[0] = current;
+        }
+        out.commit(n);
+        written += n;
+        if (n < room) return written;
+    }
+}
+
+// Records each queue of the FIFO merge tree holds. 63 queues (64 runs)
+// take 252 KB, which stays in L2.
+const size_t MERGE_QUEUE_RECORDS = 1024;
+
+// Any number of runs as a binary tree of two-way merges. Leaves are the
+// runs; each inner node owns a queue its children are merged into, refilled
+// whole when it runs dry, and the root merges its children straight into
+// the output. Every merge is a mergeRanges() call over two blocks, so with
+// SIMD each level does vector steps instead of per-record tree climbs.
+// Unread part of a FIFO tree node's current block.
+template <typename Record>
+struct FifoNode {
+    const Record* pos = nullptr;
+    const Record* end = nullptr;
+    bool done = false;
+};
+
+template <typename Record, typename Reader, typename Writer>
+class FifoMergeTree {
+public:
+    FifoMergeTree(RunCursor<Record, Reader>* runs, int count)
+        : runs(runs), k(count), nodes(2 * count), queues(count * MERGE_QUEUE_RECORDS) {}
+
+    uint64_t run(Writer& out) {
+        uint64_t written = 0;
+        while (true) {
+            size_t room;
+            Record* dst = out.reserve(room);
+            size_t n = fill(1, dst, room);
+            out.commit(n);
+            written += n;
+            if (n < room) return written;
+        }
+    }
+
+private:
+    // Node j (1 <= j < k) has children 2j and 2j + 1; node k + i is run i.
+    using Node = FifoNode<Record>;
+
+    // Makes node j's block non-empty; false once its input is used up.
+    bool pull(int j) {
+        Node& node = nodes[j];
+        if (node.pos != node.end) return true;
+        if (node.done) return false;
+        size_t n;
+        if (j >= k) {
+            RunCursor<Record, Reader>& cursor = runs[j - k];
+            n = cursor.ready() ? static_cast<size_t>(cursor.end - cursor.pos) : 0;
+            node.pos = cursor.pos;
+            cursor.pos = cursor.end;
+        } else {
+            Record* queue = queues.data() + j * MERGE_QUEUE_RECORDS;
+            n = fill(j, queue, MERGE_QUEUE_RECORDS);
+            node.pos = queue;
+        }
+        node.end = node.pos + n;
+        node.done = n == 0;
+        return n > 0;
+    }
+
+    // Merges node j's children into dst until room is used up or both
+    // are finished.
+    size_t fill(int j, Record* dst, size_t room) {
+        Node& left = nodes[2 * j];
+        Node& right = nodes[2 * j + 1];
+        size_t written = 0;
+        while (written < room) {
+            bool hasLeft = pull(2 * j), hasRight = pull(2 * j + 1);
+            if (hasLeft && hasRight) {
+                written += mergeRanges(left.pos, left.end, right.pos, right.end, dst + written, room - written);
+                continue;
+            }
+            if (!hasLeft && !hasRight) break;
+            Node& rest = hasLeft ? left : right;
+            size_t n = std::min<size_t>(room - written, rest.end - rest.pos);
+            std::memcpy(dst + written, rest.pos, n * sizeof(Record));
+            rest.pos += n;
+            written += n;
+        }
+        return written;
+    }
+
+    RunCursor<Record, Reader>* runs;
+    int k;
+    TrackedVector<Node> nodes;
+    TrackedVector<Record> queues; // slot j for inner node j (slots 0, 1 unused)
+};
+
+template <typename Record, typename Reader, typename Writer>
+uint64_t mergeFifoTree(RunCursor<Record, Reader>* runs, int count, Writer& out) {
+    FifoMergeTree<Record, Reader, Writer> tree(runs, count);
+    return tree.run(out);
+}
+
+// Bytes of kernel state per run, for memory budgeting: the larger of the
+// loser tree's key and loser slots and the FIFO tree's node and queue (the
+// other kernels keep theirs on the stack).
+const size_t MERGE_BYTES_PER_RUN = std::max(sizeof(uint64_t) + sizeof(int),
+                                            MERGE_QUEUE_RECORDS * sizeof(int) + 2 * sizeof(FifoNode<int>));
+
+// Merges `count` open readers into `out`, choosing the kernel for the
+// group's fan-in. Returns the number of records written.
+uint64_t mergeRuns(FileReader* const* readers, int count, FileWriter& out);
@@ -1,13 +1,43 @@
 #include "external_merge_sort.hpp"
+#include "incremental_merge.hpp"
 #include "logger.hpp"
+#include "temp_dirs.hpp"
+#include "key_spec.hpp"
+#include "manifest.hpp"
 #include <iostream>
 #include <string>
 #include <vector>
 #include <algorithm> // For std::find
+#include <glob.h>
 
 // Define the global logger flag
 bool g_debug_logging_enabled = false;
 
+static void printUsage(const char* prog) {
+    std::cerr << "Usage: " << prog << " <input_file|-> <output_file|-> <mem_limit_in_bytes|N%> [K_value]\n"
+              << "       [--checkpoint] [--resume] [--tmp-dir dir[,dir...]] [--tmp-policy rr|space|bandwidth]\n"
+              << "       [--metrics-out file.json] [--simd none|avx2|avx512] [--threads N] [--pipeline]\n"
+              << "       [--key OFF:TYPE[:asc|desc],...] [--index file.idx] [--index-stride N] [--verbose]\n"
+              << "       [--merge-into sorted_base] [--tier-ratio R]\n"
+              << "   or: " << prog << " --presorted <file,file,...|'glob'> <output_file|-> <mem_limit_in_bytes|N%> [K_value]\n";
+}
+
+// Comma-separated list of files and glob patterns, in the order given (a
+// pattern that matches nothing is kept as a name, to fail on opening).
+static std::vector<std::string> expandInputs(const std::string& list) {
+    std::vector<std::string> files;
+    for (const std::string& item : splitList(list)) {
+        glob_t matches;
+        if (glob(item.c_str(), 0, nullptr, &matches) == 0) {
+            for (size_t i = 0; i < matches.gl_pathc; ++i) files.push_back(matches.gl_pathv[i]);
+        } else {
+            files.push_back(item);
+        }
+        globfree(&matches);
+    }
+    return files;
+}
+
 int main(int argc, char* argv[]) {
     std::vector<std::string> args(argv + 1, argv + argc);
     bool verbose = false;
@@ -19,6 +49,46 @@ int main(int argc, char* argv[]) {
         args.erase(verbose_it);
     }
 
+    // --checkpoint keeps a durable merge_sort.manifest; --resume continues
+    // from it after a crash (and keeps checkpointing).
+    SortOptions options;
+    options.checkpoint = takeFlag(args, "--checkpoint");
+    options.resume = takeFlag(args, "--resume");
+
+    // --tmp-dir may be repeated or given a comma-separated list.
+    std::vector<std::string> tmpDirArgs;
+    takeOption(args, "--tmp-dir", tmpDirArgs);
+    for (const std::string& list : tmpDirArgs) {
+        for (const std::string& dir : splitList(list)) options.tmpDirs.push_back(dir);
+    }
+    takeOption(args, "--tmp-policy", options.tmpPolicy);
+    takeOption(args, "--metrics-out", options.metricsOut);
+    // --simd caps the merge kernels' vector width (the default is the
+    // widest the CPU supports).
+    std::string simd;
+    takeOption(args, "--simd", simd);
+    // --threads N generates runs on N workers spread over the NUMA nodes.
+    std::string threads;
+    takeOption(args, "--threads", threads);
+    // --pipeline overlaps reading, run formation and run writing on
+    // separate threads (pipeline.hpp).
+    options.pipeline = takeFlag(args, "--pipeline");
+    // --key sorts by columns inside the record instead of the whole int.
+    takeOption(args, "--key", options.keySpec);
+    // --index writes a sparse index of the output (see bin/index_lookup).
+    std::string indexStride;
+    takeOption(args, "--index", options.indexFile);
+    takeOption(args, "--index-stride", indexStride);
+    // --merge-into BASE sorts only the input and merges it with the sorted
+    // BASE (in place if the output is BASE); --tier-ratio R instead adds it
+    // to the sorted levels output.0, output.1, ... (incremental_merge.hpp).
+    std::string mergeBase, tierRatio;
+    takeOption(args, "--merge-into", mergeBase);
+    takeOption(args, "--tier-ratio", tierRatio);
+    // --presorted takes a list or glob of inputs that are (mostly) already
+    // sorted and merges them without generating runs for them.
+    const bool presorted = takeFlag(args, "--presorted");
+
     g_debug_logging_enabled = verbose;
     if (g_debug_logging_enabled) {
         std::cerr << "Debug logging enabled for merge sort." << std::endl;
@@ -30,25 +100,89 @@ int main(int argc, char* argv[]) {
     int k_val = 0; // Default to 0 for heuristic
 
     if (args.size() < 3 || args.size() > 4) {
-        std::cerr << "Usage: " << argv[0] << " <input_file> <output_file> <mem_limit_in_bytes> [K_value] [--verbose]\n";
+        printUsage(argv[0]);
         return 1;
     }
 
     inputFile = args[0];
     outputFile = args[1];
-    memLimit = std::stoul(args[2]);
+    try {
+        memLimit = parseMemoryBudget(args[2]);
+        if (!simd.empty()) setSimdLevel(parseSimdLevel(simd.c_str()));
+        if (!threads.empty()) options.threads = std::max(1, std::stoi(threads));
+        if (!options.keySpec.empty()) KeySpec::parse(options.keySpec);
+        if (!indexStride.empty()) options.indexStride = std::max(1, std::stoi(indexStride));
+    } catch (const std::invalid_argument& e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    } catch (const std::out_of_range&) {
+        std::cerr << "Numeric argument out of range." << std::endl;
+        return 1;
+    }
+
+    // With "-" as output the data owns stdout, so narration goes to stderr.
+    if (outputFile == "-") {
+        std::cout.rdbuf(std::cerr.rdbuf());
+    }
 
     if (args.size() == 4) {
         try {
             k_val = std::stoi(args[3]);
         } catch (const std::invalid_argument& e) {
             std::cerr << "Invalid K value: '" << args[3] << "'. Must be an integer." << std::endl;
-            std::cerr << "Usage: " << argv[0] << " <input_file> <output_file> <mem_limit_in_bytes> [K_value] [--verbose]\n";
+            printUsage(argv[0]);
+            return 1;
+        } catch (const std::out_of_range&) {
+            std::cerr << "K value out of range: '" << args[3] << "'." << std::endl;
+            return 1;
+        }
+    }
+
+    try {
+        TempDirs::parsePolicy(options.tmpPolicy);
+    } catch (const std::invalid_argument& e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+
+    // A checkpoint names its input by path and size, so the input must be
+    // a file a resumed sort can reopen.
+    if ((options.checkpoint || options.resume) && !checkpointableInput(inputFile)) {
+        std::cerr << "--checkpoint and --resume need a regular input file, not a stream." << std::endl;
+        return 1;
+    }
+
+    if (presorted) {
+        if (options.checkpoint || options.resume || !mergeBase.empty() || !tierRatio.empty()) {
+            std::cerr << "--presorted excludes --checkpoint, --resume, --merge-into and --tier-ratio." << std::endl;
             return 1;
         }
+        if (!externalMergeSortFiles(expandInputs(inputFile), outputFile, memLimit, k_val, options)) return 1;
+        std::cout << "External merge sort completed.\n";
+        return 0;
     }
 
-    externalMergeSort(inputFile, outputFile, memLimit, k_val);
+    const bool incremental = !mergeBase.empty() || !tierRatio.empty();
+    if (incremental && (options.checkpoint || options.resume || !options.indexFile.empty()
+                        || (!mergeBase.empty() && !tierRatio.empty()))) {
+        std::cerr << "--merge-into and --tier-ratio exclude each other and --checkpoint, --resume and --index."
+                  << std::endl;
+        return 1;
+    }
+    if (!mergeBase.empty()) {
+        if (!incrementalMerge(inputFile, mergeBase, outputFile, memLimit, k_val, options)) return 1;
+    } else if (!tierRatio.empty()) {
+        double ratio = 0;
+        try {
+            ratio = std::stod(tierRatio);
+        } catch (const std::exception&) {
+            std::cerr << "Invalid tier ratio: '" << tierRatio << "'." << std::endl;
+            return 1;
+        }
+        if (!tieredAppend(inputFile, outputFile, ratio, memLimit, k_val, options)) return 1;
+    } else if (!externalMergeSort(inputFile, outputFile, memLimit, k_val, options)) {
+        return 1;
+    }
 
     std::cout << "External merge sort completed.\n";
     return 0;
@@ -0,0 +1,241 @@
+#include "metrics.hpp"
+#include <fstream>
+#include <iomanip>
+#include <algorithm>
+#include <ctime>
+#include <cstdio>
+#include <sys/resource.h>
+
+Metrics& metrics() {
+    static Metrics instance;
+    return instance;
+}
+
+double processCpuSeconds() {
+    timespec ts;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+void reportMemory(std::ostream& out) {
+    const MemoryGovernor& gov = memory();
+    out << "Memory: peak " << gov.peak() << " bytes";
+    if (gov.cap() > 0) {
+        char percent[16];
+        std::snprintf(percent, sizeof(percent), "%.1f%%", 100.0 * gov.peak() / gov.cap());
+        out << " of " << gov.cap() << " (" << percent << ")";
+    }
+    out << std::endl;
+    metrics().countMax("memory_peak_bytes", gov.peak());
+    metrics().countMax("memory_cap_bytes", gov.cap());
+}
+
+void Metrics::reset(const std::string& outputPath) {
+    *this = Metrics();
+    path = outputPath;
+    // Opened here, before the engines start any worker threads.
+    if (enabled()) {
+        perfCounters().open();
+        set("perf_counters", perfCounters().status());
+    }
+}
+
+void Metrics::set(const std::string& key, const std::string& value) {
+    if (!enabled()) return;
+    for (auto& kv : attributes) {
+        if (kv.first == key) {
+            kv.second = value;
+            return;
+        }
+    }
+    attributes.emplace_back(key, value);
+}
+
+void Metrics::count(const std::string& name, uint64_t delta) {
+    if (enabled()) counters[name] += delta;
+}
+
+void Metrics::countMax(const std::string& name, uint64_t value) {
+    if (!enabled()) return;
+    uint64_t& current = counters[name];
+    current = std::max(current, value);
+}
+
+void Metrics::observe(const std::string& histogram, uint64_t value) {
+    if (!enabled()) return;
+    int bucket = -1; // value 0
+    while (value) {
+        value >>= 1;
+        bucket++;
+    }
+    histograms[histogram][bucket]++;
+}
+
+void Metrics::addDevice(const std::string& label, const IoStats& stats) {
+    if (enabled()) devices.emplace_back(label, stats);
+}
+
+void Metrics::addPhase(const std::string& name, double wallSeconds, double cpuSeconds,
+                       uint64_t records, const IoStats& io, const uint64_t* perf) {
+    auto it = std::find_if(phases.begin(), phases.end(), [&](const Phase& p) { return p.name == name; });
+    if (it == phases.end()) {
+        phases.push_back(Phase());
+        phases.back().name = name;
+        it = phases.end() - 1;
+    }
+    it->calls++;
+    it->records += records;
+    it->wall_seconds += wallSeconds;
+    it->cpu_seconds += cpuSeconds;
+    it->io.bytes_read += io.bytes_read;
+    it->io.bytes_written += io.bytes_written;
+    it->io.read_calls += io.read_calls;
+    it->io.write_calls += io.write_calls;
+    it->io.read_seconds += io.read_seconds;
+    it->io.write_seconds += io.write_seconds;
+    for (int i = 0; i < PerfCounters::EVENT_COUNT; ++i) it->perf[i] += perf[i];
+}
+
+static std::string jsonString(const std::string& s) {
+    std::string out = "\"";
+    for (char c : s) {
+        switch (c) {
+            case '"': out += "\\\""; break;
+            case '\\': out += "\\\\"; break;
+            case '\n': out += "\\n"; break;
+            case '\t': out += "\\t"; break;
+            default:
+                if (static_cast<unsigned char>(c) < 0x20) {
+                    char esc[8];
+                    snprintf(esc, sizeof(esc), "\\u%04x", c);
+                    out += esc;
+                } else {
+                    out += c;
+                }
+        }
+    }
+    return out + "\"";
+}
+
+static void writeIo(std::ostream& out, const IoStats& io) {
+    out << "\"bytes_read\": " << io.bytes_read << ", \"bytes_written\": " << io.bytes_written
+        << ", \"read_calls\": " << io.read_calls << ", \"write_calls\": " << io.write_calls
+        << ", \"read_seconds\": " << io.read_seconds << ", \"write_seconds\": " << io.write_seconds;
+}
+
+static double perSecond(uint64_t n, double seconds) {
+    return seconds > 0 ? n / seconds : 0.0;
+}
+
+// The phase's event counts, only for events that could be opened.
+static void writePerf(std::ostream& out, const uint64_t* perf) {
+    const PerfCounters& counters = perfCounters();
+    out << ", \"perf\": {";
+    bool first = true;
+    for (int i = 0; i < PerfCounters::EVENT_COUNT; ++i) {
+        if (!counters.available(i)) continue;
+        out << (first ? "" : ", ") << jsonString(PerfCounters::name(i)) << ": " << perf[i];
+        first = false;
+    }
+    if (counters.available(PerfCounters::CYCLES) && counters.available(PerfCounters::INSTRUCTIONS)) {
+        double cycles = static_cast<double>(perf[PerfCounters::CYCLES]);
+        out << (first ? "" : ", ") << "\"ipc\": " << (cycles > 0 ? perf[PerfCounters::INSTRUCTIONS] / cycles : 0.0);
+    }
+    out << "}";
+}
+
+bool Metrics::write() const {
+    if (!enabled()) return true;
+    std::ofstream out(path);
+    if (!out) return false;
+    out << std::fixed << std::setprecision(6);
+
+    rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+
+    out << "{\n";
+    for (const auto& kv : attributes) {
+        out << "  " << jsonString(kv.first) << ": " << jsonString(kv.second) << ",\n";
+    }
+    out << "  \"peak_rss_bytes\": " << static_cast<uint64_t>(usage.ru_maxrss) * 1024 << ",\n";
+    out << "  \"minor_page_faults\": " << usage.ru_minflt << ",\n";
+    out << "  \"major_page_faults\": " << usage.ru_majflt << ",\n";
+
+    out << "  \"counters\": {";
+    bool first = true;
+    for (const auto& kv : counters) {
+        out << (first ? "" : ",") << "\n    " << jsonString(kv.first) << ": " << kv.second;
+        first = false;
+    }
+    out << (counters.empty() ? "" : "\n  ") << "},\n";
+
+    out << "  \"phases\": [";
+    for (size_t i = 0; i < phases.size(); ++i) {
+        const Phase& p = phases[i];
+        out << (i ? "," : "") << "\n    {\"name\": " << jsonString(p.name) << ", \"calls\": " << p.calls
+            << ", \"wall_seconds\": " << p.wall_seconds << ", \"cpu_seconds\": " << p.cpu_seconds
+            << ", \"records\": " << p.records
+            << ", \"records_per_second\": " << perSecond(p.records, p.wall_seconds) << ", ";
+        writeIo(out, p.io);
+        if (perfCounters().anyAvailable()) writePerf(out, p.perf);
+        out << "}";
+    }
+    out << (phases.empty() ? "" : "\n  ") << "],\n";
+
+    out << "  \"histograms\": {";
+    first = true;
+    for (const auto& h : histograms) {
+        out << (first ? "" : ",") << "\n    " << jsonString(h.first) << ": [";
+        bool firstBucket = true;
+        for (const auto& b : h.second) {
+            uint64_t lo = b.first < 0 ? 0 : 1ULL << b.first;
+            uint64_t hi = b.first < 0 ? 0 : (lo << 1) - 1;
+            out << (firstBucket ? "" : ", ") << "{\"min\": " << lo << ", \"max\": " << hi
+                << ", \"count\": " << b.second << "}";
+            firstBucket = false;
+        }
+        out << "]";
+        first = false;
+    }
+    out << (histograms.empty() ? "" : "\n  ") << "},\n";
+
+    out << "  \"devices\": [";
+    for (size_t i = 0; i < devices.size(); ++i) {
+        out << (i ? "," : "") << "\n    {\"device\": " << jsonString(devices[i].first) << ", ";
+        writeIo(out, devices[i].second);
+        out << "}";
+    }
+    out << (devices.empty() ? "" : "\n  ") << "]\n";
+    out << "}\n";
+    return static_cast<bool>(out);
+}
+
+static IoStats ioDelta(const IoStats& now, const IoStats& then) {
+    IoStats d;
+    d.bytes_read = now.bytes_read - then.bytes_read;
+    d.bytes_written = now.bytes_written - then.bytes_written;
+    d.read_calls = now.read_calls - then.read_calls;
+    d.write_calls = now.write_calls - then.write_calls;
+    d.read_seconds = now.read_seconds - then.read_seconds;
+    d.write_seconds = now.write_seconds - then.write_seconds;
+    return d;
+}
+
+PhaseTimer::PhaseTimer(const std::string& name)
+    : name(name), active(metrics().enabled()), records(0), cpuStart(0) {
+    if (!active) return;
+    wallStart = std::chrono::steady_clock::now();
+    cpuStart = processCpuSeconds();
+    ioStart = processIoStats();
+    perfCounters().read(perfStart);
+}
+
+PhaseTimer::~PhaseTimer() {
+    if (!active) return;
+    double wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - wallStart).count();
+    uint64_t perf[PerfCounters::EVENT_COUNT];
+    perfCounters().read(perf);
+    // Scaled (multiplexed) counts are estimates and may dip slightly.
+    for (int i = 0; i < PerfCounters::EVENT_COUNT; ++i) perf[i] = perf[i] > perfStart[i] ? perf[i] - perfStart[i] : 0;
+    metrics().addPhase(name, wall, processCpuSeconds() - cpuStart, records, ioDelta(processIoStats(), ioStart), perf);
+}
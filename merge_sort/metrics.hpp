@@ -0,0 +1,79 @@
+#pragma once
+
+#include "io_utils.hpp"
+#include "perf_counters.hpp"
+#include <string>
+#include <vector>
+#include <map>
+#include <cstdint>
+#include <chrono>
+#include <ostream>
+
+// Structured numbers for one sort: per-phase wall/CPU time, I/O and record
+// counts, hardware event counts (perf_counters.hpp), counters, histograms
+// and peak RSS, written as JSON for
+// --metrics-out. Everything is recorded at phase, run or group granularity,
+// never per record, and nothing is collected unless an output path is set.
+class Metrics {
+public:
+    // Starts a fresh collection; an empty path disables collection.
+    void reset(const std::string& outputPath);
+    bool enabled() const { return !path.empty(); }
+
+    void set(const std::string& key, const std::string& value);
+    void count(const std::string& name, uint64_t delta = 1);
+    void countMax(const std::string& name, uint64_t value);
+    // Adds a sample to a histogram with power-of-two buckets.
+    void observe(const std::string& histogram, uint64_t value);
+    void addDevice(const std::string& label, const IoStats& stats);
+
+    // Folds one timed interval into the named phase (phases entered more
+    // than once, e.g. once per recursion node, are accumulated). `perf`
+    // holds PerfCounters::EVENT_COUNT event deltas.
+    void addPhase(const std::string& name, double wallSeconds, double cpuSeconds,
+                  uint64_t records, const IoStats& io, const uint64_t* perf);
+
+    // Writes the JSON document; false if the file cannot be written.
+    bool write() const;
+
+private:
+    struct Phase {
+        std::string name;
+        uint64_t calls = 0, records = 0;
+        double wall_seconds = 0, cpu_seconds = 0;
+        IoStats io;
+        uint64_t perf[PerfCounters::EVENT_COUNT] = {};
+    };
+    std::string path;
+    std::vector<std::pair<std::string, std::string>> attributes;
+    std::map<std::string, uint64_t> counters;
+    std::map<std::string, std::map<int, uint64_t>> histograms;
+    std::vector<Phase> phases; // in first-entered order
+    std::vector<std::pair<std::string, IoStats>> devices;
+};
+
+// The process-wide collector used by both engines.
+Metrics& metrics();
+
+// CPU time consumed by the process so far, in seconds.
+double processCpuSeconds();
+
+// Prints the memory governor's peak usage against its cap and records both.
+void reportMemory(std::ostream& out);
+
+// Times a scope as a phase. Inert when metrics are disabled.
+class PhaseTimer {
+public:
+    explicit PhaseTimer(const std::string& name);
+    ~PhaseTimer();
+    void addRecords(uint64_t n) { records += n; }
+
+private:
+    std::string name;
+    bool active;
+    uint64_t records;
+    std::chrono::steady_clock::time_point wallStart;
+    double cpuStart;
+    IoStats ioStart;
+    uint64_t perfStart[PerfCounters::EVENT_COUNT];
+};
@@ -0,0 +1,101 @@
+#include "numa_topology.hpp"
+#include "logger.hpp"
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <dirent.h>
+#include <sched.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+// From <linux/mempolicy.h>; set_mempolicy is called directly so the build
+// needs no libnuma.
+static const int MPOL_PREFERRED_MODE = 1;
+static const int MAX_NODES = 1024;
+
+std::vector<int> parseCpuList(const std::string& text) {
+    std::vector<int> cpus;
+    std::stringstream ss(text);
+    std::string part;
+    while (std::getline(ss, part, ',')) {
+        if (part.empty() || part == "\n") continue;
+        size_t dash = part.find('-');
+        try {
+            int first = std::stoi(part.substr(0, dash));
+            int last = dash == std::string::npos ? first : std::stoi(part.substr(dash + 1));
+            for (int cpu = first; cpu <= last; ++cpu) cpus.push_back(cpu);
+        } catch (const std::exception&) {
+            LOG_DEBUG("Ignoring malformed CPU list entry '" << part << "'");
+        }
+    }
+    return cpus;
+}
+
+static std::vector<NumaNode> discoverNodes() {
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    bool haveMask = sched_getaffinity(0, sizeof(allowed), &allowed) == 0;
+    auto usable = [&](int cpu) { return !haveMask || (cpu < CPU_SETSIZE && CPU_ISSET(cpu, &allowed)); };
+
+    std::vector<NumaNode> nodes;
+    const std::string root = "/sys/devices/system/node";
+    if (DIR* dir = opendir(root.c_str())) {
+        while (dirent* entry = readdir(dir)) {
+            std::string name = entry->d_name;
+            if (name.size() <= 4 || name.compare(0, 4, "node") != 0
+                || name.find_first_not_of("0123456789", 4) != std::string::npos) {
+                continue;
+            }
+            std::ifstream list(root + "/" + name + "/cpulist");
+            std::string text;
+            std::getline(list, text);
+            NumaNode node{std::stoi(name.substr(4)), {}};
+            for (int cpu : parseCpuList(text)) {
+                if (usable(cpu)) node.cpus.push_back(cpu);
+            }
+            // Memory-only nodes (and nodes outside our cpuset) get no workers.
+            if (!node.cpus.empty()) nodes.push_back(node);
+        }
+        closedir(dir);
+    }
+    if (nodes.empty()) {
+        NumaNode all{0, {}};
+        long count = sysconf(_SC_NPROCESSORS_ONLN);
+        for (int cpu = 0; cpu < std::max<long>(count, 1); ++cpu) {
+            if (usable(cpu)) all.cpus.push_back(cpu);
+        }
+        if (all.cpus.empty()) all.cpus.push_back(0);
+        nodes.push_back(all);
+    }
+    std::sort(nodes.begin(), nodes.end(), [](const NumaNode& a, const NumaNode& b) { return a.id < b.id; });
+    return nodes;
+}
+
+const std::vector<NumaNode>& numaNodes() {
+    static const std::vector<NumaNode> nodes = discoverNodes();
+    return nodes;
+}
+
+bool pinThreadToNode(const NumaNode& node) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int cpu : node.cpus) {
+        if (cpu < CPU_SETSIZE) CPU_SET(cpu, &set);
+    }
+    bool ok = pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+    // With one node every allocation is local already.
+    if (ok && numaNodes().size() > 1 && node.id < MAX_NODES) {
+        unsigned long mask[MAX_NODES / (8 * sizeof(unsigned long))] = {};
+        mask[node.id / (8 * sizeof(unsigned long))] |= 1UL << (node.id % (8 * sizeof(unsigned long)));
+        ok = syscall(SYS_set_mempolicy, MPOL_PREFERRED_MODE, mask, MAX_NODES + 1) == 0;
+    }
+    if (!ok) LOG_DEBUG("Could not pin thread to NUMA node " << node.id);
+    return ok;
+}
+
+int currentNumaNode() {
+    unsigned cpu = 0, node = 0;
+    if (syscall(SYS_getcpu, &cpu, &node, nullptr) != 0) return 0;
+    return static_cast<int>(node);
+}
@@ -0,0 +1,26 @@
+#pragma once
+#include <string>
+#include <vector>
+
+// NUMA layout of the machine, read once from /sys/devices/system/node.
+// Without that directory (a kernel built without NUMA, some containers)
+// the machine is a single node holding every CPU the process may use.
+struct NumaNode {
+    int id;
+    std::vector<int> cpus; // only CPUs in the process's affinity mask
+};
+
+// Nodes that have at least one usable CPU, in id order; never empty.
+const std::vector<NumaNode>& numaNodes();
+
+// Parses a sysfs CPU list such as "0-3,8,10-11".
+std::vector<int> parseCpuList(const std::string& text);
+
+// Restricts the calling thread to the node's CPUs and makes the node its
+// preferred memory node, so everything the thread allocates and first
+// touches from here on (buffers, trees, queues) is node-local. False if
+// the kernel refuses; the thread then keeps running where it was.
+bool pinThreadToNode(const NumaNode& node);
+
+// Node the calling thread is running on (0 if unknown).
+int currentNumaNode();
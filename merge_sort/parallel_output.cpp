@@ -0,0 +1,207 @@
+#include "parallel_output.hpp"
+#include "external_merge_sort.hpp"
+#include "merge_kernels.hpp"
+#include "logger.hpp"
+#include <thread>
+#include <algorithm>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+// Slices smaller than this are not worth a thread of their own.
+static const uint64_t MIN_SLICE_RECORDS = 1 << 18;
+// Splitter samples drawn from the runs per worker.
+static const uint64_t SAMPLES_PER_WORKER = 256;
+
+bool parallelOutput(const std::string& outputFile, int threads) {
+    struct stat st;
+    if (threads <= 1 || isStdStream(outputFile)) return false;
+    return stat(outputFile.c_str(), &st) != 0 || S_ISREG(st.st_mode);
+}
+
+bool preallocateFile(const std::string& path, uint64_t bytes) {
+    int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) return false;
+    bool ok = bytes == 0 || fallocate(fd, 0, 0, static_cast<off_t>(bytes)) == 0
+              || ftruncate(fd, static_cast<off_t>(bytes)) == 0;
+    return close(fd) == 0 && ok;
+}
+
+static uint64_t recordsIn(const std::string& path) {
+    struct stat st;
+    return stat(path.c_str(), &st) == 0 ? static_cast<uint64_t>(st.st_size) / sizeof(int) : 0;
+}
+
+static int workersFor(int threads, uint64_t records) {
+    uint64_t bySize = std::max<uint64_t>(1, records / MIN_SLICE_RECORDS);
+    return static_cast<int>(std::min<uint64_t>(std::max(threads, 1), bySize));
+}
+
+// Runs work(t) for t in [0, workers) on one thread each; false if any
+// returned false or threw.
+template <typename Work>
+static bool runWorkers(int workers, Work work) {
+    std::vector<char> ok(workers, 0);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < workers; ++t) {
+        threads.emplace_back([&, t] {
+            try {
+                ok[t] = work(t);
+            } catch (const std::exception& e) {
+                LOG_DEBUG("Output worker " << t << " failed: " << e.what());
+            }
+        });
+    }
+    for (std::thread& t : threads) t.join();
+    return std::all_of(ok.begin(), ok.end(), [](char c) { return c != 0; });
+}
+
+bool concatenateParallel(const std::vector<std::string>& parts, const std::string& outputFile, int threads,
+                         size_t memBytes, const BlockTransform& transform, uint64_t& records,
+                         const std::vector<IoStats*>& inStats, IoStats* outStats) {
+    std::vector<uint64_t> starts; // first output record of every part
+    records = 0;
+    for (const std::string& part : parts) {
+        starts.push_back(records);
+        records += recordsIn(part);
+    }
+    if (!preallocateFile(outputFile, records * sizeof(int))) return false;
+
+    const int workers = workersFor(threads, records);
+    const size_t bufSize = bufferSizeFor(memBytes / (2 * workers));
+    BufferPool pool(2 * workers, bufSize);
+    std::vector<Buffer*> buffers;
+    for (int i = 0; i < 2 * workers; ++i) buffers.push_back(&pool.lease(bufSize));
+
+    return runWorkers(workers, [&](int t) {
+        const uint64_t begin = records * t / workers, end = records * (t + 1) / workers;
+        FileWriter out(outputFile, *buffers[2 * t], begin * sizeof(int), outStats);
+        if (!out.isOpen()) return false;
+        out.setTransform(transform);
+        for (size_t p = 0; p < parts.size(); ++p) {
+            const uint64_t partEnd = p + 1 < parts.size() ? starts[p + 1] : records;
+            if (partEnd <= begin || starts[p] >= end) continue;
+            FileReader in(parts[p], *buffers[2 * t + 1], p < inStats.size() ? inStats[p] : nullptr);
+            if (!in.isOpen()) return false;
+            in.skip(std::max(begin, starts[p]) - starts[p]);
+            in.limit(std::min(end, partEnd) - std::max(begin, starts[p]));
+            const int* block;
+            while (size_t n = in.nextBlock(block)) {
+                while (n > 0) {
+                    size_t room;
+                    int* dst = out.reserve(room);
+                    size_t take = std::min(room, n);
+                    std::copy(block, block + take, dst);
+                    out.commit(take);
+                    block += take;
+                    n -= take;
+                }
+            }
+        }
+        out.close();
+        return out.bytesWritten() == (end - begin) * sizeof(int) && !out.failed();
+    });
+}
+
+// First record of a sorted run that is not less than `key`.
+static uint64_t lowerBound(int fd, uint64_t records, int key, bool& ok) {
+    uint64_t lo = 0, hi = records;
+    while (lo < hi) {
+        uint64_t mid = lo + (hi - lo) / 2;
+        int value;
+        if (pread(fd, &value, sizeof(value), static_cast<off_t>(mid * sizeof(int))) != sizeof(value)) {
+            ok = false;
+            return lo;
+        }
+        if (value < key) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+int mergeParallel(const std::vector<std::string>& runs, const std::string& outputFile, int threads,
+                  size_t memBytes, const BlockTransform& transform, uint64_t& records,
+                  const std::vector<IoStats*>& inStats, IoStats* outStats) {
+    const int K = static_cast<int>(runs.size());
+    std::vector<uint64_t> runRecords;
+    records = 0;
+    for (const std::string& run : runs) {
+        runRecords.push_back(recordsIn(run));
+        records += runRecords.back();
+    }
+    // As many workers as can each hold a merge of every run.
+    int workers = workersFor(threads, records);
+    while (workers > 1 && mergeFanInFor(memBytes / workers, bufferSizeFor(memBytes / workers)) < runs.size()) {
+        workers--;
+    }
+
+    // Splitters: evenly spaced quantiles of a sample drawn from every run
+    // in proportion to its size. cuts[j][t] is where range t starts in run j.
+    std::vector<std::vector<uint64_t>> cuts(K, std::vector<uint64_t>(workers + 1, 0));
+    bool ok = true;
+    if (workers > 1) {
+        std::vector<int> fds, sample;
+        for (int j = 0; j < K; ++j) {
+            fds.push_back(open(runs[j].c_str(), O_RDONLY));
+            if (fds.back() < 0) ok = false;
+            const uint64_t n = runRecords[j];
+            const uint64_t samples = std::min(n, SAMPLES_PER_WORKER * workers * n / records + 1);
+            for (uint64_t i = 0; ok && i < samples; ++i) {
+                int value;
+                off_t at = static_cast<off_t>(i * n / samples * sizeof(int));
+                ok = pread(fds[j], &value, sizeof(value), at) == sizeof(value);
+                sample.push_back(value);
+            }
+        }
+        std::sort(sample.begin(), sample.end());
+        for (int t = 1; ok && t < workers; ++t) {
+            int splitter = sample[sample.size() * t / workers];
+            for (int j = 0; j < K; ++j) cuts[j][t] = lowerBound(fds[j], runRecords[j], splitter, ok);
+        }
+        for (int fd : fds) {
+            if (fd >= 0) close(fd);
+        }
+        if (!ok) return 0;
+    }
+    std::vector<uint64_t> offsets(workers + 1, 0);
+    for (int j = 0; j < K; ++j) {
+        cuts[j][workers] = runRecords[j];
+        for (int t = 0; t <= workers; ++t) offsets[t] += cuts[j][t];
+    }
+    if (!preallocateFile(outputFile, records * sizeof(int))) return 0;
+
+    const size_t share = memBytes / workers, bufSize = bufferSizeFor(share);
+    const size_t readBufSize = mergeReadBufferSize(share, bufSize, K);
+    std::vector<std::unique_ptr<BufferPool>> pools;
+    for (int t = 0; t < workers; ++t) {
+        std::vector<size_t> sizes(K, readBufSize);
+        sizes.push_back(bufSize);
+        pools.push_back(std::make_unique<BufferPool>(sizes));
+    }
+    LOG_DEBUG("Final merge on " << workers << " workers.");
+
+    bool done = runWorkers(workers, [&](int t) {
+        BufferPool& pool = *pools[t];
+        Buffer& outBuf = pool.lease(bufSize);
+        std::vector<std::unique_ptr<FileReader>> readers;
+        std::vector<FileReader*> inputs;
+        for (int j = 0; j < K; ++j) {
+            IoStats* stats = j < static_cast<int>(inStats.size()) ? inStats[j] : nullptr;
+            readers.push_back(std::make_unique<FileReader>(runs[j], pool.lease(), stats));
+            if (!readers.back()->isOpen()) return false;
+            readers.back()->skip(cuts[j][t]);
+            readers.back()->limit(cuts[j][t + 1] - cuts[j][t]);
+            inputs.push_back(readers.back().get());
+        }
+        FileWriter out(outputFile, outBuf, offsets[t] * sizeof(int), outStats);
+        if (!out.isOpen()) return false;
+        out.setTransform(transform);
+        mergeRuns(inputs.data(), K, out);
+        out.close();
+        return out.bytesWritten() == (offsets[t + 1] - offsets[t]) * sizeof(int) && !out.failed();
+    });
+    return done ? workers : 0;
+}
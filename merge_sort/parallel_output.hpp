@@ -0,0 +1,42 @@
+#pragma once
+#include "io_utils.hpp"
+#include <string>
+#include <vector>
+#include <cstdint>
+
+// Parallel final-output stage. Once it is known how many records land in
+// each part of the output (the quick sort's partition sizes, or splitter
+// keys cut through the merge's sorted runs), the output is preallocated
+// and several workers fill disjoint byte ranges of it at once, each
+// through its own FileWriter positioned at its range's offset. One writer
+// stream cannot keep a fast device busy; several can.
+//
+// Buffers are charged to the memory governor before any worker starts,
+// so running out of memory throws in the caller, not in a worker.
+
+// True when outputFile can take positioned writes from `threads` (> 1)
+// workers: a regular or new file, not stdout or another stream.
+bool parallelOutput(const std::string& outputFile, int threads);
+
+// Creates or truncates `path` and reserves `bytes` for it (fallocate, or
+// just the length where the filesystem cannot preallocate). False if the
+// file cannot be created.
+bool preallocateFile(const std::string& path, uint64_t bytes);
+
+// Writes the `parts` back to back into outputFile through `transform`,
+// in equal slices copied by up to `threads` workers that share memBytes.
+// Sets `records` to the records written; false on an I/O failure.
+bool concatenateParallel(const std::vector<std::string>& parts, const std::string& outputFile, int threads,
+                         size_t memBytes, const BlockTransform& transform, uint64_t& records,
+                         const std::vector<IoStats*>& inStats = {}, IoStats* outStats = nullptr);
+
+// Merges the sorted `runs` into outputFile through `transform` with up to
+// `threads` workers that share memBytes. Splitter keys sampled from the
+// runs cut every run into one key range per worker, found by binary
+// search; worker t merges range t of every run into the output at the
+// offset where range t begins. Fewer workers run when a share of the
+// memory cannot hold a merge of every run (one worker is a plain merge).
+// Returns the workers used (0 on an I/O failure) and sets `records`.
+int mergeParallel(const std::vector<std::string>& runs, const std::string& outputFile, int threads,
+                  size_t memBytes, const BlockTransform& transform, uint64_t& records,
+                  const std::vector<IoStats*>& inStats = {}, IoStats* outStats = nullptr);
@@ -0,0 +1,101 @@
+#include "perf_counters.hpp"
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+
+namespace {
+
+struct EventSpec {
+    const char* name;
+    uint32_t type;
+    uint64_t config;
+};
+
+const EventSpec EVENTS[PerfCounters::EVENT_COUNT] = {
+    {"cycles", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+    {"instructions", PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+    {"l1d_misses", PERF_TYPE_HW_CACHE,
+     PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16)},
+    {"llc_misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES},
+    {"branch_misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+    {"context_switches", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CONTEXT_SWITCHES},
+};
+
+int openEvent(const EventSpec& spec, bool excludeKernel) {
+    perf_event_attr attr;
+    std::memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = spec.type;
+    attr.config = spec.config;
+    attr.inherit = 1;
+    attr.exclude_hv = 1;
+    attr.exclude_kernel = excludeKernel ? 1 : 0;
+    attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    return static_cast<int>(syscall(__NR_perf_event_open, &attr, 0, -1, -1, PERF_FLAG_FD_CLOEXEC));
+}
+
+} // namespace
+
+const char* PerfCounters::name(int event) {
+    return EVENTS[event].name;
+}
+
+PerfCounters::PerfCounters() : opened(false) {
+    for (int& fd : fds) fd = -1;
+}
+
+PerfCounters::~PerfCounters() {
+    for (int fd : fds) {
+        if (fd >= 0) close(fd);
+    }
+}
+
+bool PerfCounters::open() {
+    if (opened) return anyAvailable();
+    opened = true;
+    int firstError = 0;
+    for (int i = 0; i < EVENT_COUNT; ++i) {
+        // Kernel time matters (the sorts are I/O heavy), but counting it
+        // needs perf_event_paranoid <= 1; fall back to user space only.
+        bool userOnly = false;
+        fds[i] = openEvent(EVENTS[i], false);
+        if (fds[i] < 0 && (errno == EACCES || errno == EPERM)) {
+            userOnly = true;
+            fds[i] = openEvent(EVENTS[i], true);
+        }
+        if (fds[i] < 0) {
+            if (!firstError) firstError = errno;
+            continue;
+        }
+        if (!statusText.empty()) statusText += ",";
+        statusText += EVENTS[i].name;
+        if (userOnly) statusText += ":u";
+    }
+    if (!anyAvailable()) statusText = std::string("unavailable (") + std::strerror(firstError) + ")";
+    return anyAvailable();
+}
+
+bool PerfCounters::anyAvailable() const {
+    for (int fd : fds) {
+        if (fd >= 0) return true;
+    }
+    return false;
+}
+
+void PerfCounters::read(uint64_t values[EVENT_COUNT]) const {
+    for (int i = 0; i < EVENT_COUNT; ++i) {
+        values[i] = 0;
+        uint64_t data[3]; // value, time enabled, time running
+        if (fds[i] < 0 || ::read(fds[i], data, sizeof(data)) != static_cast<ssize_t>(sizeof(data))) continue;
+        if (data[2] == 0) continue;
+        values[i] = data[2] < data[1]
+            ? static_cast<uint64_t>(static_cast<double>(data[0]) * data[1] / data[2]) : data[0];
+    }
+}
+
+PerfCounters& perfCounters() {
+    static PerfCounters instance;
+    return instance;
+}
@@ -0,0 +1,43 @@
+#pragma once
+#include <string>
+#include <cstdint>
+
+// Hardware and software event counters for the whole process through
+// perf_event_open(2), read at phase boundaries by PhaseTimer. They are
+// opened once, before any worker thread exists, and inherited by every
+// thread started later. Events the kernel refuses (no PMU in a VM,
+// perf_event_paranoid, a seccomp filter in a container) are skipped and
+// read as 0; when kernel-mode counting is not allowed, the rest count
+// user space only.
+class PerfCounters {
+public:
+    enum Event { CYCLES, INSTRUCTIONS, L1D_MISSES, LLC_MISSES, BRANCH_MISSES, CONTEXT_SWITCHES, EVENT_COUNT };
+
+    // JSON name of an event, e.g. "branch_misses".
+    static const char* name(int event);
+
+    PerfCounters();
+    ~PerfCounters();
+    PerfCounters(const PerfCounters&) = delete;
+    PerfCounters& operator=(const PerfCounters&) = delete;
+
+    // Opens the counters on first call; false if none could be opened.
+    bool open();
+    bool available(int event) const { return fds[event] >= 0; }
+    bool anyAvailable() const;
+    // What was opened, e.g. "cycles:u,instructions:u,context_switches",
+    // or why nothing was.
+    const std::string& status() const { return statusText; }
+
+    // Totals so far, scaled up when the kernel multiplexed a counter;
+    // 0 for unavailable events.
+    void read(uint64_t values[EVENT_COUNT]) const;
+
+private:
+    int fds[EVENT_COUNT];
+    bool opened;
+    std::string statusText;
+};
+
+// The process-wide counters.
+PerfCounters& perfCounters();
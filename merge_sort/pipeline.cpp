@@ -0,0 +1,74 @@
+#include "pipeline.hpp"
+#include "metrics.hpp"
+#include "logger.hpp"
+#include <thread>
+#include <exception>
+#include <iomanip>
+#include <sstream>
+#include <algorithm>
+
+static thread_local Pipeline::Stage* currentStage = nullptr;
+
+void chargePipelineStall(bool input, double seconds) {
+    if (!currentStage) return;
+    (input ? currentStage->inputStallSeconds : currentStage->outputStallSeconds) += seconds;
+}
+
+void Pipeline::addStage(const std::string& name, std::function<void()> body) {
+    Stage stage;
+    stage.name = name;
+    stage.body = std::move(body);
+    stages.push_back(std::move(stage));
+}
+
+void Pipeline::run() {
+    std::mutex errorLock;
+    std::exception_ptr error;
+    std::vector<std::thread> threads;
+    for (Stage& stage : stages) {
+        threads.emplace_back([&, s = &stage] {
+            currentStage = s;
+            auto start = std::chrono::steady_clock::now();
+            try {
+                s->body();
+            } catch (...) {
+                LOG_DEBUG("Pipeline stage " << s->name << " failed; stopping the pipeline.");
+                {
+                    std::lock_guard<std::mutex> guard(errorLock);
+                    if (!error) error = std::current_exception();
+                }
+                for (ChannelBase* channel : channels) channel->close();
+            }
+            s->wallSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            currentStage = nullptr;
+        });
+    }
+    for (std::thread& t : threads) t.join();
+    if (error) std::rethrow_exception(error);
+}
+
+void Pipeline::report(std::ostream& out) const {
+    std::ios::fmtflags flags = out.flags();
+    std::streamsize precision = out.precision();
+    out << std::left << std::setw(12) << "Stage" << std::right << std::setw(10) << "Busy s"
+        << std::setw(14) << "Input stall" << std::setw(15) << "Output stall" << std::endl;
+    out << std::fixed << std::setprecision(3);
+    for (const Stage& s : stages) {
+        double busy = std::max(0.0, s.wallSeconds - s.inputStallSeconds - s.outputStallSeconds);
+        out << std::left << std::setw(12) << s.name << std::right << std::setw(10) << busy
+            << std::setw(14) << s.inputStallSeconds << std::setw(15) << s.outputStallSeconds << std::endl;
+        std::string key = "pipeline_" + s.name + "_";
+        metrics().count(key + "busy_us", static_cast<uint64_t>(busy * 1e6));
+        metrics().count(key + "input_stall_us", static_cast<uint64_t>(s.inputStallSeconds * 1e6));
+        metrics().count(key + "output_stall_us", static_cast<uint64_t>(s.outputStallSeconds * 1e6));
+    }
+    out << std::setprecision(2);
+    for (const ChannelBase* c : channels) {
+        out << "Channel " << c->name() << ": mean depth " << c->meanDepth() << std::endl;
+        std::ostringstream depth;
+        depth << std::fixed << std::setprecision(2) << c->meanDepth();
+        metrics().set("pipeline_" + c->name() + "_mean_depth", depth.str());
+    }
+    out.flags(flags);
+    out.precision(precision);
+}
@@ -0,0 +1,122 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <ostream>
+#include <cstdint>
+
+// Staged pipeline: every stage runs on its own thread and hands blocks to
+// the next through a bounded channel. A full channel blocks its producer
+// and an empty one its consumer, so a slow stage holds the others back
+// and the blocks in flight bound the memory. Time a stage spends blocked
+// on a channel is its input or output stall; the rest of its wall time is
+// busy. The stage the others stall on is the bottleneck.
+
+// Charges `seconds` of waiting to the stage running on this thread (none
+// outside Pipeline::run). Called by the channels.
+void chargePipelineStall(bool input, double seconds);
+
+// What every channel has in common: a name, closing, and depth statistics.
+class ChannelBase {
+public:
+    // A return path carries used blocks back upstream (a free list): waits
+    // on it count the other way round, a pop for more room downstream as
+    // an output stall.
+    ChannelBase(const std::string& name, size_t capacity, bool returnPath)
+        : label(name), capacity(capacity), returnPath(returnPath) {}
+    virtual ~ChannelBase() = default;
+    ChannelBase(const ChannelBase&) = delete;
+    ChannelBase& operator=(const ChannelBase&) = delete;
+
+    const std::string& name() const { return label; }
+    // Wakes every waiter: pushes fail from here on, pops drain what is left.
+    void close() {
+        std::lock_guard<std::mutex> guard(lock);
+        closed = true;
+        notFull.notify_all();
+        notEmpty.notify_all();
+    }
+    // Items queued right after each push, averaged: near the capacity the
+    // consumer is the slower side, near 1 the producer.
+    double meanDepth() const { return pushes ? static_cast<double>(depthSum) / pushes : 0.0; }
+
+protected:
+    // Blocks on cv until ready() holds, charging the wait to the caller.
+    template <typename Ready>
+    void waitUntil(std::unique_lock<std::mutex>& guard, std::condition_variable& cv, Ready ready, bool input) {
+        if (ready()) return;
+        auto start = std::chrono::steady_clock::now();
+        cv.wait(guard, ready);
+        auto waited = std::chrono::steady_clock::now() - start;
+        chargePipelineStall(input != returnPath, std::chrono::duration<double>(waited).count());
+    }
+
+    std::string label;
+    size_t capacity;
+    bool returnPath;
+    std::mutex lock;
+    std::condition_variable notFull, notEmpty;
+    bool closed = false;
+    uint64_t pushes = 0, depthSum = 0;
+};
+
+template <typename T>
+class BoundedChannel : public ChannelBase {
+public:
+    BoundedChannel(const std::string& name, size_t capacity, bool returnPath = false)
+        : ChannelBase(name, capacity, returnPath) {}
+
+    // Blocks while the channel is full; false if it is closed.
+    bool push(T item) {
+        std::unique_lock<std::mutex> guard(lock);
+        waitUntil(guard, notFull, [this] { return closed || items.size() < capacity; }, false);
+        if (closed) return false;
+        items.push_back(std::move(item));
+        pushes++;
+        depthSum += items.size();
+        notEmpty.notify_one();
+        return true;
+    }
+    // Blocks while the channel is empty; false once it is closed and empty.
+    bool pop(T& item) {
+        std::unique_lock<std::mutex> guard(lock);
+        waitUntil(guard, notEmpty, [this] { return closed || !items.empty(); }, true);
+        if (items.empty()) return false;
+        item = std::move(items.front());
+        items.pop_front();
+        notFull.notify_one();
+        return true;
+    }
+
+private:
+    std::deque<T> items;
+};
+
+class Pipeline {
+public:
+    // Channels the stages use; all of them are closed when a stage fails,
+    // so no other stage stays blocked.
+    void connect(ChannelBase& channel) { channels.push_back(&channel); }
+    // A stage closes the channels it produces into when it is done.
+    void addStage(const std::string& name, std::function<void()> body);
+    // Runs every stage on its own thread and waits for all of them;
+    // rethrows the first exception a stage threw.
+    void run();
+    // Busy and stall seconds per stage and mean depth per channel, as a
+    // table on `out` and as pipeline_* metrics.
+    void report(std::ostream& out) const;
+
+    struct Stage {
+        std::string name;
+        std::function<void()> body;
+        double wallSeconds = 0, inputStallSeconds = 0, outputStallSeconds = 0;
+    };
+
+private:
+    std::vector<Stage> stages;
+    std::vector<ChannelBase*> channels;
+};
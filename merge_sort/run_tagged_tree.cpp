@@ -0,0 +1,38 @@
+#include "run_tagged_tree.hpp"
+
+// Slot s is leaf s + slots; internal node j has children 2j and 2j + 1.
+RunTaggedTree::RunTaggedTree(size_t capacity)
+    : slots(std::max<size_t>(capacity, 1)), loaded(0), keys(slots, EMPTY), losers(slots, 0) {}
+
+void RunTaggedTree::build() {
+    std::fill(keys.begin() + loaded, keys.end(), EMPTY);
+    auto winnerOf = [&](size_t node) { return node >= slots ? static_cast<uint32_t>(node - slots) : losers[node]; };
+    // Bottom-up, store each node's winner; then top-down, replace it by the
+    // loser of the match played there (children still hold their winners).
+    for (size_t j = slots - 1; j >= 1; --j) {
+        uint32_t a = winnerOf(2 * j), b = winnerOf(2 * j + 1);
+        losers[j] = keys[a] <= keys[b] ? a : b;
+    }
+    losers[0] = slots > 1 ? losers[1] : 0;
+    for (size_t j = 1; j < slots; ++j) {
+        uint32_t a = winnerOf(2 * j), b = winnerOf(2 * j + 1);
+        losers[j] = losers[j] == a ? b : a;
+    }
+}
+
+void RunTaggedTree::replay(uint64_t value) {
+    uint32_t current = winner();
+    keys[current] = value;
+    // Climb to the root carrying the current winner's key, swapping with
+    // any stored loser that beats it.
+    for (size_t node = (current + slots) / 2; node >= 1; node /= 2) {
+        uint32_t other = losers[node];
+        uint64_t otherKey = keys[other];
+        if (otherKey < value) {
+            losers[node] = current;
+            current = other;
+            value = otherKey;
+        }
+    }
+    losers[0] = current;
+}
@@ -0,0 +1,57 @@
+#pragma once
+#include "memory_governor.hpp"
+#include <cstdint>
+#include <cstddef>
+#include <algorithm>
+
+// Replacement-selection tree for run generation. Every key carries the
+// number of the run it belongs to and keys compare as (run, key), so
+// records held back for the next run stay in the tree and a run ends
+// simply when the winner's run number changes; there is no rebuild and no
+// sentinel key value. Internally a loser tree over 64-bit composites.
+class RunTaggedTree {
+public:
+    explicit RunTaggedTree(size_t capacity);
+
+    // Loading: add() up to capacity keys for run 0, then build().
+    void add(int key) { keys[loaded++] = tag(0, key); }
+    void build();
+    size_t size() const { return loaded; }
+    size_t capacity() const { return slots; }
+
+    bool empty() const { return keys[winner()] == EMPTY; }
+    int minKey() const { return static_cast<int>(static_cast<uint32_t>(keys[winner()]) ^ SIGN); }
+    uint32_t minRun() const { return static_cast<uint32_t>(keys[winner()] >> 32); }
+
+    // Replaces the winner with `key` tagged for `run` (at least minRun()).
+    void replaceMin(int key, uint32_t run) { replay(tag(run, key)); }
+    // Drops the winner (no more input to replace it with).
+    void removeMin() { replay(EMPTY); }
+
+    // Calls fn(key) for every key still in the tree, in slot order.
+    template <typename Fn>
+    void forEachKey(Fn fn) const {
+        for (size_t i = 0; i < loaded; ++i) {
+            if (keys[i] != EMPTY) fn(static_cast<int>(static_cast<uint32_t>(keys[i]) ^ SIGN));
+        }
+    }
+    // Sorts the loaded keys in place; the tree is unusable afterwards
+    // except through forEachKey, which then visits them in order.
+    void sortKeys() { std::sort(keys.begin(), keys.begin() + loaded); }
+
+    // Bytes allocated per slot.
+    static size_t bytesPerKey() { return sizeof(uint64_t) + sizeof(uint32_t); }
+
+private:
+    static constexpr uint64_t EMPTY = UINT64_MAX;
+    static constexpr uint32_t SIGN = 0x80000000u;
+    static uint64_t tag(uint32_t run, int key) {
+        return (static_cast<uint64_t>(run) << 32) | (static_cast<uint32_t>(key) ^ SIGN);
+    }
+    uint32_t winner() const { return losers[0]; }
+    void replay(uint64_t value);
+
+    size_t slots, loaded;
+    TrackedVector<uint64_t> keys;  // per slot
+    TrackedVector<uint32_t> losers; // losers[0] is the winner's slot
+};
@@ -0,0 +1,177 @@
+#include "simd_merge.hpp"
+#include <immintrin.h>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#define TARGET_AVX512 __attribute__((target("avx512f")))
+
+// The vector loop keeps the W largest keys loaded so far in a register and
+// stops with them unwritten. Those are the largest of what was loaded from
+// both inputs, so the records actually written are a prefix of each input;
+// this finds how many came from `a` (a merge-path split of the loaded
+// ranges) so both pointers can be set back to the first unwritten record.
+static size_t splitWritten(const int* a, size_t loadedA, const int* b, size_t loadedB, size_t written) {
+    size_t lo = written > loadedB ? written - loadedB : 0;
+    size_t hi = written < loadedA ? written : loadedA;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (a[mid] < b[written - mid - 1]) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo;
+}
+
+// ---- AVX2: 8 x int32 ----
+
+// Sorts a bitonic sequence: compare-exchange at distance 4, 2, 1.
+TARGET_AVX2 static inline __m256i bitonicSort8(__m256i v) {
+    __m256i p = _mm256_permute2x128_si256(v, v, 0x01);
+    v = _mm256_blend_epi32(_mm256_min_epi32(v, p), _mm256_max_epi32(v, p), 0xF0);
+    p = _mm256_shuffle_epi32(v, _MM_SHUFFLE(1, 0, 3, 2));
+    v = _mm256_blend_epi32(_mm256_min_epi32(v, p), _mm256_max_epi32(v, p), 0xCC);
+    p = _mm256_shuffle_epi32(v, _MM_SHUFFLE(2, 3, 0, 1));
+    return _mm256_blend_epi32(_mm256_min_epi32(v, p), _mm256_max_epi32(v, p), 0xAA);
+}
+
+// lo and hi sorted in, the 8 smallest (lo) and 8 largest (hi) sorted out.
+TARGET_AVX2 static inline void merge8(__m256i& lo, __m256i& hi) {
+    __m256i rev = _mm256_permutevar8x32_epi32(hi, _mm256_setr_epi32(7, 6, 5, 4, 3, 2, 1, 0));
+    __m256i l = _mm256_min_epi32(lo, rev);
+    __m256i h = _mm256_max_epi32(lo, rev);
+    lo = bitonicSort8(l);
+    hi = bitonicSort8(h);
+}
+
+TARGET_AVX2 static size_t mergeBlockAvx2(const int*& a, const int* aEnd, const int*& b, const int* bEnd,
+                                         int* dst, size_t room) {
+    const size_t W = 8;
+    const int* pa = a;
+    const int* pb = b;
+    if (static_cast<size_t>(aEnd - pa) < W || static_cast<size_t>(bEnd - pb) < W || room < W) return 0;
+    __m256i lo = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(pa));
+    __m256i hi = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(pb));
+    pa += W;
+    pb += W;
+    merge8(lo, hi);
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst), lo);
+    size_t n = W;
+    while (n + W <= room && static_cast<size_t>(aEnd - pa) >= W && static_cast<size_t>(bEnd - pb) >= W) {
+        bool takeA = *pa <= *pb;
+        const int* src = takeA ? pa : pb;
+        pa += takeA ? W : 0;
+        pb += takeA ? 0 : W;
+        lo = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src));
+        merge8(lo, hi);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + n), lo);
+        n += W;
+    }
+    size_t fromA = splitWritten(a, pa - a, b, pb - b, n);
+    a += fromA;
+    b += n - fromA;
+    return n;
+}
+
+// ---- AVX-512: 16 x int32 ----
+
+TARGET_AVX512 static inline __m512i minMax16(__m512i v, __m512i p, __mmask16 takeMax) {
+    return _mm512_mask_blend_epi32(takeMax, _mm512_min_epi32(v, p), _mm512_max_epi32(v, p));
+}
+
+// Sorts a bitonic sequence: compare-exchange at distance 8, 4, 2, 1.
+TARGET_AVX512 static inline __m512i bitonicSort16(__m512i v) {
+    v = minMax16(v, _mm512_shuffle_i32x4(v, v, _MM_SHUFFLE(1, 0, 3, 2)), 0xFF00);
+    v = minMax16(v, _mm512_shuffle_i32x4(v, v, _MM_SHUFFLE(2, 3, 0, 1)), 0xF0F0);
+    v = minMax16(v, _mm512_shuffle_epi32(v, _MM_PERM_BADC), 0xCCCC);
+    return minMax16(v, _mm512_shuffle_epi32(v, _MM_PERM_CDAB), 0xAAAA);
+}
+
+TARGET_AVX512 static inline void merge16(__m512i& lo, __m512i& hi) {
+    __m512i rev = _mm512_permutexvar_epi32(
+        _mm512_setr_epi32(15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0), hi);
+    __m512i l = _mm512_min_epi32(lo, rev);
+    __m512i h = _mm512_max_epi32(lo, rev);
+    lo = bitonicSort16(l);
+    hi = bitonicSort16(h);
+}
+
+TARGET_AVX512 static size_t mergeBlockAvx512(const int*& a, const int* aEnd, const int*& b, const int* bEnd,
+                                             int* dst, size_t room) {
+    const size_t W = 16;
+    const int* pa = a;
+    const int* pb = b;
+    if (static_cast<size_t>(aEnd - pa) < W || static_cast<size_t>(bEnd - pb) < W || room < W) return 0;
+    __m512i lo = _mm512_loadu_si512(pa);
+    __m512i hi = _mm512_loadu_si512(pb);
+    pa += W;
+    pb += W;
+    merge16(lo, hi);
+    _mm512_storeu_si512(dst, lo);
+    size_t n = W;
+    while (n + W <= room && static_cast<size_t>(aEnd - pa) >= W && static_cast<size_t>(bEnd - pb) >= W) {
+        bool takeA = *pa <= *pb;
+        const int* src = takeA ? pa : pb;
+        pa += takeA ? W : 0;
+        pb += takeA ? 0 : W;
+        lo = _mm512_loadu_si512(src);
+        merge16(lo, hi);
+        _mm512_storeu_si512(dst + n, lo);
+        n += W;
+    }
+    size_t fromA = splitWritten(a, pa - a, b, pb - b, n);
+    a += fromA;
+    b += n - fromA;
+    return n;
+}
+
+// ---- Dispatch ----
+
+SimdLevel detectSimdLevel() {
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f")) return SimdLevel::AVX512;
+    if (__builtin_cpu_supports("avx2")) return SimdLevel::AVX2;
+    return SimdLevel::None;
+}
+
+static SimdLevel g_simd_level = detectSimdLevel();
+
+SimdLevel simdLevel() {
+    return g_simd_level;
+}
+
+void setSimdLevel(SimdLevel level) {
+    SimdLevel best = detectSimdLevel();
+    g_simd_level = static_cast<int>(level) < static_cast<int>(best) ? level : best;
+}
+
+const char* simdLevelName(SimdLevel level) {
+    switch (level) {
+    case SimdLevel::AVX512: return "avx512";
+    case SimdLevel::AVX2: return "avx2";
+    default: return "none";
+    }
+}
+
+SimdLevel parseSimdLevel(const char* text) {
+    if (std::strcmp(text, "none") == 0) return SimdLevel::None;
+    if (std::strcmp(text, "avx2") == 0) return SimdLevel::AVX2;
+    if (std::strcmp(text, "avx512") == 0) return SimdLevel::AVX512;
+    throw std::invalid_argument(std::string("Unknown SIMD level '") + text + "' (expected none, avx2 or avx512)");
+}
+
+size_t simdWidth() {
+    switch (g_simd_level) {
+    case SimdLevel::AVX512: return 16;
+    case SimdLevel::AVX2: return 8;
+    default: return 1;
+    }
+}
+
+size_t simdMergeBlock(const int*& a, const int* aEnd, const int*& b, const int* bEnd, int* dst, size_t room) {
+    switch (g_simd_level) {
+    case SimdLevel::AVX512: return mergeBlockAvx512(a, aEnd, b, bEnd, dst, room);
+    case SimdLevel::AVX2: return mergeBlockAvx2(a, aEnd, b, bEnd, dst, room);
+    default: return 0;
+    }
+}
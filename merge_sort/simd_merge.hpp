@@ -0,0 +1,30 @@
+#pragma once
+#include <cstddef>
+
+// Vectorized two-way merge of sorted int blocks: a bitonic merge network
+// over AVX2 (8 keys) or AVX-512 (16 keys) registers, picked at run time
+// from what the CPU supports. The binary is built for the baseline ISA;
+// only the functions in simd_merge.cpp are compiled for the wider targets.
+
+enum class SimdLevel { None, AVX2, AVX512 };
+
+// Best level this CPU supports.
+SimdLevel detectSimdLevel();
+// Level simdMergeBlock() currently uses; starts at detectSimdLevel().
+SimdLevel simdLevel();
+// Lowers (or restores) the level in use, clamped to what the CPU supports.
+void setSimdLevel(SimdLevel level);
+const char* simdLevelName(SimdLevel level);
+// Parses "none", "avx2" or "avx512"; throws std::invalid_argument.
+SimdLevel parseSimdLevel(const char* text);
+
+// Records per vector at the current level (1 when SIMD is off).
+size_t simdWidth();
+
+// Merges the sorted ranges [a, aEnd) and [b, bEnd) into dst for as long as
+// both still hold a full vector and dst has room. Advances a and b past
+// exactly the records written and returns how many that is; 0 means the
+// caller has to take the next step itself (too little input or room, or
+// SIMD is off).
+size_t simdMergeBlock(const int*& a, const int* aEnd, const int*& b, const int* bEnd,
+                      int* dst, size_t room);
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <cstdint>
+
+// Settings shared by both engines beyond the classic
+// (input, output, memory limit, fan-in/buffer sizes) arguments.
+struct SortOptions {
+    bool checkpoint = false;           // keep a durable manifest
+    bool resume = false;               // continue from an existing manifest
+    std::vector<std::string> tmpDirs;  // where temp files go (default: cwd)
+    std::string tmpPolicy = "rr";      // rr | space | bandwidth
+    std::string metricsOut;            // JSON metrics file (empty: off)
+    int threads = 1;                   // run generation workers, spread over NUMA nodes
+    std::string keySpec;               // column sort order (key_spec.hpp); empty: signed int
+    std::string tmpPrefix;             // prepended to temp file names
+    std::string indexFile;             // sparse index of the output (sparse_index.hpp); empty: none
+    uint32_t indexStride = 4096;       // records per index block
+    bool pipeline = false;             // staged run generation (pipeline.hpp)
+};
+
+// Removes `flag` from args; true if it was present.
+inline bool takeFlag(std::vector<std::string>& args, const std::string& flag) {
+    auto it = std::find(args.begin(), args.end(), flag);
+    if (it == args.end()) return false;
+    args.erase(it);
+    return true;
+}
+
+// Removes every "flag value" pair from args, appending the values.
+inline bool takeOption(std::vector<std::string>& args, const std::string& flag, std::vector<std::string>& values) {
+    bool found = false;
+    auto it = std::find(args.begin(), args.end(), flag);
+    while (it != args.end() && it + 1 != args.end()) {
+        values.push_back(*(it + 1));
+        it = args.erase(it, it + 2);
+        it = std::find(it, args.end(), flag);
+        found = true;
+    }
+    return found;
+}
+
+inline bool takeOption(std::vector<std::string>& args, const std::string& flag, std::string& value) {
+    std::vector<std::string> values;
+    if (!takeOption(args, flag, values)) return false;
+    value = values.back();
+    return true;
+}
+
+// Splits "a,b,c" into its comma-separated parts.
+inline std::vector<std::string> splitList(const std::string& text) {
+    std::vector<std::string> parts;
+    size_t start = 0;
+    while (start <= text.size()) {
+        size_t comma = text.find(',', start);
+        if (comma == std::string::npos) comma = text.size();
+        if (comma > start) parts.push_back(text.substr(start, comma - start));
+        start = comma + 1;
+    }
+    return parts;
+}
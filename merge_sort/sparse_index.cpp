@@ -0,0 +1,124 @@
+#include "sparse_index.hpp"
+#include "logger.hpp"
+#include <iostream>
+#include <algorithm>
+#include <stdexcept>
+#include <cstring>
+
+static const char INDEX_MAGIC[8] = {'X', 'S', 'I', 'D', 'X', '0', '0', '1'};
+
+static bool writeHeader(std::FILE* file, uint32_t stride, const std::string& spec, uint64_t records) {
+    uint32_t specLength = static_cast<uint32_t>(spec.size());
+    return std::fwrite(INDEX_MAGIC, sizeof(INDEX_MAGIC), 1, file) == 1
+        && std::fwrite(&stride, sizeof(stride), 1, file) == 1
+        && std::fwrite(&specLength, sizeof(specLength), 1, file) == 1
+        && std::fwrite(&records, sizeof(records), 1, file) == 1
+        && std::fwrite(spec.data(), 1, spec.size(), file) == spec.size();
+}
+
+SparseIndexWriter::SparseIndexWriter(const std::string& path, const KeySpec& keys, uint32_t stride)
+    : file(std::fopen(path.c_str(), "wb")), path(path), spec(keys.describe()), stride(std::max<uint32_t>(stride, 1)) {
+    if (!file) {
+        LOG_DEBUG("Error opening index file for writing: " << path);
+        return;
+    }
+    // Placeholder; close() rewrites it with the final record count.
+    ok = writeHeader(file, this->stride, spec, 0);
+}
+
+SparseIndexWriter::~SparseIndexWriter() {
+    close();
+}
+
+void SparseIndexWriter::add(const int* data, size_t count) {
+    if (!file) return;
+    size_t i = 0;
+    while (i < count) {
+        uint64_t pos = records % stride;
+        if (pos == 0) {
+            if (filling) {
+                ok = ok && std::fwrite(&current, sizeof(current), 1, file) == 1;
+                written++;
+            }
+            current = {data[i], data[i], records * sizeof(int)};
+            filling = true;
+        }
+        size_t n = static_cast<size_t>(std::min<uint64_t>(count - i, stride - pos));
+        current.last = data[i + n - 1];
+        records += n;
+        i += n;
+    }
+}
+
+bool SparseIndexWriter::close() {
+    if (!file) return ok;
+    if (filling) {
+        ok = ok && std::fwrite(&current, sizeof(current), 1, file) == 1;
+        written++;
+        filling = false;
+    }
+    ok = ok && std::fseek(file, 0, SEEK_SET) == 0 && writeHeader(file, stride, spec, records);
+    ok = std::fclose(file) == 0 && ok;
+    file = nullptr;
+    if (!ok) std::cerr << "Failed to write index file " << path << std::endl;
+    return ok;
+}
+
+bool indexSortedFile(const std::string& dataFile, Buffer& buffer, SparseIndexWriter& index) {
+    FileReader reader(dataFile, buffer);
+    if (!reader.isOpen()) return false;
+    const int* block;
+    while (size_t n = reader.nextBlock(block)) index.add(block, n);
+    reader.close();
+    return true;
+}
+
+bool SparseIndex::load(const std::string& path) {
+    std::FILE* file = std::fopen(path.c_str(), "rb");
+    if (!file) {
+        std::cerr << "Error opening index file: " << path << std::endl;
+        return false;
+    }
+    char magic[sizeof(INDEX_MAGIC)];
+    uint32_t specLength = 0;
+    bool ok = std::fread(magic, sizeof(magic), 1, file) == 1
+           && std::memcmp(magic, INDEX_MAGIC, sizeof(magic)) == 0
+           && std::fread(&blockRecords, sizeof(blockRecords), 1, file) == 1 && blockRecords > 0
+           && std::fread(&specLength, sizeof(specLength), 1, file) == 1 && specLength < 4096
+           && std::fread(&total, sizeof(total), 1, file) == 1;
+    std::string text(ok ? specLength : 0, '\0');
+    ok = ok && std::fread(&text[0], 1, text.size(), file) == text.size();
+    if (ok) {
+        try {
+            spec = KeySpec::parse(text);
+        } catch (const std::invalid_argument&) {
+            ok = false;
+        }
+    }
+    blocks.resize(ok ? (total + blockRecords - 1) / blockRecords : 0);
+    ok = ok && std::fread(blocks.data(), sizeof(IndexEntry), blocks.size(), file) == blocks.size();
+    std::fclose(file);
+    if (!ok) {
+        std::cerr << "Not a valid sparse index: " << path << std::endl;
+        blocks.clear();
+    }
+    return ok;
+}
+
+void SparseIndex::span(int lo, int hi, uint64_t& begin, uint64_t& end) const {
+    begin = end = 0;
+    const int low = spec.encode(lo), high = spec.encode(hi);
+    if (low > high || blocks.empty()) return;
+    // Blocks are in key order and do not overlap: the candidates run from
+    // the first block ending at or after lo to the last starting at or
+    // before hi.
+    auto first = std::partition_point(blocks.begin(), blocks.end(),
+                                      [&](const IndexEntry& e) { return spec.encode(e.last) < low; });
+    auto last = std::partition_point(first, blocks.end(),
+                                     [&](const IndexEntry& e) { return spec.encode(e.first) <= high; });
+    if (first == last) return;
+    uint64_t lastBlock = static_cast<uint64_t>(last - blocks.begin()) - 1;
+    uint64_t lastRecords = std::min<uint64_t>(blockRecords, total - lastBlock * blockRecords);
+    begin = first->offset;
+    end = (last - 1)->offset + lastRecords * sizeof(int);
+}
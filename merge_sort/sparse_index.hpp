@@ -0,0 +1,75 @@
+#pragma once
+#include "io_utils.hpp"
+#include "key_spec.hpp"
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+// Sparse index sidecar for a sorted output: for every block of `stride`
+// records, the block's first and last record and its byte offset. The
+// engines build it from the blocks their final pass writes (O(1) work per
+// index block, no extra reads), so a consumer can answer a point or range
+// query with one index load and one pread of the data file.
+//
+// File layout (native byte order):
+//   "XSIDX001", uint32 stride, uint32 spec length, uint64 records,
+//   the key spec text (key_spec.hpp; blocks are in its order),
+//   then one IndexEntry per block.
+struct IndexEntry {
+    int32_t first, last;
+    uint64_t offset;
+};
+
+class SparseIndexWriter {
+public:
+    // Entries stream straight to `path`; nothing accumulates in memory.
+    SparseIndexWriter(const std::string& path, const KeySpec& keys, uint32_t stride);
+    ~SparseIndexWriter();
+    SparseIndexWriter(const SparseIndexWriter&) = delete;
+    SparseIndexWriter& operator=(const SparseIndexWriter&) = delete;
+
+    bool isOpen() const { return file != nullptr; }
+    // Records in output order, exactly as they land in the data file.
+    void add(const int* records, size_t count);
+    // For FileWriter::setObserver.
+    BlockSink observer() {
+        return [this](const int* records, size_t count) { add(records, count); };
+    }
+    // Writes the last entry and the final header; false on an I/O error.
+    bool close();
+    uint64_t entries() const { return written + (filling ? 1 : 0); }
+
+private:
+    std::FILE* file;
+    std::string path;
+    std::string spec;
+    uint32_t stride;
+    uint64_t records = 0, written = 0;
+    IndexEntry current{};
+    bool filling = false; // current holds a block still being filled
+    bool ok = true;
+};
+
+// Indexes an existing sorted file by reading it once through `buffer`
+// (for outputs that were moved into place rather than written).
+bool indexSortedFile(const std::string& dataFile, Buffer& buffer, SparseIndexWriter& index);
+
+class SparseIndex {
+public:
+    // Reads the whole index; false (after a message) if it is not one.
+    bool load(const std::string& path);
+    const KeySpec& keys() const { return spec; }
+    uint64_t records() const { return total; }
+    uint32_t stride() const { return blockRecords; }
+    const std::vector<IndexEntry>& entries() const { return blocks; }
+    // Byte range [begin, end) of the data file holding every record whose
+    // key lies between lo's and hi's (inclusive); empty if none can.
+    void span(int lo, int hi, uint64_t& begin, uint64_t& end) const;
+
+private:
+    KeySpec spec;
+    uint32_t blockRecords = 0;
+    uint64_t total = 0;
+    std::vector<IndexEntry> blocks;
+};
@@ -0,0 +1,206 @@
+#include "temp_dirs.hpp"
+#include "metrics.hpp"
+#include "logger.hpp"
+#include <iostream>
+#include <iomanip>
+#include <stdexcept>
+#include <limits>
+#include <algorithm>
+#include <sys/stat.h>
+#include <sys/statvfs.h>
+#include <sys/sysmacros.h>
+#include <unistd.h>
+
+TempDirs::TempDirs(const std::vector<std::string>& dirs, Policy policy, const std::string& namePrefix)
+    : policy(policy), rotation(0), prefix(namePrefix) {
+    std::vector<std::string> list = dirs.empty() ? std::vector<std::string>{"."} : dirs;
+    for (const std::string& dir : list) {
+        struct stat st;
+        if (stat(dir.c_str(), &st) != 0 || !S_ISDIR(st.st_mode) || access(dir.c_str(), W_OK) != 0) {
+            std::cerr << "Warning: temp directory " << dir << " is not usable, skipping." << std::endl;
+            continue;
+        }
+        auto it = std::find_if(devices.begin(), devices.end(),
+                               [&](const Device& d) { return d.id == st.st_dev; });
+        if (it == devices.end()) {
+            devices.push_back({st.st_dev, {dir}, 0, IoStats()});
+        } else {
+            it->dirs.push_back(dir);
+        }
+    }
+    if (devices.empty()) {
+        struct stat st;
+        stat(".", &st);
+        devices.push_back({st.st_dev, {"."}, 0, IoStats()});
+    }
+}
+
+TempDirs::Policy TempDirs::parsePolicy(const std::string& name) {
+    if (name == "rr" || name == "round-robin") return Policy::RoundRobin;
+    if (name == "space") return Policy::FreeSpace;
+    if (name == "bandwidth") return Policy::Bandwidth;
+    throw std::invalid_argument("unknown temp placement policy: " + name);
+}
+
+size_t TempDirs::pickDevice(const std::vector<size_t>& avoid) {
+    std::vector<size_t> candidates;
+    for (size_t i = 0; i < devices.size(); ++i) {
+        if (std::find(avoid.begin(), avoid.end(), i) == avoid.end()) candidates.push_back(i);
+    }
+    if (candidates.empty()) {
+        for (size_t i = 0; i < devices.size(); ++i) candidates.push_back(i);
+    }
+
+    switch (policy) {
+    case Policy::FreeSpace: {
+        size_t best = candidates[0];
+        unsigned long long bestFree = 0;
+        for (size_t i : candidates) {
+            struct statvfs vfs;
+            if (statvfs(devices[i].dirs[0].c_str(), &vfs) != 0) continue;
+            unsigned long long freeBytes = static_cast<unsigned long long>(vfs.f_bavail) * vfs.f_frsize;
+            if (freeBytes > bestFree) {
+                bestFree = freeBytes;
+                best = i;
+            }
+        }
+        return best;
+    }
+    case Policy::Bandwidth: {
+        // The device that has spent the least time on I/O so far is the one
+        // with the most spare bandwidth; untouched devices come first.
+        size_t best = candidates[0];
+        double bestTime = std::numeric_limits<double>::max();
+        for (size_t i : candidates) {
+            const IoStats& s = devices[i].stats;
+            double busy = s.write_seconds + s.read_seconds;
+            if (busy < bestTime) {
+                bestTime = busy;
+                best = i;
+            }
+        }
+        return best;
+    }
+    case Policy::RoundRobin:
+    default:
+        for (size_t step = 0; step < devices.size(); ++step) {
+            size_t i = (rotation + step) % devices.size();
+            if (std::find(candidates.begin(), candidates.end(), i) != candidates.end()) {
+                rotation = i + 1;
+                return i;
+            }
+        }
+        return candidates[0];
+    }
+}
+
+std::string TempDirs::place(const std::string& name, const std::vector<size_t>& avoidDevices) {
+    Device& dev = devices[pickDevice(avoidDevices)];
+    const std::string& dir = dev.dirs[dev.nextDir++ % dev.dirs.size()];
+    return dir == "." ? prefix + name : dir + "/" + prefix + name;
+}
+
+size_t TempDirs::deviceOf(const std::string& path) const {
+    struct stat st;
+    if (stat(path.c_str(), &st) == 0) {
+        for (size_t i = 0; i < devices.size(); ++i) {
+            if (devices[i].id == st.st_dev) return i;
+        }
+    }
+    return 0;
+}
+
+size_t TempDirs::deviceCount() const {
+    return devices.size();
+}
+
+std::string TempDirs::dirPath(const std::string& name) const {
+    const std::string& dir = devices[0].dirs[0];
+    return dir == "." ? prefix + name : dir + "/" + prefix + name;
+}
+
+std::vector<size_t> TempDirs::nextMergeGroup(const std::vector<std::string>& runs, int k,
+                                             std::vector<size_t>& avoidForOutput) {
+    std::vector<size_t> group;
+    avoidForOutput.clear();
+    if (devices.size() < 2) {
+        for (size_t i = 0; i < runs.size() && static_cast<int>(group.size()) < k; ++i) group.push_back(i);
+        return group;
+    }
+
+    std::vector<size_t> runDevice(runs.size());
+    for (size_t i = 0; i < runs.size(); ++i) runDevice[i] = deviceOf(runs[i]);
+
+    // Reserve the policy's next device for the output and read only from the
+    // others, taking runs from each remaining device in turn so reads are
+    // spread as evenly as the run placement allows.
+    size_t target = pickDevice({});
+    std::vector<std::vector<size_t>> byDevice(devices.size());
+    for (size_t i = 0; i < runs.size(); ++i) {
+        if (runDevice[i] != target) byDevice[runDevice[i]].push_back(i);
+    }
+    std::vector<size_t> cursor(devices.size(), 0);
+    bool took = true;
+    while (static_cast<int>(group.size()) < k && took) {
+        took = false;
+        for (size_t d = 0; d < devices.size() && static_cast<int>(group.size()) < k; ++d) {
+            if (cursor[d] < byDevice[d].size()) {
+                group.push_back(byDevice[d][cursor[d]++]);
+                took = true;
+            }
+        }
+    }
+    // Everything left lives on the target device: merge it anyway.
+    if (group.empty()) {
+        for (size_t i = 0; i < runs.size() && static_cast<int>(group.size()) < k; ++i) group.push_back(i);
+    }
+
+    for (size_t i : group) {
+        if (std::find(avoidForOutput.begin(), avoidForOutput.end(), runDevice[i]) == avoidForOutput.end()) {
+            avoidForOutput.push_back(runDevice[i]);
+        }
+    }
+    std::sort(group.begin(), group.end());
+    return group;
+}
+
+IoStats* TempDirs::statsFor(const std::string& path) {
+    // Files about to be created are attributed through their directory.
+    struct stat st;
+    size_t slash = path.find_last_of('/');
+    std::string dir = slash == std::string::npos ? "." : path.substr(0, slash);
+    if (isStdStream(path) || (stat(path.c_str(), &st) != 0 && stat(dir.c_str(), &st) != 0)) {
+        return nullptr;
+    }
+    for (Device& d : devices) {
+        if (d.id == st.st_dev) return &d.stats;
+    }
+    return nullptr;
+}
+
+void TempDirs::report(std::ostream& out) const {
+    auto rate = [](uint64_t bytes, double seconds) {
+        return seconds > 0 ? bytes / seconds / (1024.0 * 1024.0) : 0.0;
+    };
+    std::ios::fmtflags flags = out.flags();
+    std::streamsize precision = out.precision();
+    out << "Temp device throughput:" << std::endl;
+    for (const Device& d : devices) {
+        out << "  device " << major(d.id) << ":" << minor(d.id) << " (";
+        for (size_t i = 0; i < d.dirs.size(); ++i) out << (i ? ", " : "") << d.dirs[i];
+        out << ") read " << d.stats.bytes_read / (1024 * 1024) << " MB @ "
+            << std::fixed << std::setprecision(1) << rate(d.stats.bytes_read, d.stats.read_seconds)
+            << " MB/s, wrote " << d.stats.bytes_written / (1024 * 1024) << " MB @ "
+            << rate(d.stats.bytes_written, d.stats.write_seconds) << " MB/s" << std::endl;
+    }
+    out.flags(flags);
+    out.precision(precision);
+}
+
+void TempDirs::recordMetrics() const {
+    for (const Device& d : devices) {
+        std::string label = std::to_string(major(d.id)) + ":" + std::to_string(minor(d.id));
+        for (size_t i = 0; i < d.dirs.size(); ++i) label += (i ? "," : " ") + d.dirs[i];
+        metrics().addDevice(label, d.stats);
+    }
+}
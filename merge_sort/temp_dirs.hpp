@@ -0,0 +1,61 @@
+#pragma once
+
+#include "io_utils.hpp"
+#include <string>
+#include <vector>
+#include <ostream>
+#include <sys/types.h>
+
+// Set of directories that temporary runs/partitions are spread across.
+// Directories on the same filesystem share a device entry, so placement and
+// throughput reporting work per device rather than per path.
+class TempDirs {
+public:
+    enum class Policy {
+        RoundRobin, // rotate through devices
+        FreeSpace,  // device with the most free bytes
+        Bandwidth   // device with the least projected busy time
+    };
+
+    // namePrefix is prepended to every file name, so several sorts can
+    // share the directories. Directories that do not exist or are not
+    // writable are skipped with a warning; without any, "." is used.
+    explicit TempDirs(const std::vector<std::string>& dirs = {}, Policy policy = Policy::RoundRobin,
+                      const std::string& namePrefix = "");
+
+    // Path for a new temp file, avoiding the given devices when possible.
+    std::string place(const std::string& name, const std::vector<size_t>& avoidDevices = {});
+    // Device index for a path created by place(); 0 if unknown.
+    size_t deviceOf(const std::string& path) const;
+    size_t deviceCount() const;
+    std::string dirPath(const std::string& name) const; // file in the first directory
+
+    // Picks the next merge group from `runs` (at most k entries). With two or
+    // more devices one device is kept free of the group's inputs; the devices
+    // the group does read from are returned in avoidForOutput so place() puts
+    // the merged run elsewhere. Returns indices into `runs`.
+    std::vector<size_t> nextMergeGroup(const std::vector<std::string>& runs, int k,
+                                       std::vector<size_t>& avoidForOutput);
+
+    // Per-device counters handed to FileReader/FileWriter.
+    IoStats* statsFor(const std::string& path);
+    void report(std::ostream& out) const;
+    // Hands the per-device counters to metrics().
+    void recordMetrics() const;
+
+    static Policy parsePolicy(const std::string& name);
+
+private:
+    struct Device {
+        dev_t id;
+        std::vector<std::string> dirs;
+        size_t nextDir;
+        IoStats stats;
+    };
+    size_t pickDevice(const std::vector<size_t>& avoid);
+
+    std::vector<Device> devices;
+    Policy policy;
+    size_t rotation;
+    std::string prefix;
+};
@@ -1,27 +1,142 @@
 #include "external_quick_sort.hpp"
+#include "../merge_sort/io_utils.hpp"
+#include "../merge_sort/manifest.hpp"
+#include "../merge_sort/temp_dirs.hpp"
+#include "../merge_sort/metrics.hpp"
+#include "../merge_sort/key_spec.hpp"
+#include "../merge_sort/sparse_index.hpp"
+#include "../merge_sort/external_merge_sort.hpp"
+#include "../merge_sort/parallel_output.hpp"
+#include "logger.hpp"
 #include <iostream>
-#include <sstream>
 #include <vector>
 #include <algorithm>
+#include <memory>
+#include <cstdio>
+#include <sys/stat.h>
 
-void externalQuickSort(std::string inputFile, std::string outputFile, size_t memLimit,
-                       int recursion_level,
-                       int input_buf_mb, int small_buf_mb,
-                       int large_buf_mb, int middle_buf_mb) {
-    std::cout << "Recursion level: " << recursion_level << std::endl;
-    std::cout << "Input file: " << inputFile << std::endl;
-    std::cout << "Output file: " << outputFile << std::endl;
+// Size of a regular file; false for pipes and other streams whose length
+// is only known once they have been read to the end.
+static bool knownFileSize(const std::string& path, size_t& size) {
+    struct stat st;
+    if (isStdStream(path) || stat(path.c_str(), &st) != 0 || !S_ISREG(st.st_mode)) {
+        return false;
+    }
+    size = static_cast<size_t>(st.st_size);
+    return true;
+}
+
+static const char* MANIFEST_FILE = "quick_sort.manifest";
+
+// A child partition with more than POOR_SPLIT_NUM / POOR_SPLIT_DEN of its
+// node's records is a poor split (see sortChild).
+static const uint64_t POOR_SPLIT_NUM = 7, POOR_SPLIT_DEN = 8;
+
+// Records a finished node output so a resumed sort can skip the subtree.
+static void markSorted(Manifest& manifest, const FileWriter& out) {
+    if (isStdStream(out.fileName())) return;
+    manifest.syncData(out.fileName());
+    manifest.addFile("sorted", out.fileName(), out.bytesWritten(), out.checksum());
+    manifest.commit();
+}
+
+// Same for an output some other code wrote; hashes it only when the
+// manifest is kept on disk.
+static void markSortedFile(Manifest& manifest, const std::string& path) {
+    uint64_t bytes = 0, checksum = 0;
+    if (!manifest.enabled() || !fileChecksum(path, bytes, checksum)) return;
+    manifest.syncData(path);
+    manifest.addFile("sorted", path, bytes, checksum);
+    manifest.commit();
+}
+
+static void writeSorted(TrackedVector<int>& data, const std::string& outputFile, Buffer& outBuf, Manifest& manifest,
+                        const KeySpec* keys, SparseIndexWriter* index) {
+    PhaseTimer sortPhase("in_memory_sort");
+    sortPhase.addRecords(data.size());
+    metrics().observe("leaf_size_records", data.size());
+    std::sort(data.begin(), data.end());
+    FileWriter out(outputFile, outBuf);
+    if (!out.isOpen()) throw SortFailed("Failed to open output file: " + outputFile);
+    if (keys) out.setTransform(keys->decoder());
+    if (index) out.setObserver(index->observer());
+    for (int val : data) out.write(val);
+    out.close();
+    if (out.failed()) throw SortFailed("Failed to write " + outputFile);
+    markSorted(manifest, out);
+}
+
+// Re-enters a node's temp files as "obsolete", so the commit that records
+// the node's output also lists them for deletion: if the sort stops before
+// they are gone, a resumed one deletes them.
+static void markObsolete(Manifest& manifest, const std::vector<std::string>& files) {
+    for (const std::string& path : files) {
+        const ManifestFile* f = manifest.find(path);
+        ManifestFile entry = f ? *f : ManifestFile{"", path, 0, 0};
+        manifest.addFile("obsolete", entry.path, entry.bytes, entry.checksum);
+    }
+}
+
+static bool verified(const Manifest& manifest, const std::string& file, const std::string& kind) {
+    const ManifestFile* f = manifest.find(file);
+    return f && f->kind == kind && Manifest::verify(*f);
+}
+
+static std::string baseName(const std::string& path) {
+    size_t slash = path.find_last_of('/');
+    return slash == std::string::npos ? path : path.substr(slash + 1);
+}
+
+// Temp file for this node: reuse the location a checkpoint recorded for it,
+// otherwise let the temp directories place it away from the node's input.
+static std::string tempPath(const std::string& name, const std::string& inputFile,
+                            const Manifest& manifest, TempDirs& tmp) {
+    for (const char* kind : {"partition", "sorted"}) {
+        for (const ManifestFile& f : manifest.files(kind)) {
+            if (baseName(f.path) == name) return f.path;
+        }
+    }
+    return tmp.place(name, {tmp.deviceOf(inputFile)});
+}
+
+static size_t bufferBytes(int mb) {
+    return static_cast<size_t>(mb > 0 ? mb : 1) * 1024 * 1024;
+}
+
+// Sorts one node of the recursion. Temp files are named after the node's
+// path from the root ("0", "0s", "0sl", ...) so every node's files are
+// distinct and stable across restarts. `keys` and `index` are set only at
+// the root: its input is normalized as it is read and its output restored
+// (and indexed) as it is written, so every temp file in between holds
+// normalized keys. Returns the number of records in the node's output;
+// throws SortFailed if the node cannot be sorted.
+static uint64_t sortNode(const std::string& inputFile, const std::string& outputFile, size_t memLimit,
+                     int recursion_level, const std::string& nodeId,
+                     int input_buf_mb, int small_buf_mb,
+                     int large_buf_mb, int middle_buf_mb, Manifest& manifest, TempDirs& tmp,
+                     const SortOptions& options, const KeySpec* keys, SparseIndexWriter* index) {
+    LOG_DEBUG("Recursion level: " << recursion_level << ", input " << inputFile << ", output " << outputFile);
+    metrics().countMax("max_recursion_depth", recursion_level);
+
+    if (verified(manifest, outputFile, "sorted")) {
+        LOG_DEBUG("Output already complete (checkpoint), skipping.");
+        if (index) {
+            Buffer readBuf(bufferBytes(input_buf_mb));
+            indexSortedFile(outputFile, readBuf, *index);
+        }
+        return manifest.find(outputFile)->bytes / sizeof(int);
+    }
 
     size_t heap_mem_size;
     if (middle_buf_mb == 0) {
         // Default logic if no config is provided
         const size_t BUF_SIZE = 1 * 1024 * 1024; // 1 MB
-        if (memLimit <= 3 * BUF_SIZE) {
-            std::cerr << "Memory limit too small for default configuration\n";
-            return;
+        // The heap gets whatever the input and two partition buffers leave.
+        if (memory().available() <= 3 * BUF_SIZE) {
+            throw SortFailed("Memory limit too small for default configuration");
         }
-        heap_mem_size = memLimit - 3 * BUF_SIZE;
-        std::cout << "Using default heap size calculation. Heap memory: " << heap_mem_size / (1024 * 1024) << "MB" << std::endl;
+        heap_mem_size = memory().available() - 3 * BUF_SIZE;
+        LOG_DEBUG("Using default heap size calculation. Heap memory: " << heap_mem_size / (1024 * 1024) << "MB");
     } else {
         // User-provided config
         heap_mem_size = (size_t)middle_buf_mb * 1024 * 1024;
@@ -34,147 +149,330 @@ void externalQuickSort(std::string inputFile, std::string outputFile, size_t mem
         }
         // We trust middle_buf_mb for the heap size, but ensure it's not larger than the total limit.
         if (heap_mem_size > memLimit) {
-             std::cerr << "Error: Middle buffer size is larger than the total memory limit." << std::endl;
-             return;
+            throw SortFailed("Error: Middle buffer size is larger than the total memory limit.");
         }
-        std::cout << "Using custom heap size. Heap memory: " << heap_mem_size / (1024 * 1024) << "MB" << std::endl;
+        LOG_DEBUG("Using custom heap size. Heap memory: " << heap_mem_size / (1024 * 1024) << "MB");
     }
 
     if (heap_mem_size <= sizeof(int)) {
-        std::cerr << "Invalid heap memory size calculated. Aborting." << std::endl;
-        return;
+        throw SortFailed("Invalid heap memory size calculated. Aborting.");
     }
 
-    IntervalHeap pivotHeap(heap_mem_size / sizeof(int));
+    const std::string smallName = tempPath("partition_small_" + nodeId + ".bin", inputFile, manifest, tmp);
+    const std::string largeName = tempPath("partition_large_" + nodeId + ".bin", inputFile, manifest, tmp);
+    const std::string middleName = tempPath("partition_middle_" + nodeId + ".bin", inputFile, manifest, tmp);
+    const std::string sortedSmallName = tempPath("sorted_small_" + nodeId + ".bin", smallName, manifest, tmp);
+    const std::string sortedLargeName = tempPath("sorted_large_" + nodeId + ".bin", largeName, manifest, tmp);
 
-    std::ifstream in(inputFile, std::ios::binary);
-    if (!in) {
-        std::cerr << "Failed to open input file: " << inputFile << "\n";
-        return;
+    bool partitioned = verified(manifest, smallName, "partition")
+                    && verified(manifest, largeName, "partition")
+                    && verified(manifest, middleName, "partition");
+    if (partitioned) {
+        LOG_DEBUG("Partitions already on disk (checkpoint).");
     }
 
-    in.seekg(0, std::ios::end);
-    size_t fileSize = in.tellg();
-    in.seekg(0);
-    std::cout << "File size: " << fileSize << " bytes" << std::endl;
+    // The heap and the partitioning buffers are scoped to this block so they
+    // are released before recursing instead of piling up per level.
+    if (!partitioned) {
+        Buffer inBuf(bufferBytes(input_buf_mb));
+        FileReader in(inputFile, inBuf, tmp.statsFor(inputFile));
+        if (!in.isOpen()) throw SortFailed("Failed to open input file: " + inputFile);
+        if (keys) in.setTransform(keys->encoder());
 
-    if (fileSize <= memLimit) {
-        std::cout << "File is small enough to sort in memory." << std::endl;
-        std::vector<int> data;
-        int x;
-        while (in.read((char*)&x, sizeof(int))) data.push_back(x);
-        in.close();
-        std::sort(data.begin(), data.end());
-        std::ofstream out(outputFile, std::ios::binary);
-        for (int val : data) out.write((char*)&val, sizeof(int));
-        out.close();
-        return;
-    }
+        size_t heapCapacity = IntervalHeap::capacityFor(heap_mem_size);
+        TrackedVector<int> pending; // buffered stream records the heap had no room for
 
-    std::stringstream smallName, largeName, middleName, sortedSmallName, sortedLargeName;
-    smallName << "partition_small_" << recursion_level << ".bin";
-    largeName << "partition_large_" << recursion_level << ".bin";
-    middleName << "partition_middle_" << recursion_level << ".bin";
-    sortedSmallName << "sorted_small_" << recursion_level << ".bin";
-    sortedLargeName << "sorted_large_" << recursion_level << ".bin";
-
-    std::ofstream smallOut(smallName.str(), std::ios::binary);
-    std::ofstream largeOut(largeName.str(), std::ios::binary);
-
-    int value;
-    size_t loaded = 0;
-    std::cout << "Loading initial pivot heap..." << std::endl;
-    while (!pivotHeap.isFull() && in.read((char*)&value, sizeof(int))) {
-        pivotHeap.insert(value);
-        loaded++;
-    }
-    std::cout << "Initial pivot heap loaded with " << loaded << " elements." << std::endl;
+        size_t fileSize;
+        if (knownFileSize(inputFile, fileSize)) {
+            LOG_DEBUG("File size: " << fileSize << " bytes");
+            if (fileSize <= memory().available()) {
+                LOG_DEBUG("File is small enough to sort in memory.");
+                TrackedVector<int> data;
+                data.reserve(fileSize / sizeof(int));
+                while (in.hasNext()) data.push_back(in.next());
+                in.close();
+                writeSorted(data, outputFile, inBuf, manifest, keys, index);
+                return data.size();
+            }
+        } else {
+            // Unknown length (e.g. stdin): hold as many records as fit next
+            // to a pivot heap of the same size and the partition buffers,
+            // and only fall back to partition files if the input turns out
+            // to be larger than that.
+            size_t reserved = bufferBytes(small_buf_mb) + bufferBytes(large_buf_mb) + IntervalHeap::footprint(0);
+            size_t room = memory().available() > reserved ? memory().available() - reserved : 0;
+            heapCapacity = std::min(heapCapacity, room / (sizeof(int) + IntervalHeap::bytesPerElement()));
+            TrackedVector<int> prefix;
+            prefix.reserve(heapCapacity);
+            while (prefix.size() < heapCapacity && in.hasNext()) prefix.push_back(in.next());
+            if (!in.hasNext()) {
+                LOG_DEBUG("Stream fit in memory (" << prefix.size() << " records).");
+                in.close();
+                writeSorted(prefix, outputFile, inBuf, manifest, keys, index);
+                return prefix.size();
+            }
+            LOG_DEBUG("Stream exceeds memory; partitioning to disk.");
+            pending.swap(prefix);
+        }
+        IntervalHeap pivotHeap(heapCapacity);
+        size_t pendingPos = 0;
+        while (pendingPos < pending.size() && !pivotHeap.isFull()) pivotHeap.insert(pending[pendingPos++]);
 
-    int minPivot = pivotHeap.getMin();
-    int maxPivot = pivotHeap.getMax();
-    std::cout << "Pivots: " << minPivot << ", " << maxPivot << std::endl;
+        PhaseTimer partitionPhase("partition");
+        metrics().count("partition_nodes");
+        Buffer smallBuf(bufferBytes(small_buf_mb)), largeBuf(bufferBytes(large_buf_mb));
+        FileWriter smallOut(smallName, smallBuf, tmp.statsFor(smallName));
+        FileWriter largeOut(largeName, largeBuf, tmp.statsFor(largeName));
+        for (const FileWriter* part : {&smallOut, &largeOut}) {
+            if (!part->isOpen()) throw SortFailed("Failed to create temp file " + part->fileName());
+        }
 
-    if (minPivot > maxPivot) {
-        std::cerr << "ERROR: minPivot > maxPivot, invalid heap state\n";
-        return;
-    }
+        int value;
+        uint64_t equal = 0; // records equal to a single-valued heap, see below
+        int equalValue = 0;
+        size_t loaded = 0;
+        LOG_DEBUG("Loading initial pivot heap...");
+        while (!pivotHeap.isFull() && in.hasNext()) {
+            pivotHeap.insert(in.next());
+            loaded++;
+        }
+        LOG_DEBUG("Initial pivot heap loaded with " << loaded << " elements.");
+
+        int minPivot = pivotHeap.getMin();
+        int maxPivot = pivotHeap.getMax();
+        LOG_DEBUG("Pivots: " << minPivot << ", " << maxPivot);
 
-    std::cout << "Partitioning file..." << std::endl;
-    long long count = 0;
-    int last_h_min = 0;
-    bool violation_found = false;
-    while (in.read((char*)&value, sizeof(int))) {
-        int h_min = pivotHeap.getMin();
-        int h_max = pivotHeap.getMax();
+        if (minPivot > maxPivot) throw SortFailed("ERROR: minPivot > maxPivot, invalid heap state");
 
-        if (!violation_found && h_min < last_h_min) {
-            std::cerr << "!!! VIOLATION: h_min decreased! " << last_h_min << " -> " << h_min << " at item " << count << std::endl;
-            violation_found = true;
+        LOG_DEBUG("Partitioning file...");
+        uint64_t evictions = 0;
+        while (pendingPos < pending.size() || in.hasNext()) {
+            value = pendingPos < pending.size() ? pending[pendingPos++] : in.next();
+            int h_min = pivotHeap.getMin();
+            int h_max = pivotHeap.getMax();
+
+            // Once the heap holds a single value it never changes (nothing
+            // lies strictly between its min and max), so records equal to
+            // it belong to the middle and are only counted: a duplicate-
+            // heavy input is not pushed whole into the small partition.
+            if (h_min == h_max && value == h_min) {
+                equalValue = value;
+                equal++;
+            } else if (value <= h_min) {
+                smallOut.write(value);
+            } else if (value >= h_max) {
+                largeOut.write(value);
+            } else {
+                evictions++;
+                if (value < ((long long)h_min + h_max) / 2) {
+                    smallOut.write(pivotHeap.removeMin());
+                } else {
+                    largeOut.write(pivotHeap.removeMax());
+                }
+                pivotHeap.insert(value);
+            }
         }
-        last_h_min = h_min;
+        in.close();
+        smallOut.close();
+        largeOut.close();
 
-        bool should_log = false; // (count >= 611330 && count <= 611340) || (violation_found && count < 611340);
+        FileWriter midOut(middleName, smallBuf, tmp.statsFor(middleName));
+        if (!midOut.isOpen()) throw SortFailed("Failed to create temp file " + middleName);
+        LOG_DEBUG("Writing middle partition...");
+        while (!pivotHeap.isEmpty()) {
+            midOut.write(pivotHeap.removeMin());
+        }
+        for (uint64_t i = 0; i < equal; ++i) midOut.write(equalValue);
+        midOut.close();
+        LOG_DEBUG("Middle partition written.");
+        partitionPhase.addRecords((smallOut.bytesWritten() + largeOut.bytesWritten() + midOut.bytesWritten()) / sizeof(int));
+        metrics().count("heap_evictions", evictions);
+        metrics().count("equal_key_records", equal);
+        metrics().observe("middle_partition_records", midOut.bytesWritten() / sizeof(int));
 
-        if (should_log) {
-             std::cerr << "i=" << count << " | val=" << value
-                      << " | h_min=" << h_min << ", h_max=" << h_max;
+        for (const FileWriter* part : {&smallOut, &largeOut, &midOut}) {
+            if (part->failed()) throw SortFailed("Failed to write temp file " + part->fileName());
+            manifest.syncData(part->fileName());
+            manifest.addFile("partition", part->fileName(), part->bytesWritten(), part->checksum());
         }
+        manifest.commit();
+    }
 
+    // Introsort-style guard. On sorted, reversed or duplicate-heavy input
+    // the pivot heap peels off little more than its own size per pass, and
+    // recursing into the rest would reread nearly all of it per level
+    // (O(n^2 / M) I/O). A child that is a poor split is sorted by the merge
+    // sort engine instead, so the depth stays within log8/7(n / M) and the
+    // I/O within O(n log n).
+    const uint64_t nodeRecords = (manifest.find(smallName)->bytes + manifest.find(largeName)->bytes
+                                  + manifest.find(middleName)->bytes) / sizeof(int);
+    // A child that comes back with fewer records than its partition did
+    // not sort it; the node stops there, leaving the child unmarked.
+    auto sortChild = [&](const std::string& part, const std::string& sorted, const std::string& childId) {
+        uint64_t records = manifest.find(part)->bytes / sizeof(int);
+        if (records * POOR_SPLIT_DEN <= nodeRecords * POOR_SPLIT_NUM) {
+            LOG_DEBUG("Recursive call for partition " << childId << ".");
+            uint64_t sortedRecords = sortNode(part, sorted, memLimit, recursion_level + 1, childId, input_buf_mb,
+                                              small_buf_mb, large_buf_mb, middle_buf_mb, manifest, tmp, options,
+                                              nullptr, nullptr);
+            if (sortedRecords != records) {
+                throw SortFailed("Partition " + part + " sorted to " + std::to_string(sortedRecords) + " of " +
+                                 std::to_string(records) + " records");
+            }
+            return;
+        }
+        if (verified(manifest, sorted, "sorted")) return;
+        std::cout << "Poor split at node " << nodeId << ": " << records << " of " << nodeRecords
+                  << " records on one side; sorting them with the merge sort engine." << std::endl;
+        metrics().count("qs_fallbacks");
+        // The partition already holds normalized keys.
+        SortOptions fallback = options;
+        fallback.keySpec.clear();
+        fallback.indexFile.clear();
+        fallback.tmpPrefix = "fallback_" + childId + "_";
+        uint64_t sortedRecords = mergeSortFile(part, sorted, memLimit, 0, fallback);
+        if (sortedRecords != records) {
+            throw SortFailed("Merge sort fallback for " + part + " sorted " + std::to_string(sortedRecords) + " of " +
+                             std::to_string(records) + " records");
+        }
+        markSortedFile(manifest, sorted);
+    };
+    sortChild(smallName, sortedSmallName, nodeId + "s");
+    sortChild(largeName, sortedLargeName, nodeId + "l");
 
-        if (value <= h_min) {
-            if (should_log) std::cerr << " -> small" << std::endl;
-            smallOut.write((char*)&value, sizeof(int));
-        } else if (value >= h_max) {
-            if (should_log) std::cerr << " -> large" << std::endl;
-            largeOut.write((char*)&value, sizeof(int));
+    // Concatenate small | middle | large. The parts' sizes fix where each
+    // lands, so with --threads and a regular output file several writers
+    // copy slices of them at once (parallel_output.hpp). Otherwise (the
+    // output may be stdout, or feeds the index) this is a plain sequential
+    // stream of buffer-sized writes.
+    LOG_DEBUG("Merging partitions...");
+    PhaseTimer assemblePhase("assemble");
+    const std::vector<std::string> parts = {sortedSmallName, middleName, sortedLargeName};
+    // This node's output now stands in for its whole subtree.
+    std::vector<std::string> temps = {smallName, largeName, middleName, sortedSmallName, sortedLargeName};
+    uint64_t records = 0;
+    if (!index && parallelOutput(outputFile, options.threads)) {
+        std::vector<IoStats*> inStats;
+        for (const std::string& part : parts) inStats.push_back(tmp.statsFor(part));
+        if (!concatenateParallel(parts, outputFile, options.threads, memory().available(),
+                                 keys ? keys->decoder() : nullptr, records, inStats, tmp.statsFor(outputFile))) {
+            throw SortFailed("Failed to write " + outputFile);
+        }
+        markObsolete(manifest, temps);
+        markSortedFile(manifest, outputFile);
+    } else {
+        Buffer readBuf(bufferBytes(input_buf_mb)), writeBuf(bufferBytes(large_buf_mb));
+        FileWriter finalOut(outputFile, writeBuf, tmp.statsFor(outputFile));
+        if (!finalOut.isOpen()) throw SortFailed("Failed to open output file: " + outputFile);
+        if (keys) finalOut.setTransform(keys->decoder());
+        if (index) finalOut.setObserver(index->observer());
+        for (const std::string& part : parts) {
+            FileReader f(part, readBuf, tmp.statsFor(part));
+            while (f.hasNext()) finalOut.write(f.next());
+            f.close();
+        }
+        finalOut.close();
+        if (finalOut.failed()) throw SortFailed("Failed to write " + outputFile);
+        markObsolete(manifest, temps);
+        markSorted(manifest, finalOut);
+        records = finalOut.bytesWritten() / sizeof(int);
+    }
+    for (const std::string& tmp : temps) remove(tmp.c_str());
+    manifest.removeFiles("obsolete");
+    LOG_DEBUG("Partitions merged.");
+    assemblePhase.addRecords(records);
+    return records;
+}
+
+static uint64_t quickSort(const std::string& inputFile, const std::string& outputFile, size_t memLimit,
+                          int recursion_level,
+                          int input_buf_mb, int small_buf_mb,
+                          int large_buf_mb, int middle_buf_mb,
+                          const SortOptions& options) {
+    std::cout << "=== External Quick Sort ===" << std::endl;
+    std::cout << "Input file: " << inputFile << std::endl;
+    std::cout << "Output file: " << outputFile << std::endl;
+    std::cout << "Memory limit: " << memLimit << " bytes" << std::endl;
+
+    const KeySpec keys = options.keySpec.empty() ? KeySpec() : KeySpec::parse(options.keySpec);
+    if (!keys.identity()) std::cout << "Sort key: " << keys.describe() << std::endl;
+    metrics().set("key", keys.describe());
+
+    std::unique_ptr<SparseIndexWriter> index;
+    if (!options.indexFile.empty()) {
+        index = std::make_unique<SparseIndexWriter>(options.indexFile, keys, options.indexStride);
+        if (!index->isOpen()) throw SortFailed("Failed to open index file: " + options.indexFile);
+        metrics().set("index", options.indexFile);
+    }
+
+    TempDirs tmp(options.tmpDirs, TempDirs::parsePolicy(options.tmpPolicy));
+    Manifest manifest(tmp.dirPath(MANIFEST_FILE), options.checkpoint || options.resume);
+    bool resumed = false;
+    if (options.resume) {
+        if (!manifest.load()) {
+            std::cout << "No checkpoint found; starting from scratch." << std::endl;
+        } else if (manifest.get("engine") != "quick" || manifest.get("input") != inputIdentity(inputFile)
+                   || manifest.get("mem_limit") != std::to_string(memLimit)
+                   || manifest.get("key") != keys.describe()) {
+            std::cout << "Checkpoint belongs to a different sort; starting from scratch." << std::endl;
         } else {
-            int evicted;
-            if (value < ((long long)h_min + h_max) / 2) {
-                if (should_log) std::cerr << " | evict min path...";
-                evicted = pivotHeap.removeMin();
-                if (should_log) std::cerr << " evicted=" << evicted << ", insert " << value << std::endl;
-                smallOut.write((char*)&evicted, sizeof(int));
-            } else {
-                if (should_log) std::cerr << " | evict max path...";
-                evicted = pivotHeap.removeMax();
-                if (should_log) std::cerr << " evicted=" << evicted << ", insert " << value << std::endl;
-                largeOut.write((char*)&evicted, sizeof(int));
-            }
-            pivotHeap.insert(value);
+            std::cout << "Resuming from checkpoint." << std::endl;
+            resumed = true;
+            for (const ManifestFile& f : manifest.files("obsolete")) remove(f.path.c_str());
+            manifest.removeFiles("obsolete");
         }
-        count++;
     }
-    in.close();
-    smallOut.close();
-    largeOut.close();
-
-    std::ofstream midOut(middleName.str(), std::ios::binary);
-    std::cout << "Writing middle partition..." << std::endl;
-    while (!pivotHeap.isEmpty()) {
-        int out = pivotHeap.removeMin();
-        midOut.write((char*)&out, sizeof(int));
+    if (!resumed) {
+        manifest.discard();
+        manifest.set("engine", "quick");
+        manifest.set("input", inputIdentity(inputFile));
+        manifest.set("mem_limit", std::to_string(memLimit));
+        manifest.set("key", keys.describe());
+        manifest.commit();
+    }
+
+    uint64_t records = sortNode(inputFile, outputFile, memLimit, recursion_level, std::to_string(recursion_level),
+                                input_buf_mb, small_buf_mb, large_buf_mb, middle_buf_mb, manifest, tmp,
+                                options, keys.identity() ? nullptr : &keys, index.get());
+    if (index && index->close()) {
+        std::cout << "Sparse index: " << options.indexFile << " (" << index->entries() << " entries)" << std::endl;
+    }
+    manifest.discard();
+    tmp.report(std::cout);
+    tmp.recordMetrics();
+    std::cout << "Quick sort completed: " << records << " records." << std::endl;
+    return records;
+}
+
+bool externalQuickSort(std::string inputFile, std::string outputFile, size_t memLimit,
+                       int recursion_level,
+                       int input_buf_mb, int small_buf_mb,
+                       int large_buf_mb, int middle_buf_mb,
+                       const SortOptions& options) {
+    metrics().reset(options.metricsOut);
+    metrics().set("engine", "quick_sort");
+    metrics().set("input", inputFile);
+    metrics().set("output", outputFile);
+    metrics().set("mem_limit", std::to_string(memLimit));
+    memory().reset(memLimit);
+    bool ok = true;
+    try {
+        PhaseTimer total("total");
+        total.addRecords(quickSort(inputFile, outputFile, memLimit, recursion_level,
+                                   input_buf_mb, small_buf_mb, large_buf_mb, middle_buf_mb, options));
+    } catch (const MemoryLimitExceeded& e) {
+        std::cerr << "Memory limit exceeded: " << e.what() << std::endl;
+        ok = false;
+    } catch (const std::invalid_argument& e) {
+        std::cerr << e.what() << std::endl;
+        ok = false;
+    } catch (const SortFailed& e) {
+        std::cerr << e.what() << std::endl;
+        ok = false;
+    }
+    reportMemory(std::cout);
+    if (!metrics().write()) {
+        std::cerr << "Failed to write metrics to " << options.metricsOut << std::endl;
     }
-    midOut.close();
-    std::cout << "Middle partition written." << std::endl;
-
-    std::cout << "Recursive call for small partition." << std::endl;
-    externalQuickSort(smallName.str(), sortedSmallName.str(), memLimit, recursion_level + 1, input_buf_mb, small_buf_mb, large_buf_mb, middle_buf_mb);
-    std::cout << "Recursive call for large partition." << std::endl;
-    externalQuickSort(largeName.str(), sortedLargeName.str(), memLimit, recursion_level + 1, input_buf_mb, small_buf_mb, large_buf_mb, middle_buf_mb);
-
-    std::cout << "Merging partitions..." << std::endl;
-    std::ifstream f1(sortedSmallName.str(), std::ios::binary);
-    std::ifstream f2(middleName.str(), std::ios::binary);
-    std::ifstream f3(sortedLargeName.str(), std::ios::binary);
-    std::ofstream finalOut(outputFile, std::ios::binary);
-
-    while (f1.read((char*)&value, sizeof(int))) finalOut.write((char*)&value, sizeof(int));
-    while (f2.read((char*)&value, sizeof(int))) finalOut.write((char*)&value, sizeof(int));
-    while (f3.read((char*)&value, sizeof(int))) finalOut.write((char*)&value, sizeof(int));
-
-    f1.close();
-    f2.close();
-    f3.close();
-    finalOut.close();
-    std::cout << "Partitions merged." << std::endl;
+    return ok;
 }
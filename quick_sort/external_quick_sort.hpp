@@ -2,14 +2,18 @@
 #define EXTERNAL_QUICK_SORT_HPP
 
 #include "interval_heap.hpp"
+#include "../merge_sort/sort_options.hpp"
 #include <string>
 #include <vector>
 #include <algorithm>
 #include <fstream>
 
-void externalQuickSort(std::string inputFile, std::string outputFile, size_t memLimit,
+// False if the sort hit the memory limit (the hard cap on everything the
+// engine allocates).
+bool externalQuickSort(std::string inputFile, std::string outputFile, size_t memLimit,
                        int recursion_level = 0,
                        int input_buf_mb = 0, int small_buf_mb = 0,
-                       int large_buf_mb = 0, int middle_buf_mb = 0);
+                       int large_buf_mb = 0, int middle_buf_mb = 0,
+                       const SortOptions& options = SortOptions());
 
 #endif
@@ -3,7 +3,6 @@
 #include <iostream>
 #include <algorithm>
 #include <stdexcept>
-#include <sstream>
 
 IntervalHeap::IntervalHeap(size_t capacity) : capacity(capacity) {
     heap.reserve(capacity / 2 + 1);
@@ -29,14 +28,10 @@ int IntervalHeap::getMax() const {
 }
 
 void IntervalHeap::insert(int value) {
-    std::stringstream ss;
-    ss << "  insert(" << value << ")";
-    LOG_DEBUG(ss.str());
+    LOG_DEBUG("  insert(" << value << ")");
 
     if (isFull()) {
-        std::stringstream ss_full;
-        ss_full << "Heap is full, cannot insert " << value;
-        LOG_DEBUG(ss_full.str());
+        LOG_DEBUG("Heap is full, cannot insert " << value);
         return;
     }
     if (heap.empty()) {
@@ -130,9 +125,7 @@ int IntervalHeap::removeMax() {
 }
 
 void IntervalHeap::siftUpMin(size_t i) {
-    std::stringstream ss;
-    ss << "  siftUpMin(" << i << ")";
-    LOG_DEBUG(ss.str());
+    LOG_DEBUG("  siftUpMin(" << i << ")");
     while (i > 0) {
         size_t p = parent(i);
         if (heap[i].left < heap[p].left) {
@@ -149,9 +142,7 @@ void IntervalHeap::siftUpMin(size_t i) {
 }
 
 void IntervalHeap::siftUpMax(size_t i) {
-    std::stringstream ss;
-    ss << "  siftUpMax(" << i << ")";
-    LOG_DEBUG(ss.str());
+    LOG_DEBUG("  siftUpMax(" << i << ")");
     while (i > 0) {
         size_t p = parent(i);
         int currMax = heap[i].hasSingle ? heap[i].left : heap[i].right;
@@ -176,9 +167,7 @@ void IntervalHeap::siftUpMax(size_t i) {
 }
 
 void IntervalHeap::siftDownMin(size_t i) {
-    std::stringstream ss;
-    ss << "  siftDownMin(" << i << ")";
-    LOG_DEBUG(ss.str());
+    LOG_DEBUG("  siftDownMin(" << i << ")");
     size_t n = heap.size();
     while (true) {
         size_t left = leftChild(i);
@@ -189,21 +178,15 @@ void IntervalHeap::siftDownMin(size_t i) {
         if (right < n && heap[right].left < heap[smallest].left) smallest = right;
 
         if (smallest != i) {
-            std::stringstream ss_swap;
-            ss_swap << "    siftDownMin swap " << i << " (" << heap[i].left << ") with " << smallest << " (" << heap[smallest].left << ")";
-            LOG_DEBUG(ss_swap.str());
+            LOG_DEBUG("    siftDownMin swap " << i << " (" << heap[i].left << ") with " << smallest << " (" << heap[smallest].left << ")");
             std::swap(heap[i].left, heap[smallest].left);
             if (!heap[i].hasSingle && heap[i].left > heap[i].right) {
-                std::stringstream ss_fix;
-                ss_fix << "    fix interval at " << i;
-                LOG_DEBUG(ss_fix.str());
+                LOG_DEBUG("    fix interval at " << i);
                 std::swap(heap[i].left, heap[i].right);
                 siftUpMax(i);
             }
             if (!heap[smallest].hasSingle && heap[smallest].left > heap[smallest].right) {
-                std::stringstream ss_fix;
-                ss_fix << "    fix interval at " << smallest;
-                LOG_DEBUG(ss_fix.str());
+                LOG_DEBUG("    fix interval at " << smallest);
                 std::swap(heap[smallest].left, heap[smallest].right);
                 siftUpMax(smallest);
             }
@@ -215,9 +198,7 @@ void IntervalHeap::siftDownMin(size_t i) {
 }
 
 void IntervalHeap::siftDownMax(size_t i) {
-    std::stringstream ss;
-    ss << "  siftDownMax(" << i << ")";
-    LOG_DEBUG(ss.str());
+    LOG_DEBUG("  siftDownMax(" << i << ")");
     size_t n = heap.size();
     while (true) {
         size_t left = leftChild(i);
@@ -232,9 +213,7 @@ void IntervalHeap::siftDownMax(size_t i) {
         if (right < n && getRightMax(right) > getRightMax(largest)) largest = right;
 
         if (largest != i) {
-            std::stringstream ss_swap;
-            ss_swap << "    siftDownMax swap " << i << " with " << largest;
-            LOG_DEBUG(ss_swap.str());
+            LOG_DEBUG("    siftDownMax swap " << i << " with " << largest);
             int& val_i = heap[i].hasSingle ? heap[i].left : heap[i].right;
             int& val_largest = heap[largest].hasSingle ? heap[largest].left : heap[largest].right;
             std::swap(val_i, val_largest);
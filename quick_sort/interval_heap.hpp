@@ -1,6 +1,7 @@
 #ifndef INTERVAL_HEAP_HPP
 #define INTERVAL_HEAP_HPP
 
+#include "../merge_sort/memory_governor.hpp"
 #include <vector>
 #include <cstddef>
 #include <stdexcept>
@@ -16,6 +17,12 @@ public:
     int removeMin();
     int removeMax();
 
+    // Bytes a heap of `capacity` elements allocates, the largest capacity
+    // that fits in `bytes`, and the marginal cost of one more element.
+    static size_t footprint(size_t capacity) { return (capacity / 2 + 1) * sizeof(Node); }
+    static size_t capacityFor(size_t bytes) { return bytes < sizeof(Node) ? 0 : (bytes / sizeof(Node) - 1) * 2; }
+    static size_t bytesPerElement() { return (sizeof(Node) + 1) / 2; }
+
 private:
     struct Node {
         int left;  // min element of interval
@@ -25,7 +32,7 @@ private:
         Node(int l, int r) : left(l), right(r), hasSingle(false) {}
     };
 
-    std::vector<Node> heap;
+    TrackedVector<Node> heap;
     size_t capacity;
 
     void siftUpMin(size_t index);
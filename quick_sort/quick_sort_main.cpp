@@ -1,5 +1,9 @@
 #include "external_quick_sort.hpp"
 #include "logger.hpp"
+#include "../merge_sort/io_utils.hpp"
+#include "../merge_sort/temp_dirs.hpp"
+#include "../merge_sort/key_spec.hpp"
+#include "../merge_sort/manifest.hpp"
 #include <iostream>
 #include <string>
 #include <vector>
@@ -17,6 +21,41 @@ int main(int argc, char* argv[]) {
         verbose = true;
         args.erase(verbose_it);
     }
+    // --checkpoint keeps a durable quick_sort.manifest; --resume continues
+    // from it after a crash (and keeps checkpointing).
+    SortOptions options;
+    options.checkpoint = takeFlag(args, "--checkpoint");
+    options.resume = takeFlag(args, "--resume");
+
+    // --tmp-dir may be repeated or given a comma-separated list.
+    std::vector<std::string> tmpDirArgs;
+    takeOption(args, "--tmp-dir", tmpDirArgs);
+    for (const std::string& list : tmpDirArgs) {
+        for (const std::string& dir : splitList(list)) options.tmpDirs.push_back(dir);
+    }
+    takeOption(args, "--tmp-policy", options.tmpPolicy);
+    takeOption(args, "--metrics-out", options.metricsOut);
+    // --key sorts by columns inside the record instead of the whole int.
+    takeOption(args, "--key", options.keySpec);
+    // --index writes a sparse index of the output (see bin/index_lookup).
+    std::string indexStride;
+    takeOption(args, "--index", options.indexFile);
+    takeOption(args, "--index-stride", indexStride);
+    // --threads N assembles partitions into the output with N writers.
+    std::string threads;
+    takeOption(args, "--threads", threads);
+    try {
+        TempDirs::parsePolicy(options.tmpPolicy);
+        if (!options.keySpec.empty()) KeySpec::parse(options.keySpec);
+        if (!indexStride.empty()) options.indexStride = std::max(1, std::stoi(indexStride));
+        if (!threads.empty()) options.threads = std::max(1, std::stoi(threads));
+    } catch (const std::invalid_argument& e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    } catch (const std::out_of_range&) {
+        std::cerr << "Numeric argument out of range." << std::endl;
+        return 1;
+    }
     g_debug_logging_enabled = verbose;
     if (g_debug_logging_enabled) {
         std::cerr << "Debug logging enabled." << std::endl;
@@ -27,13 +66,33 @@ int main(int argc, char* argv[]) {
     size_t memLimit = 0;
 
     if (args.size() != 3 && args.size() != 7) {
-        std::cerr << "Usage: ./quick_sort_exec <input_file> <output_file> <memory_limit_bytes> [in_mb small_mb large_mb middle_mb] [--verbose]\n";
+        std::cerr << "Usage: ./quick_sort_exec <input_file|-> <output_file|-> <memory_limit_bytes|N%> [in_mb small_mb large_mb middle_mb]\n"
+                  << "       [--checkpoint] [--resume] [--tmp-dir dir[,dir...]] [--tmp-policy rr|space|bandwidth]\n"
+                  << "       [--metrics-out file.json] [--threads N] [--key OFF:TYPE[:asc|desc],...]\n"
+                  << "       [--index file.idx] [--index-stride N] [--verbose]\n";
         return 1;
     }
 
     inputFile = args[0];
     outputFile = args[1];
-    memLimit = std::stoull(args[2]);
+    try {
+        memLimit = parseMemoryBudget(args[2]);
+    } catch (const std::invalid_argument& e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+
+    // A checkpoint names its input by path and size, so the input must be
+    // a file a resumed sort can reopen.
+    if ((options.checkpoint || options.resume) && !checkpointableInput(inputFile)) {
+        std::cerr << "--checkpoint and --resume need a regular input file, not a stream." << std::endl;
+        return 1;
+    }
+
+    // With "-" as output the data owns stdout, so narration goes to stderr.
+    if (outputFile == "-") {
+        std::cout.rdbuf(std::cerr.rdbuf());
+    }
 
     if (args.size() == 7) {
         try {
@@ -41,14 +100,19 @@ int main(int argc, char* argv[]) {
             int small_mb = std::stoi(args[4]);
             int large_mb = std::stoi(args[5]);
             int middle_mb = std::stoi(args[6]);
-            externalQuickSort(inputFile, outputFile, memLimit, 0, in_mb, small_mb, large_mb, middle_mb);
+            if (!externalQuickSort(inputFile, outputFile, memLimit, 0, in_mb, small_mb, large_mb, middle_mb, options)) {
+                return 1;
+            }
         } catch (const std::invalid_argument& e) {
             std::cerr << "Invalid buffer/heap size argument. All four must be integers." << std::endl;
             return 1;
+        } catch (const std::out_of_range&) {
+            std::cerr << "Buffer/heap size argument out of range." << std::endl;
+            return 1;
         }
     } else {
         // Call with default buffer/heap sizes
-        externalQuickSort(inputFile, outputFile, memLimit, 0);
+        if (!externalQuickSort(inputFile, outputFile, memLimit, 0, 0, 0, 0, 0, options)) return 1;
     }
 
     return 0;
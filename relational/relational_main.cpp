@@ -0,0 +1,75 @@
+#include "relational_ops.hpp"
+#include "../merge_sort/io_utils.hpp"
+#include "../merge_sort/logger.hpp"
+#include "../merge_sort/temp_dirs.hpp"
+#include "../merge_sort/key_spec.hpp"
+#include <iostream>
+#include <string>
+#include <vector>
+
+// Define the global logger flag
+bool g_debug_logging_enabled = false;
+
+static void printUsage(const char* prog) {
+    std::cerr << "Usage: " << prog << " group-by <input_file|-> <output_file|-> <mem_limit_in_bytes|N%> [K_value]\n"
+              << "       [--key OFF:TYPE[:asc|desc],...] [--value OFF:TYPE]\n"
+              << "   or: " << prog << " join <left_file|-> <right_file> <output_file|-> <mem_limit_in_bytes|N%> [K_value]\n"
+              << "       [--key OFF:TYPE[:asc|desc],...]\n"
+              << "   both: [--tmp-dir dir[,dir...]] [--tmp-policy rr|space|bandwidth] [--threads N]\n"
+              << "       [--metrics-out file.json] [--verbose]\n";
+}
+
+int main(int argc, char* argv[]) {
+    std::vector<std::string> args(argv + 1, argv + argc);
+    g_debug_logging_enabled = takeFlag(args, "--verbose");
+
+    SortOptions options;
+    std::vector<std::string> tmpDirArgs;
+    takeOption(args, "--tmp-dir", tmpDirArgs);
+    for (const std::string& list : tmpDirArgs) {
+        for (const std::string& dir : splitList(list)) options.tmpDirs.push_back(dir);
+    }
+    takeOption(args, "--tmp-policy", options.tmpPolicy);
+    takeOption(args, "--metrics-out", options.metricsOut);
+    takeOption(args, "--key", options.keySpec);
+    std::string value, threads;
+    takeOption(args, "--value", value);
+    takeOption(args, "--threads", threads);
+
+    // group-by takes input, output, memory; join one more input.
+    if (args.empty() || (args[0] != "group-by" && args[0] != "join")) {
+        printUsage(argv[0]);
+        return 1;
+    }
+    const bool join = args[0] == "join";
+    const size_t fixed = join ? 5 : 4;
+    if (args.size() != fixed && args.size() != fixed + 1) {
+        printUsage(argv[0]);
+        return 1;
+    }
+
+    size_t memLimit = 0;
+    int k_val = 0;
+    try {
+        TempDirs::parsePolicy(options.tmpPolicy);
+        if (!options.keySpec.empty()) KeySpec::parse(options.keySpec);
+        if (!value.empty()) KeyColumn::parse(value);
+        if (!threads.empty()) options.threads = std::max(1, std::stoi(threads));
+        memLimit = parseMemoryBudget(args[fixed - 1]);
+        if (args.size() == fixed + 1) k_val = std::stoi(args[fixed]);
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        printUsage(argv[0]);
+        return 1;
+    }
+
+    // With "-" as output the data owns stdout, so narration goes to stderr.
+    const std::string& outputFile = args[fixed - 2];
+    if (outputFile == "-") {
+        std::cout.rdbuf(std::cerr.rdbuf());
+    }
+
+    bool ok = join ? externalMergeJoin(args[1], args[2], outputFile, memLimit, k_val, options)
+                   : externalGroupBy(args[1], outputFile, memLimit, value, k_val, options);
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,360 @@
+#include "relational_ops.hpp"
+#include "../merge_sort/external_merge_sort.hpp"
+#include "../merge_sort/key_spec.hpp"
+#include "../merge_sort/metrics.hpp"
+#include "../merge_sort/logger.hpp"
+#include <iostream>
+#include <fstream>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <exception>
+#include <algorithm>
+#include <cstdio>
+
+// The last merge pass of `runs` within memBytes: the merge kernels write
+// into `sink`, a block of normalized keys at a time.
+static void mergeInto(const SortedRuns& runs, size_t memBytes, const BlockSink& sink) {
+    int count = static_cast<int>(runs.paths.size());
+    size_t bufSize = bufferSizeFor(memBytes);
+    std::vector<size_t> poolSizes(count, mergeReadBufferSize(memBytes, bufSize, count));
+    poolSizes.push_back(bufSize);
+    BufferPool pool(poolSizes);
+    Buffer& outputBuf = pool.lease(bufSize);
+    std::vector<std::unique_ptr<FileReader>> readers;
+    std::vector<FileReader*> open;
+    for (const std::string& path : runs.paths) {
+        readers.push_back(std::make_unique<FileReader>(path, pool.lease()));
+        open.push_back(readers.back().get());
+    }
+    FileWriter out(outputBuf, sink);
+    mergeRuns(open.data(), count, out);
+    out.close();
+    for (auto& reader : readers) reader->close();
+}
+
+static void removeRuns(const SortedRuns& runs) {
+    for (const std::string& path : runs.paths) {
+        if (remove(path.c_str()) != 0) LOG_DEBUG("Error deleting file: " << path);
+    }
+}
+
+// Runs the final merge may take within memBytes (the requested K if that
+// is smaller); 0 if not even a 2-way merge fits.
+static size_t finalFanIn(size_t memBytes, int k_way) {
+    size_t fit = mergeFanInFor(memBytes, bufferSizeFor(memBytes));
+    return k_way > 1 ? std::min(fit, static_cast<size_t>(k_way)) : fit;
+}
+
+// Text output; "-" is stdout.
+static bool openText(std::ofstream& out, const std::string& outputFile) {
+    out.open(isStdStream(outputFile) ? "/dev/stdout" : outputFile, std::ios::trunc);
+    if (!out.is_open()) std::cerr << "Failed to open output file: " << outputFile << std::endl;
+    return out.is_open();
+}
+
+// One input's last merge pass on its own thread, consumed a block at a
+// time: the merge kernels push, the join pulls. Blocks are handed over
+// without copying, so the merge waits while the join works through one.
+class MergedStream {
+public:
+    MergedStream(const SortedRuns& runs, size_t memBytes) {
+        producer = std::thread([this, runs, memBytes]() {
+            try {
+                mergeInto(runs, memBytes, [this](const int* records, size_t count) { handOver(records, count); });
+            } catch (...) {
+                error = std::current_exception();
+            }
+            std::lock_guard<std::mutex> guard(lock);
+            done = true;
+            changed.notify_all();
+        });
+    }
+    // Stops waiting for the consumer (the merge runs out without it).
+    ~MergedStream() {
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            cancelled = true;
+            changed.notify_all();
+        }
+        producer.join();
+    }
+    MergedStream(const MergedStream&) = delete;
+    MergedStream& operator=(const MergedStream&) = delete;
+
+    // Next block, valid until the following call; 0 at the end. Rethrows
+    // an error from the merge (e.g. MemoryLimitExceeded).
+    size_t nextBlock(const int*& records) {
+        std::unique_lock<std::mutex> guard(lock);
+        if (taken) {
+            pending = nullptr; // hand the previous block back
+            taken = false;
+            changed.notify_all();
+        }
+        changed.wait(guard, [&] { return pending || done; });
+        if (!pending) {
+            if (error) std::rethrow_exception(error);
+            return 0;
+        }
+        taken = true;
+        records = pending;
+        return pendingCount;
+    }
+
+    bool next(int& value) {
+        if (pos == end) {
+            size_t n = nextBlock(pos);
+            end = pos + n;
+            if (n == 0) return false;
+        }
+        value = *pos++;
+        return true;
+    }
+
+private:
+    void handOver(const int* records, size_t count) {
+        std::unique_lock<std::mutex> guard(lock);
+        if (cancelled) return;
+        pending = records;
+        pendingCount = count;
+        changed.notify_all();
+        changed.wait(guard, [&] { return !pending || cancelled; });
+    }
+
+    std::mutex lock;
+    std::condition_variable changed;
+    const int* pending = nullptr;
+    size_t pendingCount = 0;
+    bool taken = false; // pending is out with the consumer
+    bool done = false, cancelled = false;
+    std::exception_ptr error;
+    const int* pos = nullptr;
+    const int* end = nullptr;
+    std::thread producer;
+};
+
+static uint64_t groupBy(const std::string& inputFile, const std::string& outputFile, size_t memLimit,
+                        const std::string& valueColumn, int k_way, const SortOptions& options, bool& ok) {
+    std::cout << "=== External Group By ===" << std::endl;
+    std::cout << "Input file: " << inputFile << std::endl;
+    std::cout << "Output file: " << outputFile << std::endl;
+    std::cout << "Memory limit: " << memLimit << " bytes" << std::endl;
+    const KeySpec keys = options.keySpec.empty() ? KeySpec() : KeySpec::parse(options.keySpec);
+    const KeyColumn value = valueColumn.empty() ? KeyColumn() : KeyColumn::parse(valueColumn);
+    std::cout << "Group key: " << keys.describe() << ", value column: " << value.describe() << std::endl;
+    metrics().set("key", keys.describe());
+    metrics().set("value", value.describe());
+
+    size_t fanIn = finalFanIn(memLimit, k_way);
+    if (fanIn < 2) {
+        std::cerr << "Memory limit too small: " << memLimit << " bytes cannot hold a 2-way merge." << std::endl;
+        ok = false;
+        return 0;
+    }
+    SortOptions sortOptions = options;
+    sortOptions.tmpPrefix += "group_";
+    SortedRuns runs;
+    if (!sortToRuns(inputFile, memLimit, k_way, fanIn, sortOptions, runs)) {
+        ok = false;
+        return 0;
+    }
+
+    std::ofstream out;
+    if (!openText(out, outputFile)) {
+        removeRuns(runs);
+        ok = false;
+        return 0;
+    }
+    for (const KeyColumn& c : keys.keyColumns()) out << c.describe() << '\t';
+    out << "count\tsum\tmin\tmax\n";
+
+    // Aggregates are folded in as the merge produces its blocks; a group
+    // is written once the first record of the next one arrives.
+    std::cout << "--- Final Merge: Group By (" << runs.paths.size() << " runs) ---" << std::endl;
+    PhaseTimer groupPhase("group_by");
+    uint64_t groups = 0, count = 0;
+    int groupKey = 0, first = 0;
+    int64_t sum = 0, lo = 0, hi = 0;
+    auto emit = [&]() {
+        for (const KeyColumn& c : keys.keyColumns()) out << c.extract(first) << '\t';
+        out << count << '\t' << sum << '\t' << lo << '\t' << hi << '\n';
+        groups++;
+    };
+    mergeInto(runs, memory().available(), [&](const int* block, size_t n) {
+        for (size_t i = 0; i < n; ++i) {
+            int record = keys.decode(block[i]);
+            int64_t v = value.extract(record);
+            if (count > 0 && keys.groupKey(block[i]) == groupKey) {
+                count++;
+                sum += v;
+                lo = std::min(lo, v);
+                hi = std::max(hi, v);
+                continue;
+            }
+            if (count > 0) emit();
+            groupKey = keys.groupKey(block[i]);
+            first = record;
+            count = 1;
+            sum = lo = hi = v;
+        }
+    });
+    if (count > 0) emit();
+    out.close();
+    removeRuns(runs);
+    groupPhase.addRecords(runs.records);
+    metrics().count("groups", groups);
+    if (!out) {
+        std::cerr << "Failed to write " << outputFile << std::endl;
+        ok = false;
+    }
+    std::cout << "Group by completed: " << runs.records << " records in " << groups << " groups." << std::endl;
+    return runs.records;
+}
+
+bool externalGroupBy(const std::string& inputFile, const std::string& outputFile, size_t memLimit,
+                     const std::string& valueColumn, int k_way, const SortOptions& options) {
+    metrics().reset(options.metricsOut);
+    metrics().set("engine", "group_by");
+    metrics().set("input", inputFile);
+    metrics().set("output", outputFile);
+    metrics().set("mem_limit", std::to_string(memLimit));
+    memory().reset(memLimit);
+    bool ok = true;
+    try {
+        PhaseTimer total("total");
+        total.addRecords(groupBy(inputFile, outputFile, memLimit, valueColumn, k_way, options, ok));
+    } catch (const MemoryLimitExceeded& e) {
+        std::cerr << "Memory limit exceeded: " << e.what() << std::endl;
+        ok = false;
+    } catch (const std::invalid_argument& e) {
+        std::cerr << e.what() << std::endl;
+        ok = false;
+    } catch (const SortFailed& e) {
+        std::cerr << e.what() << std::endl;
+        ok = false;
+    }
+    reportMemory(std::cout);
+    if (!metrics().write()) {
+        std::cerr << "Failed to write metrics to " << options.metricsOut << std::endl;
+    }
+    return ok;
+}
+
+static uint64_t mergeJoin(const std::string& leftFile, const std::string& rightFile, const std::string& outputFile,
+                          size_t memLimit, int k_way, const SortOptions& options, bool& ok) {
+    std::cout << "=== External Merge Join ===" << std::endl;
+    std::cout << "Left input: " << leftFile << std::endl;
+    std::cout << "Right input: " << rightFile << std::endl;
+    std::cout << "Output file: " << outputFile << std::endl;
+    std::cout << "Memory limit: " << memLimit << " bytes" << std::endl;
+    const KeySpec keys = options.keySpec.empty() ? KeySpec() : KeySpec::parse(options.keySpec);
+    std::cout << "Join key: " << keys.describe() << std::endl;
+    metrics().set("key", keys.describe());
+
+    // Both sorts get the whole limit one after the other. The final merges
+    // then run side by side, a third each; the last third holds the output
+    // buffer and the right side's records for the current key.
+    const size_t sideMem = memLimit / 3;
+    size_t fanIn = finalFanIn(sideMem, k_way);
+    if (fanIn < 2) {
+        std::cerr << "Memory limit too small: " << memLimit << " bytes cannot hold two 2-way merges." << std::endl;
+        ok = false;
+        return 0;
+    }
+    SortedRuns leftRuns, rightRuns;
+    SortOptions sortOptions = options;
+    sortOptions.tmpPrefix = options.tmpPrefix + "join_left_";
+    if (!sortToRuns(leftFile, memLimit, k_way, fanIn, sortOptions, leftRuns)) {
+        ok = false;
+        return 0;
+    }
+    sortOptions.tmpPrefix = options.tmpPrefix + "join_right_";
+    if (!sortToRuns(rightFile, memLimit, k_way, fanIn, sortOptions, rightRuns)) {
+        removeRuns(leftRuns);
+        ok = false;
+        return 0;
+    }
+
+    std::cout << "--- Final Merge: Join (" << leftRuns.paths.size() << " + " << rightRuns.paths.size()
+              << " runs) ---" << std::endl;
+    PhaseTimer joinPhase("join");
+    uint64_t pairs = 0;
+    {
+        Buffer outputBuf(bufferSizeFor(sideMem));
+        FileWriter out(outputFile, outputBuf);
+        if (!out.isOpen()) {
+            std::cerr << "Failed to open output file: " << outputFile << std::endl;
+            removeRuns(leftRuns);
+            removeRuns(rightRuns);
+            ok = false;
+            return 0;
+        }
+        MergedStream left(leftRuns, sideMem), right(rightRuns, sideMem);
+        TrackedVector<int> matches; // right side records of the current key
+        int l = 0, r = 0;
+        bool haveLeft = left.next(l), haveRight = right.next(r);
+        while (haveLeft && haveRight) {
+            int key = keys.groupKey(l);
+            if (key < keys.groupKey(r)) {
+                haveLeft = left.next(l);
+                continue;
+            }
+            if (keys.groupKey(r) < key) {
+                haveRight = right.next(r);
+                continue;
+            }
+            matches.clear();
+            while (haveRight && keys.groupKey(r) == key) {
+                matches.push_back(keys.decode(r));
+                haveRight = right.next(r);
+            }
+            while (haveLeft && keys.groupKey(l) == key) {
+                int record = keys.decode(l);
+                for (int match : matches) {
+                    out.write(record);
+                    out.write(match);
+                }
+                pairs += matches.size();
+                haveLeft = left.next(l);
+            }
+        }
+        out.close();
+    }
+    removeRuns(leftRuns);
+    removeRuns(rightRuns);
+    joinPhase.addRecords(leftRuns.records + rightRuns.records);
+    metrics().count("join_pairs", pairs);
+    std::cout << "Join completed: " << leftRuns.records << " left and " << rightRuns.records
+              << " right records, " << pairs << " pairs." << std::endl;
+    return leftRuns.records + rightRuns.records;
+}
+
+bool externalMergeJoin(const std::string& leftFile, const std::string& rightFile, const std::string& outputFile,
+                       size_t memLimit, int k_way, const SortOptions& options) {
+    metrics().reset(options.metricsOut);
+    metrics().set("engine", "merge_join");
+    metrics().set("input", leftFile + "," + rightFile);
+    metrics().set("output", outputFile);
+    metrics().set("mem_limit", std::to_string(memLimit));
+    memory().reset(memLimit);
+    bool ok = true;
+    try {
+        PhaseTimer total("total");
+        total.addRecords(mergeJoin(leftFile, rightFile, outputFile, memLimit, k_way, options, ok));
+    } catch (const MemoryLimitExceeded& e) {
+        std::cerr << "Memory limit exceeded: " << e.what() << std::endl;
+        ok = false;
+    } catch (const std::invalid_argument& e) {
+        std::cerr << e.what() << std::endl;
+        ok = false;
+    } catch (const SortFailed& e) {
+        std::cerr << e.what() << std::endl;
+        ok = false;
+    }
+    reportMemory(std::cout);
+    if (!metrics().write()) {
+        std::cerr << "Failed to write metrics to " << options.metricsOut << std::endl;
+    }
+    return ok;
+}
@@ -0,0 +1,28 @@
+#pragma once
+
+#include "../merge_sort/sort_options.hpp"
+#include <string>
+
+// Relational operators on the external merge sort. Each input is sorted
+// with sortToRuns, which stops before the last merge pass; the operator
+// then runs inside that pass, consuming the merged stream as it is
+// produced instead of a sorted file being written and read back.
+//
+// Keys come from options.keySpec (key_spec.hpp): records whose key columns
+// are equal form a group, and groups come out in the spec's order. Both
+// operators keep to memLimit and place temp files like the sort does
+// (--tmp-dir, --tmp-policy); checkpointing is not supported.
+
+// GROUP BY the key columns. Writes a tab-separated text table with a
+// header line, then one line per group in key order: the key column
+// values, then count, sum, min and max of valueColumn ("OFF:TYPE",
+// default the whole record as i32).
+bool externalGroupBy(const std::string& inputFile, const std::string& outputFile, size_t memLimit,
+                     const std::string& valueColumn, int k_way, const SortOptions& options);
+
+// Inner equi-JOIN on the key columns. Every matching (left, right) pair is
+// written as two consecutive records, in key order. The right side's
+// records for one key are held in memory while the left side's are
+// paired with them.
+bool externalMergeJoin(const std::string& leftFile, const std::string& rightFile, const std::string& outputFile,
+                       size_t memLimit, int k_way, const SortOptions& options);
@@ -0,0 +1,433 @@
+#include "distributions.hpp"
+#include "../merge_sort/io_utils.hpp"
+#include "../merge_sort/sort_options.hpp"
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <map>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+
+// Reproducible benchmark sweep over both executables. Datasets come from
+// scripts/distributions.hpp and are cached under the data directory; every
+// (dataset, engine, configuration, memory limit) cell is run as a child
+// process so its peak RSS is its own.
+
+bool g_debug_logging_enabled = false;
+
+struct Dataset {
+    int run;             // "Run" column of report/times.dat
+    std::string dist;
+    size_t bytes;
+    uint64_t seed;
+    std::string path;
+};
+
+struct Config {
+    std::string engine;            // "merge" or "quick"
+    std::string name;              // K=4, QS_A, ... (times.dat AlgorithmConfig)
+    std::vector<std::string> args; // positional arguments after the memory limit
+    size_t configBytes;            // memory the quick sort split asks for
+};
+
+struct Result {
+    Dataset data;
+    std::string engine, config;
+    size_t memLimit;
+    double seconds = -1, mbPerSec = 0;
+    uint64_t bytesRead = 0, bytesWritten = 0, peakRss = 0;
+    bool verified = false;
+};
+
+static const char* CSV_HEADER =
+    "run,distribution,size_bytes,seed,engine,config,mem_limit,seconds,mb_per_s,bytes_read,bytes_written,peak_rss_bytes,verified";
+
+static void printUsage(const char* prog) {
+    std::cerr << "Usage: " << prog << " [options]\n"
+              << "  --dists d1,d2,...       distributions (default uniform); one of:";
+    for (const std::string& d : distributionNames()) std::cerr << " " << d;
+    std::cerr << "\n"
+              << "  --sizes 64M,1G,...      input sizes (default 256M)\n"
+              << "  --seeds 1,2,3           one dataset per seed (default 1,2,3)\n"
+              << "  --mem 16M,64M,...       memory limits (default 16M)\n"
+              << "  --k heuristic,4,8,16    merge sort fan-in values\n"
+              << "  --qs-configs A=2:2:2:10,...  quick sort in:small:large:middle MB splits\n"
+              << "  --engines merge,quick   engines to run\n"
+              << "  --repeat N              runs per cell, median time is kept (default 1)\n"
+              << "  --data-dir DIR          dataset cache and scratch space (default data/bench)\n"
+              << "  --tmp-dir DIR[,DIR]     passed through to the sorts\n"
+              << "  --bin-dir DIR           where the sort executables live (default bin)\n"
+              << "  --times FILE            report table (default report/times.dat)\n"
+              << "  --csv FILE              detailed results (default report/bench.csv)\n"
+              << "  --baseline FILE         fail if throughput falls behind this results file\n"
+              << "  --tolerance PCT         allowed slowdown against the baseline (default 10)\n"
+              << "  --save-baseline FILE    also write the results as a new baseline\n";
+}
+
+static std::string sizeLabel(size_t bytes) {
+    if (bytes % (1ULL << 30) == 0) return std::to_string(bytes >> 30) + "G";
+    if (bytes % (1ULL << 20) == 0) return std::to_string(bytes >> 20) + "M";
+    if (bytes % (1ULL << 10) == 0) return std::to_string(bytes >> 10) + "K";
+    return std::to_string(bytes);
+}
+
+// mkdir -p
+static void makeDirs(const std::string& path) {
+    for (size_t slash = path.find('/', 1); ; slash = path.find('/', slash + 1)) {
+        mkdir(path.substr(0, slash).c_str(), 0755);
+        if (slash == std::string::npos) break;
+    }
+}
+
+static bool fileHasSize(const std::string& path, size_t bytes) {
+    struct stat st;
+    return stat(path.c_str(), &st) == 0 && static_cast<size_t>(st.st_size) == bytes;
+}
+
+// Generates a dataset unless an identical one is already cached.
+static bool ensureDataset(const Dataset& d) {
+    if (fileHasSize(d.path, d.bytes)) return true;
+    std::cout << "Generating " << d.path << "..." << std::endl;
+    std::ofstream out(d.path, std::ios::binary | std::ios::trunc);
+    if (!out) {
+        std::cerr << "Failed to create " << d.path << std::endl;
+        return false;
+    }
+    uint64_t records = d.bytes / sizeof(int);
+    Distribution dist(d.dist, d.seed, records);
+    std::vector<int> block(1 << 20);
+    for (uint64_t first = 0; first < records; first += block.size()) {
+        size_t n = static_cast<size_t>(std::min<uint64_t>(block.size(), records - first));
+        dist.fill(block.data(), first, n);
+        out.write(reinterpret_cast<const char*>(block.data()), n * sizeof(int));
+    }
+    return static_cast<bool>(out);
+}
+
+// Record count and wrap-around sum, enough to catch lost or duplicated
+// records; `sorted` is set when the file is non-decreasing.
+static bool fingerprint(const std::string& path, uint64_t& count, uint64_t& sum, bool& sorted) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in) return false;
+    std::vector<int> block(1 << 20);
+    count = sum = 0;
+    sorted = true;
+    int prev = std::numeric_limits<int>::min();
+    while (in.read(reinterpret_cast<char*>(block.data()), block.size() * sizeof(int)) || in.gcount() > 0) {
+        size_t n = in.gcount() / sizeof(int);
+        for (size_t i = 0; i < n; ++i) {
+            if (block[i] < prev) sorted = false;
+            prev = block[i];
+            sum += static_cast<uint64_t>(static_cast<int64_t>(block[i]));
+        }
+        count += n;
+    }
+    return true;
+}
+
+// Reads the "total" phase of a --metrics-out file (one phase per line).
+static void readTotals(const std::string& metricsFile, Result& r) {
+    std::ifstream in(metricsFile);
+    std::string line;
+    auto field = [](const std::string& text, const std::string& key) -> uint64_t {
+        size_t pos = text.find("\"" + key + "\": ");
+        return pos == std::string::npos ? 0 : std::stoull(text.substr(pos + key.size() + 4));
+    };
+    while (std::getline(in, line)) {
+        if (line.find("\"name\": \"total\"") != std::string::npos) {
+            r.bytesRead = field(line, "bytes_read");
+            r.bytesWritten = field(line, "bytes_written");
+        }
+    }
+}
+
+// Runs one sort as a child process; returns wall seconds or -1 on failure.
+static double runSort(const std::vector<std::string>& argv, const std::string& logFile, uint64_t& peakRss) {
+    auto start = std::chrono::steady_clock::now();
+    pid_t pid = fork();
+    if (pid < 0) return -1;
+    if (pid == 0) {
+        int devnull = open("/dev/null", O_WRONLY);
+        int log = open(logFile.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        dup2(devnull, STDOUT_FILENO);
+        if (log >= 0) dup2(log, STDERR_FILENO);
+        std::vector<char*> args;
+        for (const std::string& a : argv) args.push_back(const_cast<char*>(a.c_str()));
+        args.push_back(nullptr);
+        execv(args[0], args.data());
+        _exit(127);
+    }
+    int status = 0;
+    struct rusage usage;
+    if (wait4(pid, &status, 0, &usage) < 0) return -1;
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    peakRss = static_cast<uint64_t>(usage.ru_maxrss) * 1024;
+    return WIFEXITED(status) && WEXITSTATUS(status) == 0 ? seconds : -1;
+}
+
+static std::string csvRow(const Result& r) {
+    std::ostringstream ss;
+    ss << r.data.run << "," << r.data.dist << "," << r.data.bytes << "," << r.data.seed << ","
+       << r.engine << "," << r.config << "," << r.memLimit << ","
+       << std::fixed << std::setprecision(3) << r.seconds << "," << r.mbPerSec << ","
+       << r.bytesRead << "," << r.bytesWritten << "," << r.peakRss << "," << (r.verified ? 1 : 0);
+    return ss.str();
+}
+
+static bool writeCsv(const std::string& path, const std::vector<Result>& results) {
+    std::ofstream out(path);
+    if (!out) return false;
+    out << CSV_HEADER << "\n";
+    for (const Result& r : results) out << csvRow(r) << "\n";
+    return static_cast<bool>(out);
+}
+
+// Identifies a cell across result files: everything but the measurements.
+static std::string cellKey(const std::vector<std::string>& cols) {
+    return cols[1] + "," + cols[2] + "," + cols[3] + "," + cols[4] + "," + cols[5] + "," + cols[6];
+}
+
+// Compares throughput against a stored results file. Returns the number of
+// cells that regressed by more than `tolerancePct`.
+static int checkBaseline(const std::string& path, const std::vector<Result>& results, double tolerancePct) {
+    std::ifstream in(path);
+    if (!in) {
+        std::cerr << "Could not open baseline " << path << std::endl;
+        return -1;
+    }
+    std::map<std::string, double> baseline;
+    std::string line;
+    std::getline(in, line); // header
+    while (std::getline(in, line)) {
+        std::vector<std::string> cols;
+        std::stringstream ss(line);
+        std::string col;
+        while (std::getline(ss, col, ',')) cols.push_back(col);
+        if (cols.size() < 9) continue;
+        try {
+            baseline[cellKey(cols)] = std::stod(cols[8]);
+        } catch (const std::exception&) {
+            std::cerr << "Bad baseline row in " << path << ": " << line << std::endl;
+            return -1;
+        }
+    }
+
+    int regressions = 0;
+    std::cout << "--- Regression check against " << path << " (tolerance " << tolerancePct << "%) ---" << std::endl;
+    for (const Result& r : results) {
+        std::vector<std::string> cols;
+        std::stringstream ss(csvRow(r));
+        std::string col;
+        while (std::getline(ss, col, ',')) cols.push_back(col);
+        auto it = baseline.find(cellKey(cols));
+        if (it == baseline.end() || it->second <= 0) continue;
+        double change = (r.mbPerSec - it->second) / it->second * 100.0;
+        bool failed = !r.verified || change < -tolerancePct;
+        std::cout << "  " << (failed ? "FAIL " : "ok   ") << r.engine << " " << r.config << " "
+                  << r.data.dist << "/" << sizeLabel(r.data.bytes) << "/seed" << r.data.seed
+                  << " mem=" << sizeLabel(r.memLimit) << ": " << std::fixed << std::setprecision(1)
+                  << it->second << " -> " << r.mbPerSec << " MB/s (" << std::showpos << change
+                  << std::noshowpos << "%)" << std::endl;
+        if (failed) regressions++;
+    }
+    return regressions;
+}
+
+int main(int argc, char* argv[]) {
+    std::vector<std::string> args(argv + 1, argv + argc);
+    if (takeFlag(args, "--help")) {
+        printUsage(argv[0]);
+        return 0;
+    }
+
+    std::string dists = "uniform", sizes = "256M", seeds = "1,2,3", mems = "16M";
+    std::string kValues = "heuristic,4,8,16", qsConfigs = "A=2:2:2:10,B=1:1:1:13,C=2:1:1:12";
+    std::string engines = "merge,quick", repeat = "1", tolerance = "10";
+    std::string dataDir = "data/bench", tmpDir, binDir = "bin";
+    std::string timesFile = "report/times.dat", csvFile = "report/bench.csv", baselineFile, saveBaseline;
+    takeOption(args, "--dists", dists);
+    takeOption(args, "--sizes", sizes);
+    takeOption(args, "--seeds", seeds);
+    takeOption(args, "--mem", mems);
+    takeOption(args, "--k", kValues);
+    takeOption(args, "--qs-configs", qsConfigs);
+    takeOption(args, "--engines", engines);
+    takeOption(args, "--repeat", repeat);
+    takeOption(args, "--data-dir", dataDir);
+    takeOption(args, "--tmp-dir", tmpDir);
+    takeOption(args, "--bin-dir", binDir);
+    takeOption(args, "--times", timesFile);
+    takeOption(args, "--csv", csvFile);
+    takeOption(args, "--baseline", baselineFile);
+    takeOption(args, "--tolerance", tolerance);
+    takeOption(args, "--save-baseline", saveBaseline);
+    if (!args.empty()) {
+        std::cerr << "Unknown argument: " << args[0] << std::endl;
+        printUsage(argv[0]);
+        return 1;
+    }
+
+    std::vector<Dataset> datasets;
+    std::vector<size_t> memLimits;
+    std::vector<Config> configs;
+    int repeats;
+    double tolerancePct;
+    try {
+        for (const std::string& d : splitList(dists)) {
+            for (const std::string& s : splitList(sizes)) {
+                for (const std::string& seed : splitList(seeds)) {
+                    Dataset ds;
+                    ds.run = static_cast<int>(datasets.size()) + 1;
+                    ds.dist = d;
+                    ds.bytes = parseByteSize(s) / sizeof(int) * sizeof(int);
+                    ds.seed = std::stoull(seed);
+                    ds.path = dataDir + "/" + d + "_" + sizeLabel(ds.bytes) + "_seed" + seed + ".bin";
+                    Distribution check(d, ds.seed, 1); // rejects unknown names
+                    datasets.push_back(ds);
+                }
+            }
+        }
+        for (const std::string& m : splitList(mems)) memLimits.push_back(parseByteSize(m));
+
+        std::vector<std::string> engineList = splitList(engines);
+        auto wanted = [&](const std::string& e) {
+            return std::find(engineList.begin(), engineList.end(), e) != engineList.end();
+        };
+        if (wanted("merge")) {
+            for (const std::string& k : splitList(kValues)) {
+                Config c{"merge", "K=" + k, {}, 0};
+                if (k != "heuristic") c.args.push_back(std::to_string(std::stoi(k)));
+                configs.push_back(c);
+            }
+        }
+        if (wanted("quick")) {
+            for (const std::string& spec : splitList(qsConfigs)) {
+                size_t eq = spec.find('=');
+                Config c{"quick", "QS_" + spec.substr(0, eq), {}, 0};
+                if (eq == std::string::npos) {
+                    c.name = "QS_" + spec; // default split
+                } else {
+                    std::stringstream ss(spec.substr(eq + 1));
+                    std::string mb;
+                    while (std::getline(ss, mb, ':')) {
+                        c.args.push_back(std::to_string(std::stoi(mb)));
+                        c.configBytes += static_cast<size_t>(std::stoi(mb)) << 20;
+                    }
+                    if (c.args.size() != 4) throw std::invalid_argument("quick sort config needs 4 sizes: " + spec);
+                }
+                configs.push_back(c);
+            }
+        }
+        repeats = std::max(1, std::stoi(repeat));
+        tolerancePct = std::stod(tolerance);
+    } catch (const std::exception& e) {
+        std::cerr << "Invalid arguments: " << e.what() << std::endl;
+        printUsage(argv[0]);
+        return 1;
+    }
+
+    makeDirs(dataDir);
+    const std::string outFile = dataDir + "/sorted.bin";
+    const std::string metricsFile = dataDir + "/metrics.json";
+    std::vector<Result> results;
+
+    for (const Dataset& d : datasets) {
+        if (!ensureDataset(d)) return 1;
+        uint64_t inCount, inSum;
+        bool inSorted;
+        fingerprint(d.path, inCount, inSum, inSorted);
+
+        for (size_t mem : memLimits) {
+            for (const Config& c : configs) {
+                if (c.configBytes > mem) continue; // split does not fit this limit
+                Result r;
+                r.data = d;
+                r.engine = c.engine;
+                r.config = c.name + (memLimits.size() > 1 ? "@" + sizeLabel(mem) : "");
+                r.memLimit = mem;
+
+                std::vector<std::string> cmd = {binDir + (c.engine == "merge" ? "/merge_sort_exec" : "/quick_sort_exec"),
+                                                d.path, outFile, std::to_string(mem)};
+                cmd.insert(cmd.end(), c.args.begin(), c.args.end());
+                cmd.insert(cmd.end(), {"--metrics-out", metricsFile});
+                if (!tmpDir.empty()) cmd.insert(cmd.end(), {"--tmp-dir", tmpDir});
+
+                std::cout << "Run " << d.run << " (" << d.dist << ", " << sizeLabel(d.bytes) << ", seed " << d.seed
+                          << "): " << c.engine << " " << c.name << ", mem " << sizeLabel(mem) << "... " << std::flush;
+                std::vector<double> times;
+                for (int i = 0; i < repeats; ++i) {
+                    uint64_t rss = 0;
+                    double t = runSort(cmd, dataDir + "/" + c.engine + ".log", rss);
+                    if (t < 0) {
+                        times.clear();
+                        break;
+                    }
+                    times.push_back(t);
+                    r.peakRss = std::max(r.peakRss, rss);
+                }
+                if (!times.empty()) {
+                    std::sort(times.begin(), times.end());
+                    r.seconds = times[times.size() / 2];
+                    r.mbPerSec = d.bytes / r.seconds / (1024.0 * 1024.0);
+                    readTotals(metricsFile, r);
+                    uint64_t outCount, outSum;
+                    bool outSorted;
+                    r.verified = fingerprint(outFile, outCount, outSum, outSorted)
+                              && outSorted && outCount == inCount && outSum == inSum;
+                }
+                remove(outFile.c_str());
+                remove(metricsFile.c_str());
+
+                if (r.seconds < 0) {
+                    std::cout << "FAILED (see " << dataDir << "/" << c.engine << ".log)" << std::endl;
+                } else {
+                    std::cout << std::fixed << std::setprecision(2) << r.seconds << " s, "
+                              << r.mbPerSec << " MB/s, peak RSS " << r.peakRss / (1024 * 1024) << " MB"
+                              << (r.verified ? "" : ", OUTPUT NOT SORTED") << std::endl;
+                    std::cout.unsetf(std::ios::fixed);
+                }
+                results.push_back(r);
+            }
+        }
+    }
+
+    // The report pipeline (generate_report, plot_graphs.py) reads this table.
+    std::ofstream times(timesFile);
+    times << "Run,AlgorithmConfig,MergeSortTime,QuickSortTime\n";
+    for (const Result& r : results) {
+        std::ostringstream t;
+        t << std::fixed << std::setprecision(3) << (r.verified ? r.seconds : -1.0);
+        times << r.data.run << "," << r.config << ","
+              << (r.engine == "merge" ? t.str() + "," : "," + t.str()) << "\n";
+    }
+    times.close();
+    if (!writeCsv(csvFile, results)) {
+        std::cerr << "Failed to write " << csvFile << std::endl;
+        return 1;
+    }
+    std::cout << "--- Results written to " << timesFile << " and " << csvFile << " ---" << std::endl;
+    if (!saveBaseline.empty() && writeCsv(saveBaseline, results)) {
+        std::cout << "Baseline saved to " << saveBaseline << std::endl;
+    }
+
+    bool failed = std::any_of(results.begin(), results.end(), [](const Result& r) { return !r.verified; });
+    if (!baselineFile.empty()) {
+        int regressions = checkBaseline(baselineFile, results, tolerancePct);
+        if (regressions != 0) {
+            std::cerr << (regressions < 0 ? "Baseline unavailable." : std::to_string(regressions) + " regression(s) found.")
+                      << std::endl;
+            return 1;
+        }
+        std::cout << "No regressions." << std::endl;
+    }
+    return failed ? 1 : 0;
+}
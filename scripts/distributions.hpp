@@ -0,0 +1,187 @@
+#pragma once
+
+#include <cstdint>
+#include <cmath>
+#include <string>
+#include <vector>
+#include <limits>
+#include <stdexcept>
+
+// Seeded input distributions for benchmarks and test data. Record i of a
+// dataset depends only on (distribution, seed, i, record count), so any
+// range of records can be generated independently and every run of the
+// same dataset is byte-identical.
+
+inline uint64_t mix64(uint64_t z) {
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+// SplitMix64 stream started from a (seed, counter) pair.
+class CounterRng {
+public:
+    CounterRng(uint64_t seed, uint64_t counter) : state(mix64(seed ^ mix64(counter + 0x9E3779B97F4A7C15ULL))) {}
+    uint64_t next() {
+        state += 0x9E3779B97F4A7C15ULL;
+        return mix64(state);
+    }
+    // Uniform in [0, 1).
+    double nextDouble() {
+        return (next() >> 11) * (1.0 / 9007199254740992.0);
+    }
+    // Uniform in [0, bound).
+    uint64_t nextBelow(uint64_t bound) {
+        return static_cast<uint64_t>((static_cast<unsigned __int128>(next()) * bound) >> 64);
+    }
+
+private:
+    uint64_t state;
+};
+
+// Zipf(s) over ranks 1..n by rejection-inversion (Hormann & Derflinger),
+// O(1) expected draws per sample and no tables.
+class ZipfSampler {
+public:
+    ZipfSampler(uint64_t n, double exponent) : n(n), s(exponent) {
+        hX1 = hIntegral(1.5) - 1.0;
+        hN = hIntegral(n + 0.5);
+        threshold = 2.0 - hIntegralInverse(hIntegral(2.5) - h(2.0));
+    }
+
+    uint64_t sample(CounterRng& rng) const {
+        while (true) {
+            double u = hN + rng.nextDouble() * (hX1 - hN);
+            double x = hIntegralInverse(u);
+            double k = std::floor(x + 0.5);
+            if (k < 1) k = 1;
+            if (k > n) k = static_cast<double>(n);
+            if (k - x <= threshold || u >= hIntegral(k + 0.5) - h(k)) {
+                return static_cast<uint64_t>(k);
+            }
+        }
+    }
+
+private:
+    static double helper1(double x) {
+        return std::fabs(x) > 1e-8 ? std::log1p(x) / x : 1 - x * (0.5 - x * (1.0 / 3 - 0.25 * x));
+    }
+    static double helper2(double x) {
+        return std::fabs(x) > 1e-8 ? std::expm1(x) / x : 1 + x * 0.5 * (1 + x / 3 * (1 + 0.25 * x));
+    }
+    double h(double x) const { return std::exp(-s * std::log(x)); }
+    double hIntegral(double x) const {
+        double logX = std::log(x);
+        return helper2((1 - s) * logX) * logX;
+    }
+    double hIntegralInverse(double x) const {
+        double t = x * (1 - s);
+        if (t < -1) t = -1;
+        return std::exp(helper1(t) * x);
+    }
+
+    uint64_t n;
+    double s, hX1, hN, threshold;
+};
+
+// Names accepted by Distribution, in the order they are documented.
+inline const std::vector<std::string>& distributionNames() {
+    static const std::vector<std::string> names = {
+        "uniform",       // 1..range (default 1,000,000, as the original generate_input)
+        "zipf",          // ranks 1..range with exponent s (a few hot keys)
+        "sorted",        // non-decreasing over the whole positive range
+        "reverse",       // non-increasing
+        "sawtooth",      // ascending teeth of 2^20 records
+        "few-unique",    // 16 distinct values
+        "all-equal",     // one value
+        "full-range",    // uniform over every key value, negatives included
+        "normal",        // Gaussian around range/2
+        "nearly-sorted", // sorted, with a `noise` fraction of random keys
+        "duplicates"     // a `dup_ratio` fraction drawn from 1,000 hot keys
+    };
+    return names;
+}
+
+// Tunables for the parameterised distributions.
+struct DistributionParams {
+    int keyBits = 32;          // 32 or 64
+    uint64_t range = 1000000;  // uniform/zipf/normal key space
+    double zipfExponent = 1.1;
+    double stddev = 0;         // normal; 0 means range / 8
+    double noise = 0.01;       // nearly-sorted
+    double dupRatio = 0.5;     // duplicates
+};
+
+class Distribution {
+public:
+    Distribution(const std::string& name, uint64_t seed, uint64_t records,
+                 const DistributionParams& params = DistributionParams())
+        : kind(-1), seed(seed), records(records ? records : 1), params(params),
+          positive(params.keyBits == 64 ? std::numeric_limits<int64_t>::max() : std::numeric_limits<int>::max()),
+          zipf(params.range, params.zipfExponent) {
+        const std::vector<std::string>& names = distributionNames();
+        for (size_t k = 0; k < names.size(); ++k) {
+            if (names[k] == name) kind = static_cast<int>(k);
+        }
+        if (kind < 0) throw std::invalid_argument("Unknown distribution: " + name);
+        if (params.keyBits != 32 && params.keyBits != 64) throw std::invalid_argument("Key bits must be 32 or 64");
+        if (params.range == 0) throw std::invalid_argument("Range must be positive");
+    }
+
+    // Writes records [first, first + count) to out (32-bit keys).
+    void fill(int* out, uint64_t first, size_t count) const {
+        for (size_t j = 0; j < count; ++j) out[j] = at(first + j);
+    }
+
+    int at(uint64_t i) const {
+        return static_cast<int>(key(i));
+    }
+
+    // Key of record i; fits in keyBits.
+    int64_t key(uint64_t i) const {
+        CounterRng rng(seed, i);
+        switch (kind) {
+            case UNIFORM: return 1 + static_cast<int64_t>(rng.nextBelow(params.range));
+            case ZIPF: return static_cast<int64_t>(zipf.sample(rng));
+            case SORTED: return scaled(i, records);
+            case REVERSE: return scaled(records - 1 - i, records);
+            case SAWTOOTH: return scaled(i % SAW_TOOTH, SAW_TOOTH);
+            case FEW_UNIQUE: return static_cast<int64_t>(rng.nextBelow(16) * 1000003);
+            case ALL_EQUAL: return 42;
+            case NORMAL: {
+                // Box-Muller; clamped to [0, positive].
+                double u1 = 1.0 - rng.nextDouble(), u2 = rng.nextDouble();
+                double z = std::sqrt(-2.0 * std::log(u1)) * std::cos(6.283185307179586 * u2);
+                double sd = params.stddev > 0 ? params.stddev : params.range / 8.0;
+                double v = std::round(params.range / 2.0 + z * sd);
+                return v <= 0 ? 0 : v >= static_cast<double>(positive) ? positive : static_cast<int64_t>(v);
+            }
+            case NEARLY_SORTED:
+                return rng.nextDouble() < params.noise ? static_cast<int64_t>(rng.nextBelow(positive))
+                                                       : scaled(i, records);
+            case DUPLICATES:
+                return rng.nextDouble() < params.dupRatio ? static_cast<int64_t>(mix64(rng.nextBelow(1000)) % positive)
+                                                          : static_cast<int64_t>(rng.nextBelow(positive));
+            default:
+                return params.keyBits == 64 ? static_cast<int64_t>(rng.next())
+                                            : static_cast<int32_t>(static_cast<uint32_t>(rng.next() >> 32));
+        }
+    }
+
+private:
+    // Indices into distributionNames().
+    enum { UNIFORM, ZIPF, SORTED, REVERSE, SAWTOOTH, FEW_UNIQUE, ALL_EQUAL, FULL_RANGE,
+           NORMAL, NEARLY_SORTED, DUPLICATES };
+    static const uint64_t SAW_TOOTH = 1 << 20;
+
+    // Maps i in [0, n) monotonically onto [0, positive).
+    int64_t scaled(uint64_t i, uint64_t n) const {
+        return static_cast<int64_t>(static_cast<unsigned __int128>(i) * static_cast<uint64_t>(positive) / n);
+    }
+
+    int kind;
+    uint64_t seed, records;
+    DistributionParams params;
+    int64_t positive;
+    ZipfSampler zipf;
+};
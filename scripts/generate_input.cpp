@@ -1,33 +1,151 @@
+#include "distributions.hpp"
 #include <iostream>
-#include <fstream>
-#include <cstdlib>
-#include <ctime>
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+
+// Writes a binary input file from a seeded distribution. Records are
+// generated in fixed-size blocks by a pool of threads and written with
+// pwrite at their final offsets; record i only depends on the seed and i,
+// so the file is identical for any thread count.
+
+static void printUsage() {
+    std::cerr << "Usage: ./generate_input <output_file> <size> [options]\n"
+              << "  size                  MB, or with a K/M/G suffix (e.g. 256, 50G)\n"
+              << "  --dist NAME           distribution (default uniform):";
+    for (const std::string& d : distributionNames()) std::cerr << " " << d;
+    std::cerr << "\n"
+              << "  --seed N              PRNG seed (default 1)\n"
+              << "  --threads N           generator threads (default: all cores)\n"
+              << "  --key-bits 32|64      key width (default 32; the sorters read 32-bit keys)\n"
+              << "  --record-bytes N      record width; bytes past the key are seeded payload\n"
+              << "  --range N             key space for uniform/zipf/normal (default 1000000)\n"
+              << "  --zipf-s X            zipf exponent (default 1.1)\n"
+              << "  --stddev X            normal standard deviation (default range/8)\n"
+              << "  --noise X             nearly-sorted fraction of random keys (default 0.01)\n"
+              << "  --dup-ratio X         duplicates fraction of hot keys (default 0.5)\n";
+}
+
+// Size argument: a bare number is MB (the original interface).
+static uint64_t parseSize(const std::string& text) {
+    size_t idx = 0;
+    uint64_t value = std::stoull(text, &idx);
+    std::string suffix = text.substr(idx);
+    if (suffix.empty() || suffix == "M" || suffix == "MB") return value << 20;
+    if (suffix == "K" || suffix == "KB") return value << 10;
+    if (suffix == "G" || suffix == "GB") return value << 30;
+    if (suffix == "B") return value;
+    throw std::invalid_argument("Unknown size suffix: " + text);
+}
 
 int main(int argc, char* argv[]) {
-    if (argc != 3) {
-        std::cerr << "Usage: ./generate_input <output_file> <size_in_MB>\n";
+    if (argc < 3) {
+        printUsage();
         return 1;
     }
-
     std::string fileName = argv[1];
-    int fileSizeMB = std::stoi(argv[2]);
-    size_t bytesToWrite = fileSizeMB * 1024 * 1024;
-    size_t intsToWrite = bytesToWrite / sizeof(int);
+    std::string dist = "uniform";
+    uint64_t seed = 1, bytesToWrite;
+    unsigned threads = std::max(1u, std::thread::hardware_concurrency());
+    size_t recordBytes = 0;
+    DistributionParams params;
+    try {
+        bytesToWrite = parseSize(argv[2]);
+        for (int i = 3; i < argc; ++i) {
+            std::string opt = argv[i];
+            if (i + 1 >= argc) throw std::invalid_argument("Missing value for " + opt);
+            std::string val = argv[++i];
+            if (opt == "--dist") dist = val;
+            else if (opt == "--seed") seed = std::stoull(val);
+            else if (opt == "--threads") threads = std::max(1, std::stoi(val));
+            else if (opt == "--key-bits") params.keyBits = std::stoi(val);
+            else if (opt == "--record-bytes") recordBytes = std::stoul(val);
+            else if (opt == "--range") params.range = std::stoull(val);
+            else if (opt == "--zipf-s") params.zipfExponent = std::stod(val);
+            else if (opt == "--stddev") params.stddev = std::stod(val);
+            else if (opt == "--noise") params.noise = std::stod(val);
+            else if (opt == "--dup-ratio") params.dupRatio = std::stod(val);
+            else throw std::invalid_argument("Unknown option " + opt);
+        }
+        Distribution check(dist, seed, 1, params); // rejects bad names/parameters
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << "\n";
+        printUsage();
+        return 1;
+    }
 
-    std::ofstream outFile(fileName, std::ios::binary);
-    if (!outFile) {
-        std::cerr << "Failed to open output file.\n";
+    const size_t keyBytes = params.keyBits / 8;
+    if (recordBytes == 0) recordBytes = keyBytes;
+    if (recordBytes < keyBytes) {
+        std::cerr << "Record width must be at least the key width (" << keyBytes << " bytes).\n";
         return 1;
     }
+    const uint64_t records = bytesToWrite / recordBytes;
 
-    std::srand(std::time(nullptr));
-    for (size_t i = 0; i < intsToWrite; ++i) {
-        int num = 1 + std::rand() % 1000000;
-        outFile.write(reinterpret_cast<char*>(&num), sizeof(int));
+    Distribution generator(dist, seed, records, params);
+    int fd = open(fileName.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        std::cerr << "Failed to open output file.\n";
+        return 1;
     }
 
-    outFile.close();
-    std::cout << "File '" << fileName << "' generated (" << fileSizeMB << " MB, " 
-          << intsToWrite << " numbers).\n";
+    // 4 MB of records per block; blocks are handed out in order so the
+    // writes stay close to sequential.
+    const uint64_t perBlock = std::max<uint64_t>(1, (4 << 20) / recordBytes);
+    const uint64_t blocks = (records + perBlock - 1) / perBlock;
+    std::atomic<uint64_t> nextBlock(0);
+    std::atomic<bool> failed(false);
+    auto start = std::chrono::steady_clock::now();
+
+    auto worker = [&]() {
+        std::vector<char> buf(perBlock * recordBytes);
+        for (uint64_t b = nextBlock++; b < blocks && !failed; b = nextBlock++) {
+            uint64_t first = b * perBlock;
+            uint64_t n = std::min(perBlock, records - first);
+            char* out = buf.data();
+            for (uint64_t i = first; i < first + n; ++i, out += recordBytes) {
+                int64_t key = generator.key(i);
+                if (keyBytes == 4) {
+                    int32_t k32 = static_cast<int32_t>(key);
+                    std::memcpy(out, &k32, 4);
+                } else {
+                    std::memcpy(out, &key, 8);
+                }
+                // Payload: a second seeded stream, so it is reproducible too.
+                for (size_t off = keyBytes; off < recordBytes; off += 8) {
+                    uint64_t word = mix64(seed ^ mix64(i * 0x100000001B3ULL + off));
+                    std::memcpy(out + off, &word, std::min<size_t>(8, recordBytes - off));
+                }
+            }
+            size_t len = n * recordBytes;
+            off_t offset = static_cast<off_t>(first * recordBytes);
+            for (size_t done = 0; done < len;) {
+                ssize_t w = pwrite(fd, buf.data() + done, len - done, offset + done);
+                if (w <= 0) {
+                    failed = true;
+                    break;
+                }
+                done += static_cast<size_t>(w);
+            }
+        }
+    };
+    std::vector<std::thread> pool;
+    for (unsigned t = 0; t < threads; ++t) pool.emplace_back(worker);
+    for (auto& t : pool) t.join();
+
+    if (close(fd) != 0 || failed) {
+        std::cerr << "Failed to write " << fileName << ".\n";
+        return 1;
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cout << "File '" << fileName << "' generated (" << (records * recordBytes >> 20) << " MB, "
+              << records << " records, " << dist << ", seed " << seed << ", "
+              << (seconds > 0 ? records * recordBytes / seconds / (1024 * 1024) : 0) << " MB/s).\n";
     return 0;
 }
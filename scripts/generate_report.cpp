@@ -62,6 +62,18 @@ void print_table_rows(const std::string& algo_name, const std::vector<std::strin
     }
 }
 
+// The classic configurations in their usual order, then any others the
+// benchmark sweep produced (e.g. "K=8@64M") in name order.
+std::vector<std::string> config_order(const std::vector<std::string>& classic, const ResultsMap& results) {
+    std::vector<std::string> order = classic;
+    for (const auto& entry : results) {
+        if (std::find(classic.begin(), classic.end(), entry.first) == classic.end()) {
+            order.push_back(entry.first);
+        }
+    }
+    return order;
+}
+
 void print_latex_report(const ResultsMap& ms_results, const ResultsMap& qs_results, size_t num_runs) {
     std::cout << "\\documentclass{article}\n"
               << "\\usepackage{graphicx}\n"
@@ -112,18 +124,20 @@ void print_latex_report(const ResultsMap& ms_results, const ResultsMap& qs_resul
               << "Table~\\ref{tab:perf_summary} summarizes execution times for each algorithm and configuration across three runs.\n\n"
               << "\\begin{table}[h!]\n"
               << "\\centering\n"
-              << "\\begin{tabular}{l l c c c c}\n"
+              << "\\begin{tabular}{l l " << std::string(num_runs, 'c') << "c}\n"
               << "\\toprule\n"
-              << "\\textbf{Algorithm} & \\textbf{Configuration} & \\textbf{Run 1 (s)} & \\textbf{Run 2 (s)} & \\textbf{Run 3 (s)} & \\textbf{Average (s)} \\\\\n"
+              << "\\textbf{Algorithm} & \\textbf{Configuration} ";
+    for (size_t run = 1; run <= num_runs; ++run) {
+        std::cout << "& \\textbf{Run " << run << " (s)} ";
+    }
+    std::cout << "& \\textbf{Average (s)} \\\\\n"
               << "\\midrule\n";
 
-    const std::vector<std::string> ms_config_order = {"K=heuristic", "K=4", "K=8", "K=16"};
-    print_table_rows("Merge Sort", ms_config_order, ms_results, num_runs);
+    print_table_rows("Merge Sort", config_order({"K=heuristic", "K=4", "K=8", "K=16"}, ms_results), ms_results, num_runs);
 
     std::cout << "\\midrule\n";
 
-    const std::vector<std::string> qs_config_order = {"QS_A", "QS_B", "QS_C"};
-    print_table_rows("Quick Sort", qs_config_order, qs_results, num_runs);
+    print_table_rows("Quick Sort", config_order({"QS_A", "QS_B", "QS_C"}, qs_results), qs_results, num_runs);
 
     std::cout << "\\bottomrule\n"
               << "\\end{tabular}\n"
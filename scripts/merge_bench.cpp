@@ -0,0 +1,166 @@
+#include "../merge_sort/merge_kernels.hpp"
+#include "../merge_sort/sort_options.hpp"
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <random>
+#include <algorithm>
+#include <chrono>
+
+// Merge kernel microbenchmark: K sorted runs held in memory are merged by
+// each kernel in turn (scalar loser tree, register select, two-way merge,
+// FIFO merge tree at each SIMD level), so the numbers show the kernels
+// alone, without disk I/O. Speedups are against the scalar loser tree
+// (the scalar two-way merge at K = 2).
+
+bool g_debug_logging_enabled = false;
+
+// Hands out one run a block at a time, like a FileReader over its buffer.
+struct MemoryReader {
+    const int* pos;
+    const int* end;
+    size_t block;
+    size_t nextBlock(const int*& records) {
+        size_t n = std::min<size_t>(block, end - pos);
+        records = pos;
+        pos += n;
+        return n;
+    }
+};
+
+// Collects the output in one array, a FileWriter-sized window at a time.
+// Like a FileWriter it always has room: the array is one window longer
+// than the merge result.
+struct ArrayWriter {
+    std::vector<int>& out;
+    size_t window;
+    size_t used = 0;
+    int* reserve(size_t& room) {
+        room = std::min(window, out.size() - used);
+        return out.data() + used;
+    }
+    void commit(size_t n) { used += n; }
+};
+
+struct Kernel {
+    std::string name;
+    SimdLevel simd;
+    bool (*fits)(int k);
+    uint64_t (*merge)(RunCursor<int, MemoryReader>* runs, int k, ArrayWriter& out);
+};
+
+static uint64_t runTree(RunCursor<int, MemoryReader>* runs, int k, ArrayWriter& out) { return mergeTree(runs, k, out); }
+static uint64_t runTwo(RunCursor<int, MemoryReader>* runs, int, ArrayWriter& out) { return mergeTwo(runs, out); }
+static uint64_t runFifo(RunCursor<int, MemoryReader>* runs, int k, ArrayWriter& out) { return mergeFifoTree(runs, k, out); }
+static uint64_t runSelect(RunCursor<int, MemoryReader>* runs, int k, ArrayWriter& out) {
+    return k <= 4 ? mergeSelect<4>(runs, k, out) : mergeSelect<8>(runs, k, out);
+}
+
+static void printUsage(const char* prog) {
+    std::cerr << "Usage: " << prog << " [options]\n"
+              << "  --k 2,3,4,...        fan-in values (default 2,3,4,6,8,12,16,24,32,48,64)\n"
+              << "  --records N          records merged per measurement (default 16M)\n"
+              << "  --block N            records per input block (default 16384)\n"
+              << "  --repeat N           runs per cell, the best is kept (default 3)\n"
+              << "  --seed N             key generator seed (default 1)\n";
+}
+
+int main(int argc, char* argv[]) {
+    std::vector<std::string> args(argv + 1, argv + argc);
+    if (takeFlag(args, "--help")) {
+        printUsage(argv[0]);
+        return 0;
+    }
+    std::string kValues = "2,3,4,6,8,12,16,24,32,48,64", records = "16M", block = "16384", repeat = "3", seed = "1";
+    takeOption(args, "--k", kValues);
+    takeOption(args, "--records", records);
+    takeOption(args, "--block", block);
+    takeOption(args, "--repeat", repeat);
+    takeOption(args, "--seed", seed);
+    if (!args.empty()) {
+        std::cerr << "Unknown argument: " << args[0] << std::endl;
+        printUsage(argv[0]);
+        return 1;
+    }
+
+    std::vector<int> ks;
+    size_t total, blockRecords;
+    int repeats;
+    std::mt19937 rng;
+    try {
+        for (const std::string& k : splitList(kValues)) ks.push_back(std::stoi(k));
+        total = parseByteSize(records);
+        blockRecords = std::stoul(block);
+        repeats = std::max(1, std::stoi(repeat));
+        rng.seed(std::stoul(seed));
+    } catch (const std::exception& e) {
+        std::cerr << "Invalid arguments: " << e.what() << std::endl;
+        printUsage(argv[0]);
+        return 1;
+    }
+
+    const SimdLevel best = detectSimdLevel();
+    std::vector<Kernel> kernels = {
+        {"tree", SimdLevel::None, [](int k) { return k > 2; }, runTree},
+        {"select", SimdLevel::None, [](int k) { return k > 2 && k <= 8; }, runSelect},
+        {"two", SimdLevel::None, [](int k) { return k == 2; }, runTwo},
+        {"fifo", SimdLevel::None, [](int k) { return k > 2; }, runFifo},
+    };
+    for (SimdLevel level : {SimdLevel::AVX2, SimdLevel::AVX512}) {
+        if (static_cast<int>(level) > static_cast<int>(best)) continue;
+        kernels.push_back({std::string("two/") + simdLevelName(level), level, [](int k) { return k == 2; }, runTwo});
+        kernels.push_back({std::string("fifo/") + simdLevelName(level), level, [](int k) { return k > 2; }, runFifo});
+    }
+
+    std::cout << "Merging " << total << " records, " << blockRecords << " per block; CPU SIMD: "
+              << simdLevelName(best) << "\n\n"
+              << std::left << std::setw(5) << "K" << std::setw(14) << "kernel"
+              << std::right << std::setw(12) << "Mrec/s" << std::setw(12) << "vs scalar" << "\n";
+
+    std::uniform_int_distribution<int> keys(INT32_MIN, INT32_MAX);
+    const size_t window = 1 << 18;
+    std::vector<int> input(total), output(total + window);
+    for (int k : ks) {
+        if (k < 2) continue;
+        // K sorted runs of near-equal length, back to back in `input`.
+        std::vector<size_t> starts;
+        for (int i = 0; i <= k; ++i) starts.push_back(total * i / k);
+        for (int& key : input) key = keys(rng);
+        for (int i = 0; i < k; ++i) std::sort(input.begin() + starts[i], input.begin() + starts[i + 1]);
+        std::vector<int> expected(input);
+        std::sort(expected.begin(), expected.end());
+
+        double treeRate = 0;
+        for (const Kernel& kernel : kernels) {
+            if (!kernel.fits(k)) continue;
+            setSimdLevel(kernel.simd);
+            double bestSeconds = 0;
+            for (int r = 0; r < repeats; ++r) {
+                std::vector<MemoryReader> readers;
+                for (int i = 0; i < k; ++i) {
+                    readers.push_back({input.data() + starts[i], input.data() + starts[i + 1], blockRecords});
+                }
+                std::vector<RunCursor<int, MemoryReader>> runs(k);
+                for (int i = 0; i < k; ++i) runs[i].reader = &readers[i];
+                ArrayWriter writer{output, window};
+                auto start = std::chrono::steady_clock::now();
+                uint64_t written = kernel.merge(runs.data(), k, writer);
+                double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+                if (written != total || !std::equal(expected.begin(), expected.end(), output.begin())) {
+                    std::cerr << "Kernel " << kernel.name << " produced a wrong result at K=" << k << std::endl;
+                    return 1;
+                }
+                if (r == 0 || seconds < bestSeconds) bestSeconds = seconds;
+            }
+            double rate = total / bestSeconds / 1e6;
+            if (kernel.name == "tree" || (k == 2 && kernel.name == "two")) treeRate = rate;
+            std::cout << std::left << std::setw(5) << k << std::setw(14) << kernel.name << std::right
+                      << std::fixed << std::setprecision(1) << std::setw(12) << rate
+                      << std::setw(11) << rate / treeRate << "x" << std::defaultfloat << "\n";
+        }
+        std::cout << std::flush;
+    }
+    setSimdLevel(best);
+    return 0;
+}
@@ -1,40 +1,221 @@
 #include <iostream>
 #include <fstream>
 #include <vector>
+#include <string>
+#include <thread>
 #include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <climits>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "../merge_sort/key_spec.hpp"
+
+// Checks that a file of ints is sorted and, given the input it was produced
+// from, that it holds exactly the same records. Files are mapped and split
+// into one chunk per thread; chunks are checked independently and then
+// stitched together at their boundaries. With --key SPEC the order checked
+// is the spec's (records compared by their normalized keys).
+
+static uint64_t mix64(uint64_t z) {
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+// Order-independent multiset fingerprint: two sums of differently salted
+// record hashes plus the count. Sums (unlike xor) do not cancel duplicated
+// records, so dropping or duplicating any record changes the result.
+struct Fingerprint {
+    uint64_t count = 0, sum1 = 0, sum2 = 0;
+
+    void add(int value) {
+        uint64_t v = static_cast<uint32_t>(value);
+        sum1 += mix64(v + 0x9E3779B97F4A7C15ULL);
+        sum2 += mix64(v ^ 0xD1B54A32D192ED03ULL);
+        count++;
+    }
+    void merge(const Fingerprint& other) {
+        count += other.count;
+        sum1 += other.sum1;
+        sum2 += other.sum2;
+    }
+    bool operator==(const Fingerprint& other) const {
+        return count == other.count && sum1 == other.sum1 && sum2 == other.sum2;
+    }
+};
+
+struct ChunkResult {
+    Fingerprint fp;
+    int first = 0, last = 0; // keys, not records
+    uint64_t violation = UINT64_MAX; // index of the first out-of-order record
+};
+
+static void scanChunk(const int* data, uint64_t begin, uint64_t end, bool checkOrder, const KeySpec& keys,
+                      ChunkResult& r) {
+    if (begin >= end) return;
+    r.first = keys.encode(data[begin]);
+    r.last = keys.encode(data[end - 1]);
+    int prev = r.first;
+    for (uint64_t i = begin; i < end; ++i) {
+        int v = data[i];
+        int key = keys.encode(v);
+        if (checkOrder && key < prev && r.violation == UINT64_MAX) r.violation = i;
+        prev = key;
+        r.fp.add(v);
+    }
+}
+
+struct FileSummary {
+    Fingerprint fp;
+    uint64_t violation = UINT64_MAX;
+    int before = 0, at = 0; // the offending pair
+};
+
+// Scans a whole file with `threads` threads. Falls back to sequential block
+// reads when the file cannot be mapped (pipes, "-").
+static bool scanFile(const std::string& path, bool checkOrder, const KeySpec& keys, unsigned threads,
+                     FileSummary& out) {
+    int fd = path == "-" ? STDIN_FILENO : open(path.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+    struct stat st;
+    void* map = MAP_FAILED;
+    size_t bytes = 0;
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+        bytes = static_cast<size_t>(st.st_size);
+        map = mmap(nullptr, bytes, PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+
+    if (map != MAP_FAILED) {
+        madvise(map, bytes, MADV_SEQUENTIAL);
+        const int* data = static_cast<const int*>(map);
+        uint64_t n = bytes / sizeof(int);
+        threads = static_cast<unsigned>(std::max<uint64_t>(1, std::min<uint64_t>(threads, n / (1 << 16) + 1)));
+        std::vector<ChunkResult> results(threads);
+        std::vector<std::thread> workers;
+        for (unsigned t = 0; t < threads; ++t) {
+            uint64_t begin = n * t / threads, end = n * (t + 1) / threads;
+            workers.emplace_back(scanChunk, data, begin, end, checkOrder, std::cref(keys), std::ref(results[t]));
+        }
+        for (auto& w : workers) w.join();
+
+        // Stitch chunks: order must also hold across each boundary.
+        bool havePrev = false;
+        int prevLast = 0;
+        for (unsigned t = 0; t < threads; ++t) {
+            uint64_t begin = n * t / threads;
+            const ChunkResult& r = results[t];
+            out.fp.merge(r.fp);
+            if (r.fp.count == 0) continue;
+            if (checkOrder && out.violation == UINT64_MAX) {
+                if (havePrev && r.first < prevLast) {
+                    out.violation = begin;
+                } else if (r.violation != UINT64_MAX) {
+                    out.violation = r.violation;
+                }
+                if (out.violation != UINT64_MAX) {
+                    out.before = data[out.violation - 1];
+                    out.at = data[out.violation];
+                }
+            }
+            prevLast = r.last;
+            havePrev = true;
+        }
+        munmap(map, bytes);
+    } else {
+        std::vector<int> block(1 << 20);
+        uint64_t index = 0;
+        int prev = INT_MIN, prevRecord = 0;
+        ssize_t got;
+        size_t carry = 0; // bytes of a partial record left from the last read
+        char* raw = reinterpret_cast<char*>(block.data());
+        while ((got = read(fd, raw + carry, block.size() * sizeof(int) - carry)) > 0) {
+            size_t total = carry + static_cast<size_t>(got);
+            size_t n = total / sizeof(int);
+            for (size_t i = 0; i < n; ++i, ++index) {
+                int v = block[i];
+                int key = keys.encode(v);
+                if (checkOrder && key < prev && out.violation == UINT64_MAX) {
+                    out.violation = index;
+                    out.before = prevRecord;
+                    out.at = v;
+                }
+                prev = key;
+                prevRecord = v;
+                out.fp.add(v);
+            }
+            carry = total - n * sizeof(int);
+            std::copy(raw + n * sizeof(int), raw + total, raw);
+        }
+    }
+    if (fd != STDIN_FILENO) close(fd);
+    return true;
+}
 
 int main(int argc, char* argv[]) {
-    if (argc != 2) {
-        std::cerr << "Usage: ./verify_sorted <file>" << std::endl;
+    std::vector<std::string> args(argv + 1, argv + argc);
+    unsigned threads = std::max(1u, std::thread::hardware_concurrency());
+    auto it = std::find(args.begin(), args.end(), "--threads");
+    if (it != args.end() && it + 1 != args.end()) {
+        try {
+            threads = std::max(1, std::stoi(*(it + 1)));
+        } catch (const std::exception&) {
+            std::cerr << "Invalid thread count: '" << *(it + 1) << "'." << std::endl;
+            return 1;
+        }
+        args.erase(it, it + 2);
+    }
+    KeySpec keys;
+    it = std::find(args.begin(), args.end(), "--key");
+    if (it != args.end() && it + 1 != args.end()) {
+        try {
+            keys = KeySpec::parse(*(it + 1));
+        } catch (const std::invalid_argument& e) {
+            std::cerr << e.what() << std::endl;
+            return 1;
+        }
+        args.erase(it, it + 2);
+    }
+    if (args.empty() || args.size() > 2) {
+        std::cerr << "Usage: ./verify_sorted <sorted_file|-> [input_file] [--threads N] [--key SPEC]" << std::endl;
         return 1;
     }
 
-    std::ifstream file(argv[1], std::ios::binary);
-    if (!file) {
-        std::cerr << "Error opening file: " << argv[1] << std::endl;
+    auto start = std::chrono::steady_clock::now();
+    FileSummary sorted;
+    if (!scanFile(args[0], true, keys, threads, sorted)) {
+        std::cerr << "Error opening file: " << args[0] << std::endl;
         return 1;
     }
-
-    int prev_val;
-    if (!file.read(reinterpret_cast<char*>(&prev_val), sizeof(int))) {
-        std::cout << "File is empty or contains only one element. It is considered sorted." << std::endl;
-        return 0;
+    if (sorted.violation != UINT64_MAX) {
+        std::cerr << "Verification failed: File is not sorted." << std::endl;
+        std::cerr << "Mismatch at index " << sorted.violation << ":" << std::endl;
+        std::cerr << "Previous value: " << sorted.before << std::endl;
+        std::cerr << "Current value: " << sorted.at << std::endl;
+        return 1;
     }
+    uint64_t scanned = sorted.fp.count;
 
-    int current_val;
-    long long count = 1;
-    while (file.read(reinterpret_cast<char*>(&current_val), sizeof(int))) {
-        if (current_val < prev_val) {
-            std::cerr << "Verification failed: File is not sorted." << std::endl;
-            std::cerr << "Mismatch at index " << count << ":" << std::endl;
-            std::cerr << "Previous value: " << prev_val << std::endl;
-            std::cerr << "Current value: " << current_val << std::endl;
+    if (args.size() == 2) {
+        FileSummary input;
+        if (!scanFile(args[1], false, keys, threads, input)) {
+            std::cerr << "Error opening file: " << args[1] << std::endl;
+            return 1;
+        }
+        scanned += input.fp.count;
+        if (!(input.fp == sorted.fp)) {
+            std::cerr << "Verification failed: Output is not a permutation of the input ("
+                      << sorted.fp.count << " records out, " << input.fp.count << " in)." << std::endl;
             return 1;
         }
-        prev_val = current_val;
-        count++;
     }
 
-    std::cout << "Verification successful: File is sorted." << std::endl;
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cout << "Verification successful: File is sorted";
+    if (args.size() == 2) std::cout << " and is a permutation of " << args[1];
+    std::cout << " (" << sorted.fp.count << " records, "
+              << (seconds > 0 ? scanned * sizeof(int) / seconds / (1024 * 1024) : 0) << " MB/s)." << std::endl;
     return 0;
 }